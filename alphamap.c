@@ -0,0 +1,114 @@
+#include "alphamap.h"
+#include "util.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <SDL.h>
+
+// The list of registered alpha maps. There is only a handful of images in a
+// map, so a list is good enough.
+static struct alphamap* alphamaps = NULL;
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+/*
+ * Sums a rectangle of a summed-area table of the given width.
+ */
+static uint32_t area_sum(const uint32_t* table, int w, const SDL_Rect* rect) {
+	int stride = w + 1;
+	int x1 = rect->x;
+	int y1 = rect->y;
+	int x2 = rect->x + rect->w;
+	int y2 = rect->y + rect->h;
+
+	return table[y2 * stride + x2] - table[y1 * stride + x2]
+	     - table[y2 * stride + x1] + table[y1 * stride + x1];
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+void alphamap_register(const SDL_Texture* texture, SDL_Surface* surface) {
+	// Read the pixels in a known format, whatever the image format was.
+	SDL_Surface* rgba = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+	if (rgba == NULL) {
+		debug_print("Unable to convert surface: %s\n", SDL_GetError());
+		return;
+	}
+
+	struct alphamap* am = malloc(sizeof(struct alphamap));
+	am->texture = texture;
+	am->w = rgba->w;
+	am->h = rgba->h;
+
+	int stride = am->w + 1;
+	am->opaque = calloc(stride * (am->h + 1), sizeof(uint32_t));
+	am->visible = calloc(stride * (am->h + 1), sizeof(uint32_t));
+
+	SDL_LockSurface(rgba);
+	for (int y = 0; y < am->h; y++) {
+		const Uint32* row = (const Uint32*)((const Uint8*)rgba->pixels + y * rgba->pitch);
+
+		// Running sums of the current row.
+		uint32_t opaque = 0;
+		uint32_t visible = 0;
+		for (int x = 0; x < am->w; x++) {
+			Uint8 r, g, b, a;
+			SDL_GetRGBA(row[x], rgba->format, &r, &g, &b, &a);
+			opaque  += a == 0xff;
+			visible += a != 0x00;
+
+			int idx = (y + 1) * stride + (x + 1);
+			am->opaque[idx]  = am->opaque[idx - stride]  + opaque;
+			am->visible[idx] = am->visible[idx - stride] + visible;
+		}
+	}
+	SDL_UnlockSurface(rgba);
+	SDL_FreeSurface(rgba);
+
+	am->next = alphamaps;
+	alphamaps = am;
+}
+
+void alphamap_unregister(const SDL_Texture* texture) {
+	for (struct alphamap** am = &alphamaps; *am != NULL; am = &(*am)->next) {
+		if ((*am)->texture == texture) {
+			struct alphamap* found = *am;
+			*am = found->next;
+			free(found->opaque);
+			free(found->visible);
+			free(found);
+			return;
+		}
+	}
+}
+
+const struct alphamap* alphamap_find(const SDL_Texture* texture) {
+	for (const struct alphamap* am = alphamaps; am != NULL; am = am->next) {
+		if (am->texture == texture) {
+			return am;
+		}
+	}
+	return NULL;
+}
+
+enum alpha_class alphamap_classify(const struct alphamap* am, const SDL_Rect* rect) {
+	if (rect->x < 0 || rect->y < 0 || rect->w <= 0 || rect->h <= 0
+		|| rect->x + rect->w > am->w || rect->y + rect->h > am->h) {
+		// Outside of the image, we can't tell.
+		return ALPHA_TRANSLUCENT;
+	}
+
+	uint32_t area = rect->w * rect->h;
+	if (area_sum(am->visible, am->w, rect) == 0) {
+		return ALPHA_EMPTY;
+	}
+	if (area_sum(am->opaque, am->w, rect) == area) {
+		return ALPHA_OPAQUE;
+	}
+	return ALPHA_TRANSLUCENT;
+}
@@ -0,0 +1,58 @@
+#ifndef ALPHAMAP_H
+#define ALPHAMAP_H
+
+#include <stdint.h>
+
+#include <SDL.h>
+
+/*
+ * How the pixels of a rectangle in an image cover what is behind them.
+ */
+enum alpha_class {
+	ALPHA_TRANSLUCENT, // Some pixels are (partially) transparent.
+	ALPHA_EMPTY,       // All pixels are fully transparent.
+	ALPHA_OPAQUE,      // All pixels are fully opaque.
+};
+
+/*
+ * An alpha map summarizes the alpha channel of an image, so any rectangle in
+ * it can be classified without the pixels. It consists of two summed-area
+ * tables: one counting the fully opaque pixels, and one counting the pixels
+ * which are not fully transparent.
+ *
+ * Alpha maps are registered for a texture when it is loaded, since that is
+ * the only time the pixels are available.
+ */
+struct alphamap {
+	const SDL_Texture* texture; // The texture this map belongs to.
+	int w;
+	int h;
+
+	uint32_t* opaque;  // (w + 1) * (h + 1) summed-area table.
+	uint32_t* visible; // (w + 1) * (h + 1) summed-area table.
+
+	struct alphamap* next;
+};
+
+/*
+ * Scans the pixels of the surface, and registers the alpha map of it for the
+ * texture which was created from it.
+ */
+void alphamap_register(const SDL_Texture* texture, SDL_Surface* surface);
+
+/*
+ * Removes the alpha map of the texture, if any.
+ */
+void alphamap_unregister(const SDL_Texture* texture);
+
+/*
+ * Returns the alpha map of the texture, or NULL when none was registered.
+ */
+const struct alphamap* alphamap_find(const SDL_Texture* texture);
+
+/*
+ * Classifies the pixels within the rectangle of the alpha map.
+ */
+enum alpha_class alphamap_classify(const struct alphamap* am, const SDL_Rect* rect);
+
+#endif // ALPHAMAP_H
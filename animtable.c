@@ -0,0 +1,136 @@
+#include "animtable.h"
+#include "util.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "tmx/tmx.h"
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct animtable* animtable_create(const tmx_map* map) {
+	int len = 0;
+	for (uint32_t gid = 0; gid < map->tilecount; gid++) {
+		if (map->tiles[gid] != NULL && map->tiles[gid]->animation_len > 0) {
+			len++;
+		}
+	}
+	if (len == 0) {
+		return NULL;
+	}
+
+	struct animtable* at = calloc(1, sizeof(struct animtable));
+	at->tiles = calloc(len, sizeof(struct anim_tile));
+	at->index_len = map->tilecount;
+	at->index = malloc(at->index_len * sizeof(int));
+
+	for (uint32_t gid = 0; gid < map->tilecount; gid++) {
+		at->index[gid] = -1;
+
+		const tmx_tile* tile = map->tiles[gid];
+		if (tile == NULL || tile->animation_len == 0) {
+			continue;
+		}
+
+		struct anim_tile* t = &at->tiles[at->len];
+		t->gid = gid;
+		t->frames_len = tile->animation_len;
+		t->frames = malloc(t->frames_len * sizeof(uint32_t));
+		t->ends = malloc(t->frames_len * sizeof(uint32_t));
+		t->current = -1;
+
+		for (int i = 0; i < t->frames_len; i++) {
+			// Frames refer to tiles by their id in the tileset, and the gid
+			// of this tile is the first gid of the tileset plus its id.
+			uint32_t frame = gid - tile->id + tile->animation[i].tile_id;
+			if (frame >= map->tilecount || map->tiles[frame] == NULL) {
+				debug_print("Animation of gid %u refers to invalid tile %u\n", gid, frame);
+				frame = 0;
+			}
+			t->frames[i] = frame;
+			t->duration += tile->animation[i].duration;
+			t->ends[i] = t->duration;
+		}
+
+		at->index[gid] = at->len++;
+	}
+
+	debug_print("Animation table has %d animated tiles\n", at->len);
+	return at;
+}
+
+void animtable_free(struct animtable* at) {
+	for (int i = 0; i < at->len; i++) {
+		free(at->tiles[i].frames);
+		free(at->tiles[i].ends);
+		free(at->tiles[i].cells);
+	}
+	free(at->tiles);
+	free(at->index);
+	free(at);
+}
+
+struct anim_tile* animtable_find(const struct animtable* at, uint32_t gid) {
+	gid &= TMX_FLIP_BITS_REMOVAL;
+	if (gid >= at->index_len || at->index[gid] < 0) {
+		return NULL;
+	}
+	return &at->tiles[at->index[gid]];
+}
+
+void animtable_add_cell(struct anim_tile* t, int layer, size_t idx) {
+	if (t->cells_len == t->cells_capacity) {
+		t->cells_capacity = t->cells_capacity > 0 ? t->cells_capacity * 2 : 16;
+		t->cells = realloc(t->cells, t->cells_capacity * sizeof(struct anim_cell));
+	}
+	t->cells[t->cells_len++] = (struct anim_cell){ layer, idx };
+}
+
+void animtable_remove_cell(struct anim_tile* t, int layer, size_t idx) {
+	for (int i = 0; i < t->cells_len; i++) {
+		if (t->cells[i].layer == layer && t->cells[i].idx == idx) {
+			// The order does not matter, so move the last one in its place.
+			t->cells[i] = t->cells[--t->cells_len];
+			return;
+		}
+	}
+}
+
+bool animtable_advance(struct animtable* at, uint32_t ticks) {
+	bool changed = false;
+	at->deadline = UINT32_MAX;
+
+	for (int i = 0; i < at->len; i++) {
+		struct anim_tile* t = &at->tiles[i];
+		t->changed = false;
+		if (t->duration == 0) {
+			// Frames without a duration; just show the first one.
+			t->changed = t->current != 0;
+			t->current = 0;
+			changed = changed || t->changed;
+			continue;
+		}
+
+		uint32_t time = ticks % t->duration;
+		int frame = 0;
+		while (t->ends[frame] <= time) {
+			frame++;
+		}
+		assert(frame < t->frames_len);
+
+		uint32_t deadline = ticks - time + t->ends[frame];
+		if (deadline < at->deadline) {
+			at->deadline = deadline;
+		}
+
+		if (frame != t->current) {
+			t->current = frame;
+			t->changed = true;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
@@ -0,0 +1,74 @@
+#ifndef ANIMTABLE_H
+#define ANIMTABLE_H
+
+#include "tmx/tmx.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A cell of a layer which holds an animated tile.
+ */
+struct anim_cell {
+	int layer;  // The index of the layer in the draw plan.
+	size_t idx; // The index of the cell in the layer.
+};
+
+/*
+ * An animated tile, and the cells in which it is used.
+ */
+struct anim_tile {
+	uint32_t gid;    // The animated gid, without the TMX flip bits.
+	uint32_t* frames; // The gid of every frame.
+	uint32_t* ends;   // The time every frame ends, in milliseconds since the start.
+	int frames_len;
+	uint32_t duration; // The duration of all frames together.
+
+	int current;  // The index of the current frame, -1 before the first one.
+	bool changed; // Whether the frame changed in the last animtable_advance.
+
+	struct anim_cell* cells;
+	int cells_len;
+	int cells_capacity;
+};
+
+/*
+ * The animation table contains every animated tile of a map. All animations
+ * are driven by one clock, so they stay in sync with each other, and advancing
+ * them only visits the animated tiles, not the cells of the map.
+ */
+struct animtable {
+	struct anim_tile* tiles;
+	int len;
+
+	int* index;         // Index in `tiles' by gid, or -1 when not animated.
+	uint32_t index_len;
+
+	uint32_t deadline; // The tick at which the next frame changes.
+};
+
+/*
+ * Creates the animation table from the tiles of the map. Returns NULL when no
+ * tile is animated.
+ */
+struct animtable* animtable_create(const tmx_map* map);
+void animtable_free(struct animtable* at);
+
+/*
+ * Returns the animated tile for the gid (which may include the flip bits), or
+ * NULL when the gid is not animated.
+ */
+struct anim_tile* animtable_find(const struct animtable* at, uint32_t gid);
+
+void animtable_add_cell(struct anim_tile* t, int layer, size_t idx);
+void animtable_remove_cell(struct anim_tile* t, int layer, size_t idx);
+
+/*
+ * Moves every animation to the frame at the given tick (as in SDL_GetTicks).
+ * Returns true when any frame changed, in which case the tiles which changed
+ * have their `changed' flag set.
+ */
+bool animtable_advance(struct animtable* at, uint32_t ticks);
+
+#endif // ANIMTABLE_H
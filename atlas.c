@@ -0,0 +1,389 @@
+#include "atlas.h"
+#include "alphamap.h"
+#include "util.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <SDL.h>
+
+// The size of a page is limited, even if the renderer supports larger
+// textures, since most of the page would be wasted on small maps.
+static const int MAX_PAGE_SIZE = 4096;
+static const int MIN_PAGE_SIZE = 256;
+
+/*
+ * The pixels of a texture, as registered by the image loader.
+ */
+struct atlas_source {
+	const SDL_Texture* texture;
+	SDL_Surface* surface; // Always in SDL_PIXELFORMAT_RGBA32.
+	struct atlas_source* next;
+};
+
+/*
+ * A rectangle of an image which is packed into a page: a single tile.
+ */
+struct atlas_item {
+	tmx_tile* tile;
+	int x, y, w, h; // The tile in the image.
+	int px, py;     // The top-left of the padding in the page.
+};
+
+/*
+ * The items of a single image, which are all packed on the same page, since
+ * the tilemap finds the texture of a tile through its image.
+ */
+struct atlas_group {
+	tmx_image* image;
+	SDL_Surface* surface;
+	struct atlas_item* items;
+	int items_len;
+	int w, h; // The largest item, including the padding.
+	int page;
+};
+
+/*
+ * The state of the shelf packer: items are placed left to right on a shelf,
+ * and a new shelf is started below the tallest item when a row is full.
+ */
+struct shelf {
+	int x, y, h;
+};
+
+// The list of registered surfaces. There is only a handful of images in a
+// map, so a list is good enough.
+static struct atlas_source* sources = NULL;
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+static SDL_Surface* find_surface(const SDL_Texture* texture) {
+	for (const struct atlas_source* s = sources; s != NULL; s = s->next) {
+		if (s->texture == texture) {
+			return s->surface;
+		}
+	}
+	return NULL;
+}
+
+static int clamp(int v, int min, int max) {
+	return v < min ? min : v > max ? max : v;
+}
+
+/*
+ * Adds a group for the given image, with room for `len' items. Returns NULL if
+ * the pixels of the image were not registered.
+ */
+static struct atlas_group* add_group(struct atlas_group** groups, int* groups_len, tmx_image* image, int len) {
+	if (image == NULL || image->resource_image == NULL) {
+		return NULL;
+	}
+	SDL_Surface* surface = find_surface(image->resource_image);
+	if (surface == NULL) {
+		return NULL;
+	}
+
+	*groups = realloc(*groups, (*groups_len + 1) * sizeof(struct atlas_group));
+	struct atlas_group* g = &(*groups)[(*groups_len)++];
+	g->image = image;
+	g->surface = surface;
+	g->items = calloc(len, sizeof(struct atlas_item));
+	g->items_len = 0;
+	g->w = 0;
+	g->h = 0;
+	g->page = -1;
+	return g;
+}
+
+/*
+ * Adds a tile to a group. Returns false if the tile lies outside of the image.
+ */
+static bool add_item(struct atlas_group* g, tmx_tile* tile, int x, int y, int w, int h, int padding) {
+	if (w <= 0 || h <= 0 || x < 0 || y < 0 || x + w > g->surface->w || y + h > g->surface->h) {
+		return false;
+	}
+
+	struct atlas_item* it = &g->items[g->items_len++];
+	it->tile = tile;
+	it->x = x;
+	it->y = y;
+	it->w = w;
+	it->h = h;
+
+	if (w + 2 * padding > g->w) {
+		g->w = w + 2 * padding;
+	}
+	if (h + 2 * padding > g->h) {
+		g->h = h + 2 * padding;
+	}
+	return true;
+}
+
+/*
+ * Collects the groups to pack: one per tileset image, with an item for every
+ * tile, and one per tile of an image collection.
+ */
+static void collect_groups(tmx_map* map, int padding, struct atlas_group** groups, int* groups_len) {
+	for (tmx_tileset_list* tl = map->ts_head; tl != NULL; tl = tl->next) {
+		tmx_tileset* ts = tl->tileset;
+
+		if (ts->image != NULL) {
+			struct atlas_group* g = add_group(groups, groups_len, ts->image, ts->tilecount);
+			if (g == NULL) {
+				continue;
+			}
+			for (unsigned int i = 0; i < ts->tilecount; i++) {
+				tmx_tile* tile = &ts->tiles[i];
+				if (!add_item(g, tile, tile->ul_x, tile->ul_y, ts->tile_width, ts->tile_height, padding)) {
+					// A broken tileset: leave the whole image as it is.
+					free(g->items);
+					(*groups_len)--;
+					break;
+				}
+			}
+			continue;
+		}
+
+		for (unsigned int i = 0; i < ts->tilecount; i++) {
+			tmx_tile* tile = &ts->tiles[i];
+			struct atlas_group* g = add_group(groups, groups_len, tile->image, 1);
+			if (g == NULL) {
+				continue;
+			}
+			if (!add_item(g, tile, 0, 0, g->surface->w, g->surface->h, padding)) {
+				free(g->items);
+				(*groups_len)--;
+			}
+		}
+	}
+}
+
+static int compare_groups(const void* a, const void* b) {
+	const struct atlas_group* ga = a;
+	const struct atlas_group* gb = b;
+	// Tallest first, which keeps the shelves filled.
+	return gb->h - ga->h;
+}
+
+/*
+ * Finds a place for an item of the given size on the current page.
+ */
+static bool place(struct shelf* s, int size, int w, int h, int* px, int* py) {
+	if (s->x + w > size) {
+		s->y += s->h;
+		s->x = 0;
+		s->h = 0;
+	}
+	if (w > size || s->y + h > size) {
+		return false;
+	}
+
+	*px = s->x;
+	*py = s->y;
+	s->x += w;
+	if (h > s->h) {
+		s->h = h;
+	}
+	return true;
+}
+
+/*
+ * Places all items of a group on the current page. Returns false, and leaves
+ * the shelf untouched, if they do not all fit.
+ */
+static bool place_group(struct shelf* s, int size, struct atlas_group* g, int padding) {
+	struct shelf saved = *s;
+	for (int i = 0; i < g->items_len; i++) {
+		struct atlas_item* it = &g->items[i];
+		if (!place(s, size, it->w + 2 * padding, it->h + 2 * padding, &it->px, &it->py)) {
+			*s = saved;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Copies an item into a page, and repeats its edge pixels into the padding.
+ */
+static void copy_item(SDL_Surface* page, const SDL_Surface* src, const struct atlas_item* it, int padding) {
+	for (int y = -padding; y < it->h + padding; y++) {
+		int sy = it->y + clamp(y, 0, it->h - 1);
+		const Uint32* srow = (const Uint32*)((const Uint8*)src->pixels + sy * src->pitch);
+		Uint32* drow = (Uint32*)((Uint8*)page->pixels + (it->py + padding + y) * page->pitch);
+
+		for (int x = -padding; x < it->w + padding; x++) {
+			drow[it->px + padding + x] = srow[it->x + clamp(x, 0, it->w - 1)];
+		}
+	}
+}
+
+/*
+ * Creates the texture of a page from the groups which were placed on it.
+ */
+static SDL_Texture* create_page(SDL_Renderer* r, struct atlas_group* groups, int groups_len, int page, int w, int h, int padding) {
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_RGBA32);
+	if (surface == NULL) {
+		debug_print("Unable to create atlas page: %s\n", SDL_GetError());
+		return NULL;
+	}
+
+	SDL_FillRect(surface, NULL, 0);
+	SDL_LockSurface(surface);
+	for (int i = 0; i < groups_len; i++) {
+		if (groups[i].page != page) {
+			continue;
+		}
+		for (int j = 0; j < groups[i].items_len; j++) {
+			copy_item(surface, groups[i].surface, &groups[i].items[j], padding);
+		}
+	}
+	SDL_UnlockSurface(surface);
+
+	SDL_Texture* texture = SDL_CreateTextureFromSurface(r, surface);
+	if (texture != NULL) {
+		alphamap_register(texture, surface);
+	} else {
+		debug_print("Unable to create atlas texture: %s\n", SDL_GetError());
+	}
+
+	SDL_FreeSurface(surface);
+	return texture;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+void atlas_register(const SDL_Texture* texture, SDL_Surface* surface) {
+	SDL_Surface* rgba = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+	if (rgba == NULL) {
+		debug_print("Unable to convert surface: %s\n", SDL_GetError());
+		return;
+	}
+
+	struct atlas_source* s = malloc(sizeof(struct atlas_source));
+	s->texture = texture;
+	s->surface = rgba;
+	s->next = sources;
+	sources = s;
+}
+
+void atlas_unregister(const SDL_Texture* texture) {
+	for (struct atlas_source** s = &sources; *s != NULL; s = &(*s)->next) {
+		if ((*s)->texture == texture) {
+			struct atlas_source* found = *s;
+			*s = found->next;
+			SDL_FreeSurface(found->surface);
+			free(found);
+			return;
+		}
+	}
+}
+
+struct atlas* atlas_create(SDL_Renderer* r, tmx_map* map, int padding) {
+	assert(padding >= 0);
+
+	struct atlas_group* groups = NULL;
+	int groups_len = 0;
+	collect_groups(map, padding, &groups, &groups_len);
+
+	SDL_RendererInfo info;
+	int max_size = MAX_PAGE_SIZE;
+	if (SDL_GetRendererInfo(r, &info) == 0 && info.max_texture_width > 0) {
+		int max_texture = SDL_min(info.max_texture_width, info.max_texture_height);
+		max_size = SDL_min(max_size, max_texture);
+	}
+
+	// Start with the smallest square page which could hold everything.
+	int64_t area = 0;
+	for (int i = 0; i < groups_len; i++) {
+		for (int j = 0; j < groups[i].items_len; j++) {
+			area += (int64_t)(groups[i].items[j].w + 2 * padding) * (groups[i].items[j].h + 2 * padding);
+		}
+	}
+	int size = MIN_PAGE_SIZE;
+	while (size < max_size && (int64_t)size * size < area + area / 8) {
+		size *= 2;
+	}
+	size = SDL_min(size, max_size);
+
+	qsort(groups, groups_len, sizeof(struct atlas_group), compare_groups);
+
+	// Place the groups, and remember how much of every page is used, so the
+	// last page is not larger than it has to be.
+	int pages_len = 0;
+	int* heights = NULL;
+	struct shelf s = { 0, 0, 0 };
+	for (int i = 0; i < groups_len; i++) {
+		struct atlas_group* g = &groups[i];
+		if (pages_len == 0 || !place_group(&s, size, g, padding)) {
+			s = (struct shelf){ 0, 0, 0 };
+			if (!place_group(&s, size, g, padding)) {
+				debug_print("Image does not fit in an atlas page of %d x %d\n", size, size);
+				continue;
+			}
+			heights = realloc(heights, (pages_len + 1) * sizeof(int));
+			pages_len++;
+		}
+		g->page = pages_len - 1;
+		heights[g->page] = s.y + s.h;
+	}
+
+	struct atlas* a = NULL;
+	if (pages_len > 0) {
+		a = calloc(1, sizeof(struct atlas));
+		a->pages = calloc(pages_len, sizeof(SDL_Texture*));
+		a->pages_len = pages_len;
+		a->images = calloc(groups_len, sizeof(tmx_image*));
+		for (int p = 0; p < pages_len; p++) {
+			a->pages[p] = create_page(r, groups, groups_len, p, size, heights[p], padding);
+		}
+	}
+
+	// Point the packed tiles to their page, and free the original textures.
+	for (int i = 0; a != NULL && i < groups_len; i++) {
+		struct atlas_group* g = &groups[i];
+		if (g->page < 0 || a->pages[g->page] == NULL) {
+			continue;
+		}
+		for (int j = 0; j < g->items_len; j++) {
+			g->items[j].tile->ul_x = g->items[j].px + padding;
+			g->items[j].tile->ul_y = g->items[j].py + padding;
+		}
+		if (tmx_img_free_func != NULL) {
+			tmx_img_free_func(g->image->resource_image);
+		}
+		g->image->resource_image = a->pages[g->page];
+		a->images[a->images_len++] = g->image;
+	}
+
+	debug_print("Packed %d of %d images into %d atlas pages of %d pixels wide\n",
+		a != NULL ? a->images_len : 0, groups_len, pages_len, size);
+
+	for (int i = 0; i < groups_len; i++) {
+		free(groups[i].items);
+	}
+	free(groups);
+	free(heights);
+	return a;
+}
+
+void atlas_free(struct atlas* a) {
+	for (int i = 0; i < a->images_len; i++) {
+		a->images[i]->resource_image = NULL;
+	}
+	for (int p = 0; p < a->pages_len; p++) {
+		if (a->pages[p] != NULL) {
+			alphamap_unregister(a->pages[p]);
+			SDL_DestroyTexture(a->pages[p]);
+		}
+	}
+	free(a->pages);
+	free(a->images);
+	free(a);
+}
@@ -0,0 +1,54 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "tmx/tmx.h"
+
+#include <SDL.h>
+
+/*
+ * An atlas packs the tiles of every tileset of a map into one or a few large
+ * textures, called pages. Tiles of different tilesets can then be drawn in the
+ * same batch, without switching textures. Every tile is surrounded by a border
+ * of padding, which repeats its edge pixels, so filtering or rounding never
+ * samples a neighbouring tile.
+ *
+ * Packing needs the pixels of the tileset images, which are gone once they
+ * have been turned into textures. The image loader therefore registers the
+ * surface of every texture it creates with atlas_register.
+ */
+struct atlas {
+	SDL_Texture** pages; // The packed textures, owned by the atlas.
+	int pages_len;
+
+	tmx_image** images;  // The images whose texture was replaced by a page.
+	int images_len;
+};
+
+/*
+ * Keeps a copy of the pixels of a surface, which was used to create the given
+ * texture, so the texture can be packed into an atlas later on.
+ */
+void atlas_register(const SDL_Texture* texture, SDL_Surface* surface);
+
+/*
+ * Releases the pixels registered for the given texture, if there are any.
+ */
+void atlas_unregister(const SDL_Texture* texture);
+
+/*
+ * Packs the tilesets of the map into pages, with `padding' pixels around every
+ * tile. The `ul_x' and `ul_y' coordinates of the packed tiles are rewritten to
+ * their position in the page, and the texture of their image is replaced by the
+ * page (the original texture is freed). Tilesets which were not registered, or
+ * which do not fit on a page, are left alone. Returns NULL if nothing was
+ * packed.
+ */
+struct atlas* atlas_create(SDL_Renderer* r, tmx_map* map, int padding);
+
+/*
+ * Frees the pages of the atlas. The images which refer to a page are reset,
+ * so the atlas must be freed before the map is.
+ */
+void atlas_free(struct atlas* a);
+
+#endif // ATLAS_H
@@ -2,33 +2,50 @@
 #include "player.h"
 #include "tilemap.h"
 
+/*
+ * Keeps a view of `view' units at `pos' within a map of `size' units along a
+ * single axis.
+ */
+static float clamp_view(float pos, float view, float size) {
+	if (view >= size) {
+		return (size - view) / 2.0f;
+	}
+	return fminf(fmaxf(pos, 0.0f), size - view);
+}
+
 struct camera* camera_create(int winwidth, int winheight) {
 	debug_print("Camera initializing with window width: %d, height: %d\n", winwidth, winheight);
 	struct camera* cam = malloc(sizeof(struct camera));
+	cam->x = 0;
+	cam->y = 0;
 	cam->winwidth = winwidth;
 	cam->winheight = winheight;
+	cam->scale = 1.0f;
 	return cam;
 }
 
-void camera_update(struct camera* cam, const struct player* p, const struct tilemap* map) {
-	// TODO: smooth lerping
-
-	uint32_t mapwidth  = (map->map->width)  * map->tilewidth - p->w;
-	uint32_t mapheight = (map->map->height) * map->tileheight - p->h;
+bool camera_zoom(struct camera* cam, float factor) {
+	float scale = fminf(fmaxf(cam->scale * factor, CAMERA_MIN_SCALE), CAMERA_MAX_SCALE);
+	if (scale == cam->scale) {
+		return false;
+	}
+	cam->scale = scale;
+	return true;
+}
 
-	uint32_t xmin = 0;
-	uint32_t xmax = mapwidth - cam->winwidth + p->w;
+bool camera_update(struct camera* cam, const struct player* p, const struct tilemap* map) {
+	// TODO: smooth lerping
 
-	uint32_t ymin = 0;
-	uint32_t ymax = mapheight - cam->winheight + p->h;
+	float oldx = cam->x;
+	float oldy = cam->y;
 
-	// Increase the x viewport based on the player position, but keep
-	// within bounds of the map. We do a float division to get a better
-	// result for the max values.
-	cam->x = p->x - ((float)cam->winwidth / 2.0);
-	cam->x = fmin(fmax(cam->x, xmin), xmax);
+	float mapwidth  = map->map->width  * map->tilewidth;
+	float mapheight = map->map->height * map->tileheight;
 
-	cam->y = p->y - ((float)cam->winheight / 2.0);
-	cam->y = fmin(fmax(cam->y, ymin), ymax);
+	// Center the viewport on the player, but keep within the bounds of the
+	// map. We do a float division to get a better result for the max values.
+	cam->x = clamp_view(p->x - ((float)cam->winwidth / 2.0), cam->winwidth, mapwidth);
+	cam->y = clamp_view(p->y - ((float)cam->winheight / 2.0), cam->winheight, mapheight);
 
+	return cam->x != oldx || cam->y != oldy;
 }
@@ -1,22 +1,41 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <stdbool.h>
+
 // Forward declaration to satisfy the dependency of player.
 // player.h includes camera.h, meaning camera.h cannot include
 // player.h for usage since it would be a circular dependency.
 struct player;
 struct tilemap;
 
+// How far the camera can be zoomed in and out.
+#define CAMERA_MIN_SCALE 0.03125f
+#define CAMERA_MAX_SCALE 4.0f
+
 struct camera {
 	float x;
 	float y;
-	int winwidth;
-	int winheight;
+	int winwidth;  // The size of the visible part of the world, in world
+	int winheight; // units. This is the window size divided by the scale.
+	float scale;   // Window pixels per world unit, 1 unless zoomed.
 };
 
 struct camera* camera_create(int winwidth, int winheight);
 
-void camera_update(struct camera* cam, const struct player* p, const struct tilemap* map);
+/*
+ * Multiplies the scale of the camera by `factor', keeping it between
+ * CAMERA_MIN_SCALE and CAMERA_MAX_SCALE. The window size is left alone, which
+ * is up to the caller. Returns true when the scale changed.
+ */
+bool camera_zoom(struct camera* cam, float factor);
+
+/*
+ * Centers the camera on the player, keeping it within the bounds of the map.
+ * When the map is smaller than the view, the map is centered instead. Returns
+ * true when the camera moved.
+ */
+bool camera_update(struct camera* cam, const struct player* p, const struct tilemap* map);
 
 
 #endif // CAMERA_H
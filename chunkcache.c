@@ -0,0 +1,184 @@
+#include "chunkcache.h"
+#include "coordmap.h"
+#include "util.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <SDL.h>
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+static void lru_unlink(struct chunkcache* cc, struct chunk* c) {
+	if (c->prev != NULL) {
+		c->prev->next = c->next;
+	} else {
+		cc->lru_head = c->next;
+	}
+
+	if (c->next != NULL) {
+		c->next->prev = c->prev;
+	} else {
+		cc->lru_tail = c->prev;
+	}
+
+	c->prev = NULL;
+	c->next = NULL;
+}
+
+static void lru_push_front(struct chunkcache* cc, struct chunk* c) {
+	c->prev = NULL;
+	c->next = cc->lru_head;
+	if (cc->lru_head != NULL) {
+		cc->lru_head->prev = c;
+	}
+	cc->lru_head = c;
+	if (cc->lru_tail == NULL) {
+		cc->lru_tail = c;
+	}
+}
+
+static size_t chunk_size(const struct chunkcache* cc) {
+	// Chunk textures are 32 bits per pixel.
+	return (size_t)cc->pixel_w * cc->pixel_h * 4;
+}
+
+/*
+ * Destroys the texture of a resident chunk, and removes it from the list. The
+ * chunk itself goes as well, it is made again when it is needed.
+ */
+static void evict(struct chunkcache* cc, struct chunk* c) {
+	assert(c->texture != NULL);
+
+	lru_unlink(cc, c);
+	SDL_DestroyTexture(c->texture);
+	cc->used -= chunk_size(cc);
+	cc->resident--;
+
+	coordmap_remove(cc->chunks[c->layer], c->cx, c->cy);
+	free(c);
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct chunkcache* chunkcache_create(int layer_count, int map_width, int map_height, int chunk_tiles, size_t budget) {
+	struct chunkcache* cc = calloc(1, sizeof(struct chunkcache));
+
+	cc->chunk_tiles = chunk_tiles;
+	cc->chunks_w = (map_width  + chunk_tiles - 1) / chunk_tiles;
+	cc->chunks_h = (map_height + chunk_tiles - 1) / chunk_tiles;
+	cc->layer_count = layer_count;
+	cc->budget = budget;
+
+	cc->chunks = calloc(layer_count, sizeof(struct coordmap*));
+	for (int l = 0; l < layer_count; l++) {
+		cc->chunks[l] = coordmap_create();
+	}
+
+	debug_print("Chunk cache created: %d layers of %d x %d chunks, budget %zu bytes\n",
+		layer_count, cc->chunks_w, cc->chunks_h, budget);
+
+	return cc;
+}
+
+void chunkcache_free(struct chunkcache* cc) {
+	chunkcache_invalidate(cc, 0, 0);
+
+	// What is left are the chunks which never got a texture.
+	for (int l = 0; l < cc->layer_count; l++) {
+		struct coordmap* chunks = cc->chunks[l];
+		for (uint32_t i = 0; i < chunks->capacity; i++) {
+			free(chunks->slots[i].value);
+		}
+		coordmap_free(chunks);
+	}
+	free(cc->chunks);
+	cc->chunks = NULL;
+	free(cc);
+}
+
+struct chunk* chunkcache_get(struct chunkcache* cc, int layer, int cx, int cy) {
+	assert(layer >= 0 && layer < cc->layer_count);
+	assert(cx >= 0 && cx < cc->chunks_w);
+	assert(cy >= 0 && cy < cc->chunks_h);
+
+	struct chunk* c = coordmap_get(cc->chunks[layer], cx, cy);
+	if (c == NULL) {
+		c = calloc(1, sizeof(struct chunk));
+		if (c == NULL || !coordmap_put(cc->chunks[layer], cx, cy, c)) {
+			debug_print("Unable to allocate chunk (%d, %d) of layer %d\n", cx, cy, layer);
+			free(c);
+			return NULL;
+		}
+		c->layer = layer;
+		c->cx = cx;
+		c->cy = cy;
+	}
+
+	if (c->texture != NULL && cc->lru_head != c) {
+		lru_unlink(cc, c);
+		lru_push_front(cc, c);
+	}
+	return c;
+}
+
+struct chunk* chunkcache_peek(struct chunkcache* cc, int layer, int cx, int cy) {
+	assert(layer >= 0 && layer < cc->layer_count);
+	assert(cx >= 0 && cx < cc->chunks_w);
+	assert(cy >= 0 && cy < cc->chunks_h);
+
+	return coordmap_get(cc->chunks[layer], cx, cy);
+}
+
+void chunkcache_dirty(struct chunkcache* cc, int layer, int cx, int cy) {
+	struct chunk* c = chunkcache_peek(cc, layer, cx, cy);
+	if (c != NULL) {
+		c->baked = false;
+	}
+}
+
+bool chunkcache_bind(struct chunkcache* cc, struct chunk* c, SDL_Renderer* r) {
+	if (c->texture != NULL) {
+		return true;
+	}
+
+	size_t size = chunk_size(cc);
+	if (size == 0 || size > cc->budget) {
+		// A single chunk does not even fit in the budget.
+		return false;
+	}
+
+	while (cc->used + size > cc->budget && cc->lru_tail != NULL) {
+		evict(cc, cc->lru_tail);
+	}
+
+	c->texture = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, cc->pixel_w, cc->pixel_h);
+	if (c->texture == NULL) {
+		debug_print("Unable to create chunk texture: %s\n", SDL_GetError());
+		return false;
+	}
+	SDL_SetTextureBlendMode(c->texture, SDL_BLENDMODE_BLEND);
+
+	c->baked = false;
+	lru_push_front(cc, c);
+	cc->used += size;
+	cc->resident++;
+
+	return true;
+}
+
+void chunkcache_invalidate(struct chunkcache* cc, float tilewidth, float tileheight) {
+	while (cc->lru_tail != NULL) {
+		evict(cc, cc->lru_tail);
+	}
+
+	cc->tilewidth = tilewidth;
+	cc->tileheight = tileheight;
+	cc->pixel_w = ceilf(cc->chunk_tiles * tilewidth);
+	cc->pixel_h = ceilf(cc->chunk_tiles * tileheight);
+}
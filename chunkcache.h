@@ -0,0 +1,97 @@
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <SDL.h>
+
+struct coordmap;
+
+/*
+ * A chunk is a square part of a single tile layer, which is baked into a
+ * render target texture once, and drawn with a single copy afterwards.
+ */
+struct chunk {
+	SDL_Texture* texture; // NULL when the chunk is not resident.
+	bool baked;           // Whether the texture contains the tiles yet.
+
+	int layer; // The index of the layer this chunk belongs to.
+	int cx;    // The chunk x coordinate (in chunks, not tiles).
+	int cy;    // The chunk y coordinate (in chunks, not tiles).
+
+	// Links in the least recently used list of resident chunks.
+	struct chunk* prev;
+	struct chunk* next;
+};
+
+/*
+ * The chunk cache keeps track of the chunks of every layer which are in use,
+ * and the textures of those which are resident. A chunk is only made when it
+ * is first asked for, so the size of the map does not matter, only the area
+ * which is drawn. The textures are kept within a memory budget: when baking a
+ * new chunk would exceed it, the least recently used chunks are discarded
+ * first, along with their chunk.
+ */
+struct chunkcache {
+	int chunk_tiles; // Width and height of a chunk, in tiles.
+	int chunks_w;    // Amount of chunks horizontally, per layer.
+	int chunks_h;    // Amount of chunks vertically, per layer.
+	int layer_count; // Amount of layers.
+
+	// The chunks of every layer, keyed on their chunk coordinate.
+	struct coordmap** chunks;
+
+	struct chunk* lru_head; // Most recently used resident chunk.
+	struct chunk* lru_tail; // Least recently used resident chunk.
+
+	size_t budget;  // Maximum texture memory, in bytes.
+	size_t used;    // Texture memory currently in use, in bytes.
+	int resident;   // Amount of chunks which have a texture.
+
+	// The tile size in pixels the current chunks were baked with, and the
+	// resulting size of a chunk texture in pixels.
+	float tilewidth;
+	float tileheight;
+	int pixel_w;
+	int pixel_h;
+};
+
+struct chunkcache* chunkcache_create(int layer_count, int map_width, int map_height, int chunk_tiles, size_t budget);
+void chunkcache_free(struct chunkcache* cc);
+
+/*
+ * Gets the chunk at chunk coordinate (cx, cy) of the given layer, which is
+ * made when it does not exist yet. When the chunk is resident, it is marked as
+ * the most recently used one. Returns NULL when it could not be made.
+ */
+struct chunk* chunkcache_get(struct chunkcache* cc, int layer, int cx, int cy);
+
+/*
+ * Gets the chunk at chunk coordinate (cx, cy) of the given layer, without
+ * marking it as used. Returns NULL when it does not exist.
+ */
+struct chunk* chunkcache_peek(struct chunkcache* cc, int layer, int cx, int cy);
+
+/*
+ * Marks the chunk at chunk coordinate (cx, cy) of the given layer as out of
+ * date, so it is baked again the next time it comes into view. Its texture is
+ * kept, if it has one. A chunk which does not exist has nothing to bake again.
+ */
+void chunkcache_dirty(struct chunkcache* cc, int layer, int cx, int cy);
+
+/*
+ * Makes sure the chunk has a render target texture, evicting the least
+ * recently used chunks when the budget would be exceeded. Returns false if no
+ * texture could be created, in which case the caller should draw the tiles
+ * of the chunk directly.
+ */
+bool chunkcache_bind(struct chunkcache* cc, struct chunk* c, SDL_Renderer* r);
+
+/*
+ * Discards every resident chunk, so they will be baked again using the given
+ * tile size (in pixels) the next time they come into view.
+ */
+void chunkcache_invalidate(struct chunkcache* cc, float tilewidth, float tileheight);
+
+#endif // CHUNKCACHE_H
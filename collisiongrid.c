@@ -0,0 +1,505 @@
+#include "collisiongrid.h"
+#include "coordmap.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tmx/tmx.h"
+
+// The amount of solid tiles to the left of every row of a grid which is not
+// sparse.
+static const int BORDER_BITS = 32;
+
+// What a search of the grid looks for.
+enum find_mode {
+	FIND_SOLID,   // Tiles which are solid, including the border.
+	FIND_WHOLE,   // Tiles which are solid all over, including the border.
+	FIND_PARTIAL, // Tiles which are only partly solid.
+};
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+static inline int clamp(int v, int lo, int hi) {
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/*
+ * Returns the row of a set of bits of a grid which is not sparse, which holds
+ * the tiles at y. That may be -1 or `height' for the border.
+ */
+static inline uint32_t* row_in(const struct collisiongrid* g, uint32_t* bits, int y) {
+	return &bits[(size_t)(y + 1) * g->stride];
+}
+
+static inline void set_bit(uint32_t* row, int x, bool set) {
+	int b = x + BORDER_BITS;
+	uint32_t mask = 1u << (b & 31);
+	if (set) {
+		row[b >> 5] |= mask;
+	} else {
+		row[b >> 5] &= ~mask;
+	}
+}
+
+/*
+ * Finds the first tile from (x1, y1) up to and including (x2, y2) which is set
+ * in `bits', and not in `exclude' unless that is NULL, going row by row. The
+ * area must be clamped into the border already.
+ */
+static inline bool find_in_rows(const struct collisiongrid* g, uint32_t* bits, uint32_t* exclude, int x1, int y1, int x2, int y2, int* hit_x, int* hit_y) {
+	int b1 = x1 + BORDER_BITS;
+	int b2 = x2 + BORDER_BITS;
+	int w1 = b1 >> 5;
+	int w2 = b2 >> 5;
+	uint32_t first = ~0u << (b1 & 31);
+	uint32_t last = ~0u >> (31 - (b2 & 31));
+	if (w1 == w2) {
+		first &= last;
+	}
+
+	for (int y = y1; y <= y2; y++) {
+		const uint32_t* row = row_in(g, bits, y);
+		const uint32_t* skip = exclude != NULL ? row_in(g, exclude, y) : NULL;
+		for (int w = w1; w <= w2; w++) {
+			uint32_t word = row[w];
+			if (skip != NULL) {
+				word &= ~skip[w];
+			}
+			if (w == w1) {
+				word &= first;
+			} else if (w == w2) {
+				word &= last;
+			}
+			if (word != 0) {
+				if (hit_x != NULL) {
+					*hit_x = (w << 5) + __builtin_ctz(word) - BORDER_BITS;
+					*hit_y = y;
+				}
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static inline struct collisiongrid_block* block_at(const struct collisiongrid* g, int x, int y) {
+	return coordmap_get(g->blocks, x / COLLISIONGRID_BLOCK, y / COLLISIONGRID_BLOCK);
+}
+
+/*
+ * Returns the row of a block with the tiles which a search looks for.
+ */
+static inline uint32_t row_of(const struct collisiongrid_block* b, enum find_mode mode, int y) {
+	switch (mode) {
+	case FIND_SOLID:
+		return b->bits[y];
+	case FIND_WHOLE:
+		return b->bits[y] & ~b->partial[y];
+	default:
+		return b->partial[y];
+	}
+}
+
+/*
+ * Finds the first tile from (x1, y1) up to and including (x2, y2) of a sparse
+ * grid which a search looks for, going row by row. The area must be within the
+ * map, or empty.
+ */
+static bool find_in_map(const struct collisiongrid* g, enum find_mode mode, int x1, int y1, int x2, int y2, int* hit_x, int* hit_y) {
+	if (x1 > x2 || y1 > y2) {
+		return false;
+	}
+
+	const int n = COLLISIONGRID_BLOCK;
+	for (int by = y1 / n; by <= y2 / n; by++) {
+		int ry1 = SDL_max(y1 - by * n, 0);
+		int ry2 = SDL_min(y2 - by * n, n - 1);
+
+		// Blocks further to the right only win with a hit in an earlier row.
+		int best_x = 0;
+		int best_y = -1;
+		for (int bx = x1 / n; bx <= x2 / n; bx++) {
+			const struct collisiongrid_block* b = coordmap_get(g->blocks, bx, by);
+			if (b == NULL) {
+				continue;
+			}
+			int rx1 = SDL_max(x1 - bx * n, 0);
+			int rx2 = SDL_min(x2 - bx * n, n - 1);
+			uint32_t mask = (~0u << rx1) & (~0u >> (n - 1 - rx2));
+			int last = best_y >= 0 ? best_y - 1 : ry2;
+			for (int y = ry1; y <= last; y++) {
+				uint32_t word = row_of(b, mode, y) & mask;
+				if (word != 0) {
+					best_x = bx * n + __builtin_ctz(word);
+					best_y = y;
+					break;
+				}
+			}
+			if (best_y == ry1) {
+				break;
+			}
+		}
+		if (best_y >= 0) {
+			if (hit_x != NULL) {
+				*hit_x = best_x;
+				*hit_y = by * n + best_y;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline bool hit_at(int x, int y, int* hit_x, int* hit_y) {
+	if (hit_x != NULL) {
+		*hit_x = x;
+		*hit_y = y;
+	}
+	return true;
+}
+
+/*
+ * Finds the first tile from (x1, y1) up to and including (x2, y2) which a
+ * search looks for, going row by row. The border around the map is only one
+ * tile wide, so that the tile which is found is never far outside of it.
+ */
+static inline bool find_in(const struct collisiongrid* g, enum find_mode mode, int x1, int y1, int x2, int y2, int* hit_x, int* hit_y) {
+	if (x1 > x2 || y1 > y2) {
+		return false;
+	}
+	x1 = clamp(x1, -1, g->width);
+	x2 = clamp(x2, -1, g->width);
+	y1 = clamp(y1, -1, g->height);
+	y2 = clamp(y2, -1, g->height);
+
+	if (g->blocks == NULL) {
+		// The border is in the bits, so the clamped area needs no more
+		// tests.
+		switch (mode) {
+		case FIND_SOLID:
+			return find_in_rows(g, g->bits, NULL, x1, y1, x2, y2, hit_x, hit_y);
+		case FIND_WHOLE:
+			return find_in_rows(g, g->bits, g->partial, x1, y1, x2, y2, hit_x, hit_y);
+		default:
+			return g->partial != NULL && find_in_rows(g, g->partial, NULL, x1, y1, x2, y2, hit_x, hit_y);
+		}
+	}
+
+	if (mode == FIND_PARTIAL) {
+		// The border is solid all over.
+		return find_in_map(g, mode,
+			SDL_max(x1, 0), SDL_max(y1, 0), SDL_min(x2, g->width - 1), SDL_min(y2, g->height - 1),
+			hit_x, hit_y);
+	}
+
+	if (x1 < 0 || y1 < 0 || x1 >= g->width || y1 >= g->height) {
+		return hit_at(x1, y1, hit_x, hit_y);
+	}
+	if (x2 >= g->width) {
+		// Every row ends in the border, so the first row has a hit.
+		if (find_in_map(g, mode, x1, y1, g->width - 1, y1, hit_x, hit_y)) {
+			return true;
+		}
+		return hit_at(g->width, y1, hit_x, hit_y);
+	}
+	if (find_in_map(g, mode, x1, y1, x2, SDL_min(y2, g->height - 1), hit_x, hit_y)) {
+		return true;
+	}
+	if (y2 >= g->height) {
+		return hit_at(x1, g->height, hit_x, hit_y);
+	}
+	return false;
+}
+
+/*
+ * Tests a single box of which the tile range is known, and records the hit.
+ */
+static inline int find_box(const struct collisiongrid* g, int i, int x1, int y1, int x2, int y2, uint32_t* hits, int* hit_x, int* hit_y) {
+	int tx, ty;
+	if (!find_in(g, FIND_SOLID, x1, y1, x2, y2, &tx, &ty)) {
+		return 0;
+	}
+	hits[i >> 5] |= 1u << (i & 31);
+	if (hit_x != NULL) {
+		hit_x[i] = tx;
+		hit_y[i] = ty;
+	}
+	return 1;
+}
+
+/*
+ * Works out the first and last tile along an axis for a single box, clamped
+ * into the border of a grid `len' tiles long. Clamping before rounding also
+ * keeps boxes far outside of the map within the range of an int.
+ */
+static inline void span(float pos, float size, float tile, int len, int* first, int* last) {
+	float lo = pos / tile;
+	float hi = (pos + size) / tile;
+	*first = floorf(fminf(fmaxf(lo, -1.0f), len));
+	*last = (int)ceilf(fminf(fmaxf(hi, 0.0f), len + 1)) - 1;
+}
+
+#ifdef __SSE2__
+// SSE2 has no rounding towards negative or positive infinity, so these round
+// towards zero, and correct the lanes which went the wrong way.
+static inline __m128 floor4(__m128 v) {
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmplt_ps(v, t), _mm_set1_ps(1.0f)));
+}
+
+static inline __m128 ceil4(__m128 v) {
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+	return _mm_add_ps(t, _mm_and_ps(_mm_cmpgt_ps(v, t), _mm_set1_ps(1.0f)));
+}
+
+/*
+ * The same as span, for four boxes at a time.
+ */
+static inline void span4(const float* pos, const float* size, float tile, int len, __m128i* first, __m128i* last) {
+	__m128 lo = _mm_div_ps(_mm_loadu_ps(pos), _mm_set1_ps(tile));
+	__m128 hi = _mm_div_ps(_mm_add_ps(_mm_loadu_ps(pos), _mm_loadu_ps(size)), _mm_set1_ps(tile));
+	lo = _mm_min_ps(_mm_max_ps(lo, _mm_set1_ps(-1.0f)), _mm_set1_ps(len));
+	hi = _mm_min_ps(_mm_max_ps(hi, _mm_set1_ps(0.0f)), _mm_set1_ps(len + 1));
+	*first = _mm_cvttps_epi32(floor4(lo));
+	*last = _mm_sub_epi32(_mm_cvttps_epi32(ceil4(hi)), _mm_set1_epi32(1));
+}
+#endif
+
+/*
+ * Makes the rows of a grid which is not sparse, with the border around the map
+ * solid. Returns false when they could not be allocated.
+ */
+static bool create_rows(struct collisiongrid* g) {
+	// The last word is wide enough for the column right of the map, which
+	// is the furthest a query reaches.
+	g->stride = ((g->width + BORDER_BITS) >> 5) + 1;
+	size_t len = (size_t)g->stride * (g->height + 2);
+	g->bits = malloc(len * sizeof(uint32_t));
+	if (g->bits == NULL) {
+		return false;
+	}
+	memset(g->bits, 0xff, len * sizeof(uint32_t));
+
+	// Clear the rows of the map, except for the border on either side.
+	for (int y = 0; y < g->height; y++) {
+		uint32_t* row = row_in(g, g->bits, y);
+		memset(row + 1, 0, (size_t)(g->stride - 1) * sizeof(uint32_t));
+		for (int b = g->width + BORDER_BITS; b < g->stride * 32; b++) {
+			row[b >> 5] |= 1u << (b & 31);
+		}
+	}
+	return true;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct collisiongrid* collisiongrid_create(int width, int height, bool sparse) {
+	struct collisiongrid* g = calloc(1, sizeof(struct collisiongrid));
+	if (g == NULL) {
+		return NULL;
+	}
+	g->width = width;
+	g->height = height;
+	if (sparse) {
+		g->blocks = coordmap_create();
+		if (g->blocks == NULL) {
+			free(g);
+			return NULL;
+		}
+	} else if (!create_rows(g)) {
+		free(g);
+		return NULL;
+	}
+	return g;
+}
+
+void collisiongrid_free(struct collisiongrid* g) {
+	if (g->blocks != NULL) {
+		for (uint32_t i = 0; i < g->blocks->capacity; i++) {
+			free(g->blocks->slots[i].value);
+		}
+		coordmap_free(g->blocks);
+	}
+	free(g->bits);
+	free(g->partial);
+	free(g);
+}
+
+bool collisiongrid_set(struct collisiongrid* g, int x, int y, bool solid, bool partial) {
+	if (g->blocks == NULL) {
+		set_bit(row_in(g, g->bits, y), x, solid);
+		if (solid && partial && g->partial == NULL) {
+			// Nothing is partly solid yet, not even the border.
+			g->partial = calloc((size_t)g->stride * (g->height + 2), sizeof(uint32_t));
+			if (g->partial == NULL) {
+				return false;
+			}
+		}
+		if (g->partial != NULL) {
+			set_bit(row_in(g, g->partial, y), x, solid && partial);
+		}
+		return true;
+	}
+
+	const int n = COLLISIONGRID_BLOCK;
+	struct collisiongrid_block* b = block_at(g, x, y);
+	if (b == NULL) {
+		if (!solid) {
+			return true;
+		}
+		b = calloc(1, sizeof(struct collisiongrid_block));
+		if (b == NULL || !coordmap_put(g->blocks, x / n, y / n, b)) {
+			free(b);
+			return false;
+		}
+	}
+
+	uint32_t mask = 1u << (x % n);
+	uint32_t* bits = &b->bits[y % n];
+	uint32_t* part = &b->partial[y % n];
+	*bits = solid ? *bits | mask : *bits & ~mask;
+	*part = solid && partial ? *part | mask : *part & ~mask;
+	if (solid) {
+		return true;
+	}
+
+	// Partly solid tiles are solid too, so the block is empty when no tile
+	// is solid.
+	for (int i = 0; i < n; i++) {
+		if (b->bits[i] != 0) {
+			return true;
+		}
+	}
+	coordmap_remove(g->blocks, x / n, y / n);
+	free(b);
+	return true;
+}
+
+bool collisiongrid_set_area(struct collisiongrid* g, int x, int y, int w, int h, const uint32_t* gids, const struct tileshapes* shapes) {
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) {
+			uint32_t gid = gids[j * w + i];
+			if (!collisiongrid_set(g, x + i, y + j, (gid & TMX_FLIP_BITS_REMOVAL) != 0, tileshapes_partial(shapes, gid))) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool collisiongrid_read_block(const struct collisiongrid* g, int bx, int by, uint32_t* bits) {
+	const int n = COLLISIONGRID_BLOCK;
+	if (g->blocks != NULL) {
+		const struct collisiongrid_block* b = coordmap_get(g->blocks, bx, by);
+		if (b == NULL) {
+			return false;
+		}
+		memcpy(bits, b->bits, sizeof(b->bits));
+		return true;
+	}
+
+	if (bx < 0 || by < 0 || bx * n >= g->width || by * n >= g->height) {
+		return false;
+	}
+
+	// Blocks start on a word of the rows, after the one of the border. The
+	// columns of the last block which are right of the map are border, and
+	// so are left out.
+	int cols = g->width - bx * n;
+	uint32_t mask = cols >= n ? ~0u : (1u << cols) - 1;
+	uint32_t any = 0;
+	for (int y = 0; y < n; y++) {
+		int ty = by * n + y;
+		bits[y] = ty < g->height ? row_in(g, g->bits, ty)[bx + 1] & mask : 0;
+		any |= bits[y];
+	}
+	return any != 0;
+}
+
+bool collisiongrid_get(const struct collisiongrid* g, int x, int y) {
+	if (g->blocks == NULL) {
+		int b = clamp(x, -1, g->width) + BORDER_BITS;
+		const uint32_t* row = row_in(g, g->bits, clamp(y, -1, g->height));
+		return (row[b >> 5] >> (b & 31)) & 1;
+	}
+	if (x < 0 || x >= g->width || y < 0 || y >= g->height) {
+		return true;
+	}
+	const struct collisiongrid_block* b = block_at(g, x, y);
+	return b != NULL && (b->bits[y % COLLISIONGRID_BLOCK] >> (x % COLLISIONGRID_BLOCK)) & 1;
+}
+
+bool collisiongrid_partial(const struct collisiongrid* g, int x, int y) {
+	if (g->blocks == NULL) {
+		if (g->partial == NULL) {
+			return false;
+		}
+		int b = clamp(x, -1, g->width) + BORDER_BITS;
+		const uint32_t* row = row_in(g, g->partial, clamp(y, -1, g->height));
+		return (row[b >> 5] >> (b & 31)) & 1;
+	}
+	if (x < 0 || x >= g->width || y < 0 || y >= g->height) {
+		return false;
+	}
+	const struct collisiongrid_block* b = block_at(g, x, y);
+	return b != NULL && (b->partial[y % COLLISIONGRID_BLOCK] >> (x % COLLISIONGRID_BLOCK)) & 1;
+}
+
+bool collisiongrid_overlaps(const struct collisiongrid* g, int x1, int y1, int x2, int y2) {
+	return find_in(g, FIND_SOLID, x1, y1, x2, y2, NULL, NULL);
+}
+
+bool collisiongrid_find(const struct collisiongrid* g, int x1, int y1, int x2, int y2, int* hit_x, int* hit_y) {
+	return find_in(g, FIND_SOLID, x1, y1, x2, y2, hit_x, hit_y);
+}
+
+bool collisiongrid_overlaps_whole(const struct collisiongrid* g, int x1, int y1, int x2, int y2) {
+	return find_in(g, FIND_WHOLE, x1, y1, x2, y2, NULL, NULL);
+}
+
+bool collisiongrid_overlaps_partial(const struct collisiongrid* g, int x1, int y1, int x2, int y2) {
+	return find_in(g, FIND_PARTIAL, x1, y1, x2, y2, NULL, NULL);
+}
+
+int collisiongrid_find_batch(const struct collisiongrid* g, float tile_w, float tile_h,
+	const float* x, const float* y, const float* w, const float* h, int len,
+	uint32_t* hits, int* hit_x, int* hit_y) {
+
+	memset(hits, 0, ((len + 31) / 32) * sizeof(uint32_t));
+
+	int count = 0;
+	int i = 0;
+#ifdef __SSE2__
+	for (; i + 4 <= len; i += 4) {
+		__m128i x1, x2, y1, y2;
+		span4(&x[i], &w[i], tile_w, g->width, &x1, &x2);
+		span4(&y[i], &h[i], tile_h, g->height, &y1, &y2);
+
+		int32_t rx1[4], rx2[4], ry1[4], ry2[4];
+		_mm_storeu_si128((__m128i*)rx1, x1);
+		_mm_storeu_si128((__m128i*)rx2, x2);
+		_mm_storeu_si128((__m128i*)ry1, y1);
+		_mm_storeu_si128((__m128i*)ry2, y2);
+		for (int j = 0; j < 4; j++) {
+			count += find_box(g, i + j, rx1[j], ry1[j], rx2[j], ry2[j], hits, hit_x, hit_y);
+		}
+	}
+#endif
+	for (; i < len; i++) {
+		int x1, x2, y1, y2;
+		span(x[i], w[i], tile_w, g->width, &x1, &x2);
+		span(y[i], h[i], tile_h, g->height, &y1, &y2);
+		count += find_box(g, i, x1, y1, x2, y2, hits, hit_x, hit_y);
+	}
+	return count;
+}
@@ -0,0 +1,129 @@
+#ifndef COLLISIONGRID_H
+#define COLLISIONGRID_H
+
+#include "tileshape.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct coordmap;
+
+// The size of a block of the grid, in tiles on either side.
+#define COLLISIONGRID_BLOCK 32
+
+/*
+ * A block of 32 x 32 tiles of a sparse grid. Bit x of word y is the tile in
+ * column x and row y of the block.
+ */
+struct collisiongrid_block {
+	uint32_t bits[COLLISIONGRID_BLOCK];    // The tiles which are solid.
+	uint32_t partial[COLLISIONGRID_BLOCK]; // The tiles which are only partly solid.
+};
+
+/*
+ * The collision layer of a map, as a single bit per tile which is set when the
+ * tile is solid. Everything outside of the map is solid, as if the map had a
+ * border around it.
+ *
+ * The bits of a map of a known size are kept in rows, with a border of solid
+ * tiles around them, so a query only has to clamp its area into the border
+ * and never looks at the size of the map again. Infinite maps may be far too
+ * large for that, so their grid is sparse: the bits are kept in blocks, keyed
+ * on the block coordinate, and a block is only made once it has a solid tile.
+ *
+ * Tiles with a collision shape which covers only part of them are in a second
+ * set of bits, which is made once there is such a tile. They are solid in the
+ * first set too, so the queries which know nothing of shapes, such as the
+ * batches, take them for whole tiles.
+ */
+struct collisiongrid {
+	int width;               // The size of the map, in tiles.
+	int height;
+	int stride;              // The amount of words in a row of the bits.
+	uint32_t* bits;          // The rows of tiles which are solid, including the border.
+	uint32_t* partial;       // The rows of tiles which are only partly solid, or NULL.
+	struct coordmap* blocks; // The blocks which have a solid tile, or NULL when the grid is not sparse.
+};
+
+/*
+ * Creates a grid of width x height tiles, none of which are solid. A sparse
+ * grid is meant for infinite maps, and only takes memory for the blocks which
+ * have a solid tile. Returns NULL when the grid could not be allocated.
+ */
+struct collisiongrid* collisiongrid_create(int width, int height, bool sparse);
+void collisiongrid_free(struct collisiongrid* g);
+
+/*
+ * Sets whether the tile at (x, y) is solid, and whether that is only part of
+ * it. The tile must be in the map. Returns false when its block, or the bits
+ * of the partly solid tiles, could not be allocated, which never happens when
+ * the tile is made empty.
+ */
+bool collisiongrid_set(struct collisiongrid* g, int x, int y, bool solid, bool partial);
+
+/*
+ * Sets the tiles of the w x h area at (x, y) from their gids, which are `w'
+ * apart. A tile is solid when it has a gid other than 0, and partly so when
+ * its shape in `shapes' says so. The shapes may be NULL. Returns false when a
+ * block could not be allocated.
+ */
+bool collisiongrid_set_area(struct collisiongrid* g, int x, int y, int w, int h, const uint32_t* gids, const struct tileshapes* shapes);
+
+/*
+ * Copies the tiles of the block at block coordinate (bx, by) into `bits', which
+ * takes COLLISIONGRID_BLOCK words. Bit x of word y is the tile in column x and
+ * row y of the block, and the tiles outside of the map are left empty. Returns
+ * false when none of its tiles are solid.
+ */
+bool collisiongrid_read_block(const struct collisiongrid* g, int bx, int by, uint32_t* bits);
+
+/*
+ * Whether the tile at (x, y) is solid. Tiles outside of the map are.
+ */
+bool collisiongrid_get(const struct collisiongrid* g, int x, int y);
+
+/*
+ * Whether the tile at (x, y) is only partly solid. Tiles outside of the map
+ * are solid all over.
+ */
+bool collisiongrid_partial(const struct collisiongrid* g, int x, int y);
+
+/*
+ * Whether any of the tiles from (x1, y1) up to and including (x2, y2) is
+ * solid. Every row is tested a word at a time.
+ */
+bool collisiongrid_overlaps(const struct collisiongrid* g, int x1, int y1, int x2, int y2);
+
+/*
+ * Like collisiongrid_overlaps, and also finds the first solid tile of the area,
+ * going row by row. When the area leaves the map, that may be a tile of the
+ * border, just outside of it.
+ */
+bool collisiongrid_find(const struct collisiongrid* g, int x1, int y1, int x2, int y2, int* hit_x, int* hit_y);
+
+/*
+ * Like collisiongrid_overlaps, for the tiles which are solid all over.
+ */
+bool collisiongrid_overlaps_whole(const struct collisiongrid* g, int x1, int y1, int x2, int y2);
+
+/*
+ * Like collisiongrid_overlaps, for the tiles which are only partly solid.
+ */
+bool collisiongrid_overlaps_partial(const struct collisiongrid* g, int x1, int y1, int x2, int y2);
+
+/*
+ * Tests `len' boxes at once. The boxes are given as a structure of arrays: box
+ * i is at (x[i], y[i]) and w[i] x h[i] large, in units of which a tile is
+ * tile_w x tile_h. A box overlaps the tiles it reaches into, not those it only
+ * touches.
+ *
+ * Bit i of `hits' is set when box i overlaps a solid tile, and the first one
+ * is then put in (hit_x[i], hit_y[i]), unless those are NULL. The tile ranges
+ * are worked out for four boxes at a time where SSE2 is available. Returns the
+ * amount of boxes which overlap a solid tile.
+ */
+int collisiongrid_find_batch(const struct collisiongrid* g, float tile_w, float tile_h,
+	const float* x, const float* y, const float* w, const float* h, int len,
+	uint32_t* hits, int* hit_x, int* hit_y);
+
+#endif // COLLISIONGRID_H
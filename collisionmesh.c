@@ -0,0 +1,479 @@
+#include "collisionmesh.h"
+#include "coordmap.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The most rectangles in a leaf of the hierarchy.
+static const int LEAF_RECTS = 4;
+
+// Deep enough for the hierarchy of any map which fits in memory.
+#define STACK_SIZE 64
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+static void free_block(struct collisionmesh_block* b) {
+	free(b->rects);
+	free(b->nodes);
+	free(b);
+}
+
+/*
+ * Merges the solid tiles of block (bx, by) of the grid, of which `left' has
+ * the rows, into rectangles. Every solid tile which is not in a rectangle yet
+ * starts a new one, which takes the tiles to its right as long as they are
+ * solid, and then the rows below it as long as all of their tiles below the
+ * rectangle are. The tiles are cleared from `left' as they are taken. Returns
+ * false when the rectangles could not be allocated.
+ */
+static bool merge_tiles(struct collisionmesh_block* b, uint32_t* left, int bx, int by) {
+	const int n = COLLISIONGRID_BLOCK;
+
+	b->len = 0;
+	int capacity = 0;
+	for (int y = 0; y < n; y++) {
+		while (left[y] != 0) {
+			int x = __builtin_ctz(left[y]);
+			uint32_t run = ~(left[y] >> x);
+			int w = run == 0 ? n - x : __builtin_ctz(run);
+			uint32_t mask = (w == n ? ~0u : (1u << w) - 1) << x;
+
+			int h = 1;
+			while (y + h < n && (left[y + h] & mask) == mask) {
+				h++;
+			}
+			for (int j = y; j < y + h; j++) {
+				left[j] &= ~mask;
+			}
+
+			if (b->len == capacity) {
+				capacity = capacity == 0 ? 16 : capacity * 2;
+				SDL_Rect* rects = realloc(b->rects, capacity * sizeof(SDL_Rect));
+				if (rects == NULL) {
+					return false;
+				}
+				b->rects = rects;
+			}
+			b->rects[b->len++] = (SDL_Rect){ bx * n + x, by * n + y, w, h };
+		}
+	}
+	return true;
+}
+
+static int compare_x(const void* a, const void* b) {
+	const SDL_Rect* ra = a;
+	const SDL_Rect* rb = b;
+	return (2 * ra->x + ra->w) - (2 * rb->x + rb->w);
+}
+
+static int compare_y(const void* a, const void* b) {
+	const SDL_Rect* ra = a;
+	const SDL_Rect* rb = b;
+	return (2 * ra->y + ra->h) - (2 * rb->y + rb->h);
+}
+
+/*
+ * Adds the node for `count' rectangles from `first', and the nodes below it.
+ * The rectangles are split in half along the longest side of their bounds.
+ * Returns the index of the node.
+ */
+static int build_node(struct collisionmesh_block* m, int first, int count) {
+	int index = m->nodes_len++;
+	SDL_Rect bounds = m->rects[first];
+	for (int i = first + 1; i < first + count; i++) {
+		SDL_UnionRect(&bounds, &m->rects[i], &bounds);
+	}
+	m->nodes[index].bounds = bounds;
+
+	if (count <= LEAF_RECTS) {
+		m->nodes[index].first = first;
+		m->nodes[index].count = count;
+		return index;
+	}
+
+	qsort(&m->rects[first], count, sizeof(SDL_Rect), bounds.w >= bounds.h ? compare_x : compare_y);
+	build_node(m, first, count / 2);
+	m->nodes[index].first = build_node(m, first + count / 2, count - count / 2);
+	m->nodes[index].count = 0;
+	return index;
+}
+
+static inline bool overlaps(const SDL_Rect* r, float x1, float y1, float x2, float y2) {
+	return x1 < r->x + r->w && x2 > r->x && y1 < r->y + r->h && y2 > r->y;
+}
+
+/*
+ * Whether the segment from (x, y) moving (dx, dy) enters the rectangle, and if
+ * so, at which fraction of it.
+ */
+static bool segment_enters(const SDL_Rect* r, float x, float y, float dx, float dy, float* t) {
+	const float pos[2] = { x, y };
+	const float d[2] = { dx, dy };
+	const float lo[2] = { r->x, r->y };
+	const float hi[2] = { r->x + r->w, r->y + r->h };
+
+	float t0 = 0.0f;
+	float t1 = 1.0f;
+	for (int a = 0; a < 2; a++) {
+		if (d[a] == 0.0f) {
+			if (pos[a] < lo[a] || pos[a] >= hi[a]) {
+				return false;
+			}
+			continue;
+		}
+		float enter = (lo[a] - pos[a]) / d[a];
+		float leave = (hi[a] - pos[a]) / d[a];
+		if (enter > leave) {
+			float swap = enter;
+			enter = leave;
+			leave = swap;
+		}
+		t0 = SDL_max(t0, enter);
+		t1 = SDL_min(t1, leave);
+		if (t0 > t1) {
+			return false;
+		}
+	}
+	*t = t0;
+	return true;
+}
+
+/*
+ * Merges a block which changed since it was merged last, as well as a block
+ * which was never merged. Returns false when that failed, and leaves the block
+ * to be merged again.
+ */
+static bool merge_block(struct collisionmesh_block* b, uint32_t* bits, int bx, int by) {
+	free(b->nodes);
+	b->nodes = NULL;
+	b->nodes_len = 0;
+	b->dirty = true;
+	if (!merge_tiles(b, bits, bx, by)) {
+		b->len = 0;
+		return false;
+	}
+	if (b->len > 0) {
+		b->nodes = malloc(2 * b->len * sizeof(struct collisionmesh_node));
+		if (b->nodes == NULL) {
+			return false;
+		}
+		build_node(b, 0, b->len);
+	}
+	b->dirty = false;
+	return true;
+}
+
+/*
+ * Returns block (bx, by) of the mesh, merging it first when it changed. Returns
+ * NULL when the block has no solid tiles, or could not be merged.
+ */
+static const struct collisionmesh_block* block_at(struct collisionmesh* m, int bx, int by) {
+	struct collisionmesh_block* b = coordmap_get(m->blocks, bx, by);
+	if (b != NULL && !b->dirty) {
+		return b;
+	}
+
+	uint32_t bits[COLLISIONGRID_BLOCK];
+	if (!collisiongrid_read_block(m->grid, bx, by, bits)) {
+		return NULL;
+	}
+	if (b == NULL) {
+		b = calloc(1, sizeof(struct collisionmesh_block));
+		if (b == NULL || !coordmap_put(m->blocks, bx, by, b)) {
+			free(b);
+			return NULL;
+		}
+		b->dirty = true;
+	}
+	if (!merge_block(b, bits, bx, by)) {
+		debug_print("Unable to merge block %d, %d of the collision mesh\n", bx, by);
+		return NULL;
+	}
+	return b;
+}
+
+/*
+ * Converts a coordinate in tiles to a block along an axis of `len' tiles,
+ * clamped to one block before and after the map. Clamping before rounding
+ * keeps coordinates far outside of the map within the range of an int.
+ */
+static inline int block_of(float v, int len) {
+	float blocks = (len + COLLISIONGRID_BLOCK - 1) / COLLISIONGRID_BLOCK;
+	return floorf(SDL_min(SDL_max(v / COLLISIONGRID_BLOCK, -1.0f), blocks));
+}
+
+static int query_block(const struct collisionmesh_block* b, float x1, float y1, float x2, float y2, SDL_FRect* found, int max, int n) {
+	int stack[STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const struct collisionmesh_node* node = &b->nodes[stack[--top]];
+		if (!overlaps(&node->bounds, x1, y1, x2, y2)) {
+			continue;
+		}
+		if (node->count == 0) {
+			stack[top++] = node->first;
+			stack[top++] = node - b->nodes + 1;
+			continue;
+		}
+		for (int i = node->first; i < node->first + node->count; i++) {
+			const SDL_Rect* r = &b->rects[i];
+			if (overlaps(r, x1, y1, x2, y2)) {
+				if (n < max) {
+					found[n] = (SDL_FRect){ r->x, r->y, r->w, r->h };
+				}
+				n++;
+			}
+		}
+	}
+	return n;
+}
+
+/*
+ * Finds the nearest rectangle of a block which the segment from (x, y) moving
+ * (dx, dy) enters before `best', and returns the fraction of the segment
+ * before it, or `best' when there is none.
+ */
+static float segment_block(const struct collisionmesh_block* b, float x, float y, float dx, float dy, float best) {
+	int stack[STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const struct collisionmesh_node* node = &b->nodes[stack[--top]];
+
+		// Nodes the segment enters after the nearest hit so far are skipped.
+		float enter;
+		if (!segment_enters(&node->bounds, x, y, dx, dy, &enter) || enter >= best) {
+			continue;
+		}
+		if (node->count == 0) {
+			stack[top++] = node->first;
+			stack[top++] = node - b->nodes + 1;
+			continue;
+		}
+		for (int i = node->first; i < node->first + node->count; i++) {
+			if (segment_enters(&b->rects[i], x, y, dx, dy, &enter) && enter < best) {
+				best = enter;
+			}
+		}
+	}
+	return best;
+}
+
+/*
+ * Like segment_block, for block (bx, by) of the mesh.
+ */
+static float segment_at(struct collisionmesh* m, int bx, int by, float x, float y, float dx, float dy, float best) {
+	const struct collisionmesh_block* b = block_at(m, bx, by);
+	if (b == NULL || b->nodes_len == 0) {
+		return best;
+	}
+	return segment_block(b, x, y, dx, dy, best);
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct collisionmesh* collisionmesh_create(const struct collisiongrid* g) {
+	struct collisionmesh* m = calloc(1, sizeof(struct collisionmesh));
+	if (m == NULL) {
+		return NULL;
+	}
+	m->grid = g;
+	m->blocks = coordmap_create();
+	if (m->blocks == NULL) {
+		free(m);
+		return NULL;
+	}
+
+	// Merge what is in the grid already, the blocks to come are merged as
+	// they are needed.
+	const int n = COLLISIONGRID_BLOCK;
+	int rects = 0;
+	if (g->blocks == NULL) {
+		for (int by = 0; by * n < g->height; by++) {
+			for (int bx = 0; bx * n < g->width; bx++) {
+				const struct collisionmesh_block* b = block_at(m, bx, by);
+				rects += b != NULL ? b->len : 0;
+			}
+		}
+	} else {
+		for (uint32_t i = 0; i < g->blocks->capacity; i++) {
+			const struct coordmap_slot* slot = &g->blocks->slots[i];
+			if (slot->value != NULL) {
+				const struct collisionmesh_block* b = block_at(m, slot->x, slot->y);
+				rects += b != NULL ? b->len : 0;
+			}
+		}
+	}
+
+	debug_print("Merged the solid tiles into %d rectangles, in %u blocks\n", rects, m->blocks->len);
+	return m;
+}
+
+void collisionmesh_free(struct collisionmesh* m) {
+	for (uint32_t i = 0; i < m->blocks->capacity; i++) {
+		if (m->blocks->slots[i].value != NULL) {
+			free_block(m->blocks->slots[i].value);
+		}
+	}
+	coordmap_free(m->blocks);
+	free(m);
+}
+
+void collisionmesh_dirty(struct collisionmesh* m, int x1, int y1, int x2, int y2) {
+	const int n = COLLISIONGRID_BLOCK;
+	if (m->blocks->len == 0 || x1 > x2 || y1 > y2) {
+		return;
+	}
+
+	// Blocks which were never merged are merged once they are needed, so
+	// only those which were need to be looked at.
+	for (int by = y1 / n; by <= y2 / n; by++) {
+		for (int bx = x1 / n; bx <= x2 / n; bx++) {
+			struct collisionmesh_block* b = coordmap_get(m->blocks, bx, by);
+			if (b == NULL) {
+				continue;
+			}
+			uint32_t bits[COLLISIONGRID_BLOCK];
+			if (!collisiongrid_read_block(m->grid, bx, by, bits)) {
+				coordmap_remove(m->blocks, bx, by);
+				free_block(b);
+			} else {
+				b->dirty = true;
+			}
+		}
+	}
+}
+
+int collisionmesh_query(struct collisionmesh* m, float x1, float y1, float x2, float y2, SDL_FRect* found, int max) {
+	const struct collisiongrid* g = m->grid;
+	const int n = COLLISIONGRID_BLOCK;
+	int bx1 = SDL_max(block_of(x1, g->width), 0);
+	int by1 = SDL_max(block_of(y1, g->height), 0);
+	int bx2 = block_of(ceilf(x2) - 1, g->width);
+	int by2 = block_of(ceilf(y2) - 1, g->height);
+	bx2 = SDL_min(bx2, (g->width - 1) / n);
+	by2 = SDL_min(by2, (g->height - 1) / n);
+	if (bx1 > bx2 || by1 > by2) {
+		return 0;
+	}
+
+	int count = 0;
+	if (g->blocks == NULL || (int64_t)(bx2 - bx1 + 1) * (by2 - by1 + 1) <= g->blocks->len) {
+		for (int by = by1; by <= by2; by++) {
+			for (int bx = bx1; bx <= bx2; bx++) {
+				const struct collisionmesh_block* b = block_at(m, bx, by);
+				if (b != NULL && b->nodes_len > 0) {
+					count = query_block(b, x1, y1, x2, y2, found, max, count);
+				}
+			}
+		}
+		return count;
+	}
+
+	// The area has more blocks than the sparse grid, so only those of the
+	// grid are looked at.
+	for (uint32_t i = 0; i < g->blocks->capacity; i++) {
+		const struct coordmap_slot* slot = &g->blocks->slots[i];
+		if (slot->value == NULL || slot->x < bx1 || slot->x > bx2 || slot->y < by1 || slot->y > by2) {
+			continue;
+		}
+		const struct collisionmesh_block* b = block_at(m, slot->x, slot->y);
+		if (b != NULL && b->nodes_len > 0) {
+			count = query_block(b, x1, y1, x2, y2, found, max, count);
+		}
+	}
+	return count;
+}
+
+bool collisionmesh_contains(struct collisionmesh* m, float x, float y) {
+	const struct collisiongrid* g = m->grid;
+	if (!(x >= 0.0f && x < g->width && y >= 0.0f && y < g->height)) {
+		return false;
+	}
+	const struct collisionmesh_block* b = block_at(m, (int)x / COLLISIONGRID_BLOCK, (int)y / COLLISIONGRID_BLOCK);
+	if (b == NULL || b->nodes_len == 0) {
+		return false;
+	}
+
+	int stack[STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const struct collisionmesh_node* node = &b->nodes[stack[--top]];
+		const SDL_Rect* r = &node->bounds;
+		if (x < r->x || x >= r->x + r->w || y < r->y || y >= r->y + r->h) {
+			continue;
+		}
+		if (node->count == 0) {
+			stack[top++] = node->first;
+			stack[top++] = node - b->nodes + 1;
+			continue;
+		}
+		for (int i = node->first; i < node->first + node->count; i++) {
+			r = &b->rects[i];
+			if (x >= r->x && x < r->x + r->w && y >= r->y && y < r->y + r->h) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool collisionmesh_segment(struct collisionmesh* m, float x1, float y1, float x2, float y2, float* t) {
+	const struct collisiongrid* g = m->grid;
+	const int n = COLLISIONGRID_BLOCK;
+	float dx = x2 - x1;
+	float dy = y2 - y1;
+
+	// Only the part of the segment in the map can enter a rectangle.
+	float t0, t1;
+	SDL_Rect map = { 0, 0, g->width, g->height };
+	if (!segment_enters(&map, x1, y1, dx, dy, &t0) || !segment_enters(&map, x2, y2, -dx, -dy, &t1)) {
+		return false;
+	}
+	t1 = 1.0f - t1;
+
+	// Walk the blocks along the segment. No rectangle crosses the edge of a
+	// block, so the first block with a hit has the nearest one.
+	int last_x = (g->width - 1) / n;
+	int last_y = (g->height - 1) / n;
+	int bx = SDL_min(SDL_max(block_of(x1 + dx * t0, g->width), 0), last_x);
+	int by = SDL_min(SDL_max(block_of(y1 + dy * t0, g->height), 0), last_y);
+	int end_x = SDL_min(SDL_max(block_of(x1 + dx * t1, g->width), 0), last_x);
+	int end_y = SDL_min(SDL_max(block_of(y1 + dy * t1, g->height), 0), last_y);
+	int step_x = dx > 0.0f ? 1 : -1;
+	int step_y = dy > 0.0f ? 1 : -1;
+
+	float best = segment_at(m, bx, by, x1, y1, dx, dy, 2.0f);
+	while (best > 1.0f && (bx != end_x || by != end_y)) {
+		// The fraction of the segment at which it leaves the block along
+		// either axis.
+		float tx = bx == end_x ? INFINITY : ((bx + (step_x > 0)) * n - x1) / dx;
+		float ty = by == end_y ? INFINITY : ((by + (step_y > 0)) * n - y1) / dy;
+		if (tx == ty) {
+			// Through a corner, which touches the blocks on either side.
+			best = segment_at(m, bx + step_x, by, x1, y1, dx, dy, best);
+			best = segment_at(m, bx, by + step_y, x1, y1, dx, dy, best);
+			bx += step_x;
+			by += step_y;
+		} else if (tx < ty) {
+			bx += step_x;
+		} else {
+			by += step_y;
+		}
+		best = segment_at(m, bx, by, x1, y1, dx, dy, best);
+	}
+
+	if (best > 1.0f) {
+		return false;
+	}
+	*t = best;
+	return true;
+}
@@ -0,0 +1,81 @@
+#ifndef COLLISIONMESH_H
+#define COLLISIONMESH_H
+
+#include "collisiongrid.h"
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+struct coordmap;
+
+/*
+ * A node of the bounding volume hierarchy. The left child of an inner node is
+ * the node right after it.
+ */
+struct collisionmesh_node {
+	SDL_Rect bounds; // The bounds of every rectangle below the node, in tiles.
+	int first;       // The first rectangle of a leaf, or the right child.
+	int count;       // The amount of rectangles of a leaf, 0 for inner nodes.
+};
+
+/*
+ * The rectangles of a single block of the collision grid, in a bounding volume
+ * hierarchy.
+ */
+struct collisionmesh_block {
+	SDL_Rect* rects; // In tiles, sorted so every leaf has a range of them.
+	int len;
+
+	struct collisionmesh_node* nodes;
+	int nodes_len;
+
+	bool dirty;      // The tiles of the block changed since it was merged.
+};
+
+/*
+ * The solid tiles of a collision grid, merged into as few rectangles as the
+ * greedy way finds: every rectangle is as wide as its first row allows, and
+ * then as high as the rows below allow. The rectangles are kept in a bounding
+ * volume hierarchy, so a query visits a few large boxes instead of every
+ * tile it covers.
+ *
+ * Every block of the grid is merged on its own, so a change to the grid only
+ * has the blocks it touched merged again, once a query needs them. No
+ * rectangle crosses the edge of a block. Tiles outside of the map are not in
+ * the mesh.
+ */
+struct collisionmesh {
+	const struct collisiongrid* grid;
+	struct coordmap* blocks; // The merged blocks, keyed on their block coordinate.
+};
+
+struct collisionmesh* collisionmesh_create(const struct collisiongrid* g);
+void collisionmesh_free(struct collisionmesh* m);
+
+/*
+ * Has the blocks with a tile from (x1, y1) up to and including (x2, y2) merged
+ * again before they are next used, for after those tiles of the grid changed.
+ */
+void collisionmesh_dirty(struct collisionmesh* m, int x1, int y1, int x2, int y2);
+
+/*
+ * Finds the rectangles overlapping the area from (x1, y1) up to (x2, y2), in
+ * tiles. Rectangles which only touch the area do not overlap it. At most `max'
+ * of them are put in `found', but all of them are counted.
+ */
+int collisionmesh_query(struct collisionmesh* m, float x1, float y1, float x2, float y2, SDL_FRect* found, int max);
+
+/*
+ * Whether the point (x, y), in tiles, is inside any rectangle.
+ */
+bool collisionmesh_contains(struct collisionmesh* m, float x, float y);
+
+/*
+ * Whether the segment from (x1, y1) to (x2, y2), in tiles, enters any of the
+ * rectangles. If so, `t' is set to the fraction of the segment before the
+ * first one, which is 0 when it starts inside.
+ */
+bool collisionmesh_segment(struct collisionmesh* m, float x1, float y1, float x2, float y2, float* t);
+
+#endif // COLLISIONMESH_H
@@ -0,0 +1,124 @@
+#include "coordmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The initial amount of slots in the hash table.
+static const uint32_t INITIAL_SLOTS = 64;
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+static inline uint32_t hash(int x, int y) {
+	// Entries are usually near each other, so mix the bits of both coordinates.
+	uint32_t h = (uint32_t)x * 0x9e3779b1u ^ (uint32_t)y * 0x85ebca77u;
+	return h ^ (h >> 16);
+}
+
+/*
+ * Finds the slot of (x, y), or the free slot where it would go. The table must
+ * have slots.
+ */
+static struct coordmap_slot* find_slot(const struct coordmap* m, int x, int y) {
+	uint32_t mask = m->capacity - 1;
+	for (uint32_t i = hash(x, y) & mask; ; i = (i + 1) & mask) {
+		struct coordmap_slot* slot = &m->slots[i];
+		if (slot->value == NULL || (slot->x == x && slot->y == y)) {
+			return slot;
+		}
+	}
+}
+
+/*
+ * Moves every entry to a table of `capacity' slots.
+ */
+static bool grow(struct coordmap* m, uint32_t capacity) {
+	struct coordmap_slot* slots = calloc(capacity, sizeof(struct coordmap_slot));
+	if (slots == NULL) {
+		return false;
+	}
+
+	struct coordmap_slot* old = m->slots;
+	uint32_t old_capacity = m->capacity;
+	m->slots = slots;
+	m->capacity = capacity;
+	for (uint32_t i = 0; i < old_capacity; i++) {
+		if (old[i].value != NULL) {
+			*find_slot(m, old[i].x, old[i].y) = old[i];
+		}
+	}
+	free(old);
+	return true;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct coordmap* coordmap_create(void) {
+	return calloc(1, sizeof(struct coordmap));
+}
+
+void coordmap_free(struct coordmap* m) {
+	free(m->slots);
+	free(m);
+}
+
+void* coordmap_get(const struct coordmap* m, int x, int y) {
+	if (m->len == 0) {
+		return NULL;
+	}
+	return find_slot(m, x, y)->value;
+}
+
+bool coordmap_put(struct coordmap* m, int x, int y, void* value) {
+	if ((m->len + 1) * 2 > m->capacity && !grow(m, m->capacity > 0 ? m->capacity * 2 : INITIAL_SLOTS)) {
+		return false;
+	}
+
+	struct coordmap_slot* slot = find_slot(m, x, y);
+	if (slot->value == NULL) {
+		slot->x = x;
+		slot->y = y;
+		m->len++;
+	}
+	slot->value = value;
+	return true;
+}
+
+void* coordmap_remove(struct coordmap* m, int x, int y) {
+	if (m->len == 0) {
+		return NULL;
+	}
+	struct coordmap_slot* slot = find_slot(m, x, y);
+	void* value = slot->value;
+	if (value == NULL) {
+		return NULL;
+	}
+
+	// Move the entries after the slot which probed past it back, so every
+	// entry can still be found without tombstones.
+	uint32_t mask = m->capacity - 1;
+	uint32_t hole = slot - m->slots;
+	memset(slot, 0, sizeof(struct coordmap_slot));
+	for (uint32_t i = (hole + 1) & mask; m->slots[i].value != NULL; i = (i + 1) & mask) {
+		uint32_t home = hash(m->slots[i].x, m->slots[i].y) & mask;
+		// An entry stays when its home lies cyclically in (hole, i].
+		bool stays = hole < i ? (home > hole && home <= i) : (home > hole || home <= i);
+		if (!stays) {
+			m->slots[hole] = m->slots[i];
+			memset(&m->slots[i], 0, sizeof(struct coordmap_slot));
+			hole = i;
+		}
+	}
+	m->len--;
+	return value;
+}
+
+void coordmap_clear(struct coordmap* m) {
+	if (m->len > 0) {
+		memset(m->slots, 0, m->capacity * sizeof(struct coordmap_slot));
+		m->len = 0;
+	}
+}
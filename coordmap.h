@@ -0,0 +1,55 @@
+#ifndef COORDMAP_H
+#define COORDMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A slot of a coordinate map.
+ */
+struct coordmap_slot {
+	int x;
+	int y;
+	void* value; // NULL when the slot is free.
+};
+
+/*
+ * A hash table from integer coordinates to pointers, for what only exists in
+ * a few places of a large area, such as the blocks of a map which have tiles.
+ * An area without any entries costs no memory at all.
+ *
+ * Every entry can be visited by walking the slots, skipping the free ones.
+ * The values belong to the caller, the map never frees them.
+ */
+struct coordmap {
+	struct coordmap_slot* slots; // Open addressing, with linear probing.
+	uint32_t capacity;           // Amount of slots, a power of two.
+	uint32_t len;                // Amount of entries.
+};
+
+struct coordmap* coordmap_create(void);
+void coordmap_free(struct coordmap* m);
+
+/*
+ * Returns the value at (x, y), or NULL when there is none.
+ */
+void* coordmap_get(const struct coordmap* m, int x, int y);
+
+/*
+ * Sets the value at (x, y), which must not be NULL. Returns false when the
+ * table could not grow to take it.
+ */
+bool coordmap_put(struct coordmap* m, int x, int y, void* value);
+
+/*
+ * Removes the entry at (x, y), and returns its value, or NULL when there was
+ * none.
+ */
+void* coordmap_remove(struct coordmap* m, int x, int y);
+
+/*
+ * Removes every entry. The slots are kept for the entries to come.
+ */
+void coordmap_clear(struct coordmap* m);
+
+#endif // COORDMAP_H
@@ -0,0 +1,138 @@
+#include "distancefield.h"
+#include "util.h"
+
+#include <stdlib.h>
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+static inline int at(const struct distancefield* f, int x, int y) {
+	if (x < 0 || x >= f->width || y < 0 || y >= f->height) {
+		return 0;
+	}
+	return f->cells[(size_t)y * f->width + x];
+}
+
+static inline int min4(int a, int b, int c, int d) {
+	return SDL_min(SDL_min(a, b), SDL_min(c, d));
+}
+
+/*
+ * Works out the distances of the tiles from (x1, y1) up to and including
+ * (x2, y2) again. The tiles around the area must be right already: they are
+ * where the distances from outside of the area come from.
+ *
+ * The forward pass takes the distances from above and to the left of every
+ * tile, and the backward pass those from below and to the right. With the
+ * chessboard metric, that is exact.
+ */
+static void rebuild(struct distancefield* f, const struct collisiongrid* g, int x1, int y1, int x2, int y2) {
+	for (int y = y1; y <= y2; y++) {
+		uint16_t* row = &f->cells[(size_t)y * f->width];
+		for (int x = x1; x <= x2; x++) {
+			row[x] = collisiongrid_get(g, x, y) ? 0 : UINT16_MAX;
+		}
+	}
+
+	for (int y = y1; y <= y2; y++) {
+		uint16_t* row = &f->cells[(size_t)y * f->width];
+		for (int x = x1; x <= x2; x++) {
+			if (row[x] == 0) {
+				continue;
+			}
+			int d = min4(at(f, x - 1, y), at(f, x - 1, y - 1), at(f, x, y - 1), at(f, x + 1, y - 1)) + 1;
+			row[x] = SDL_min(row[x], d);
+		}
+	}
+
+	for (int y = y2; y >= y1; y--) {
+		uint16_t* row = &f->cells[(size_t)y * f->width];
+		for (int x = x2; x >= x1; x--) {
+			if (row[x] == 0) {
+				continue;
+			}
+			int d = min4(at(f, x + 1, y), at(f, x + 1, y + 1), at(f, x, y + 1), at(f, x - 1, y + 1)) + 1;
+			row[x] = SDL_min(row[x], d);
+		}
+	}
+}
+
+/*
+ * Whether any tile of the map exactly `k' tiles away from (x, y) is at least
+ * `k' tiles from the nearest solid tile. The ring is left when there is none.
+ */
+static bool ring_reaches(const struct distancefield* f, int x, int y, int k) {
+	for (int i = -k; i <= k; i++) {
+		// The top and bottom sides of the ring, then the left and right ones
+		// without their corners.
+		if (at(f, x + i, y - k) >= k || at(f, x + i, y + k) >= k) {
+			return true;
+		}
+		if (i > -k && i < k && (at(f, x - k, y + i) >= k || at(f, x + k, y + i) >= k)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct distancefield* distancefield_create(const struct collisiongrid* g) {
+	struct distancefield* f = calloc(1, sizeof(struct distancefield));
+	if (f == NULL) {
+		return NULL;
+	}
+	f->width = g->width;
+	f->height = g->height;
+	f->cells = malloc((size_t)f->width * f->height * sizeof(uint16_t));
+	if (f->cells == NULL && f->width > 0 && f->height > 0) {
+		free(f);
+		return NULL;
+	}
+	if (f->width > 0 && f->height > 0) {
+		rebuild(f, g, 0, 0, f->width - 1, f->height - 1);
+	}
+	return f;
+}
+
+void distancefield_free(struct distancefield* f) {
+	free(f->cells);
+	free(f);
+}
+
+void distancefield_mark(struct distancefield* f, int x, int y) {
+	// A tile whose distance changes has a neighbour closer to (x, y) whose
+	// distance changes as well, all the way up to (x, y) itself. Those are
+	// the tiles at least as far from a solid tile as from (x, y), so the
+	// rings around it are grown until one has none of them.
+	int radius = 0;
+	int limit = SDL_max(f->width, f->height);
+	while (radius < limit && ring_reaches(f, x, y, radius + 1)) {
+		radius++;
+	}
+
+	int x1 = SDL_max(x - radius, 0);
+	int y1 = SDL_max(y - radius, 0);
+	int x2 = SDL_min(x + radius, f->width - 1);
+	int y2 = SDL_min(y + radius, f->height - 1);
+	SDL_Rect area = { x1, y1, x2 - x1 + 1, y2 - y1 + 1 };
+	SDL_UnionRect(&f->stale, &area, &f->stale);
+}
+
+void distancefield_flush(struct distancefield* f, const struct collisiongrid* g) {
+	if (SDL_RectEmpty(&f->stale)) {
+		return;
+	}
+
+	// The tiles around the window are right, since every tile whose
+	// distance changed is in the area of a marked tile.
+	rebuild(f, g, f->stale.x, f->stale.y, f->stale.x + f->stale.w - 1, f->stale.y + f->stale.h - 1);
+	f->stale = (SDL_Rect){ 0, 0, 0, 0 };
+}
+
+int distancefield_get(const struct distancefield* f, int x, int y) {
+	return at(f, x, y);
+}
@@ -0,0 +1,59 @@
+#ifndef DISTANCEFIELD_H
+#define DISTANCEFIELD_H
+
+#include "collisiongrid.h"
+
+#include <stdint.h>
+
+#include <SDL.h>
+
+/*
+ * The distance from every tile of a collision grid to the nearest solid tile,
+ * in tiles, along the chessboard metric: a tile at distance d has only free
+ * tiles within d - 1 tiles of it in every direction, including diagonally.
+ * Solid tiles are at 0, and so is everything outside of the map. Partly solid
+ * tiles count as solid, so the free area around a tile is never overstated.
+ *
+ * The chessboard distance is never more than the straight distance, so a ray
+ * may skip d - 1 tiles of open space in any direction without missing a wall.
+ */
+struct distancefield {
+	int width;        // The size of the map, in tiles.
+	int height;
+	uint16_t* cells;  // Row by row. Distances saturate at UINT16_MAX.
+	SDL_Rect stale;   // The tiles to work out again, empty when none are.
+};
+
+/*
+ * Works out the distances from the solid tiles of the grid in two passes over
+ * the map, one forwards and one backwards. The field has a cell for every tile
+ * of the map, so it is only meant for maps of a bounded size. Returns NULL when
+ * it could not be allocated.
+ */
+struct distancefield* distancefield_create(const struct collisiongrid* g);
+void distancefield_free(struct distancefield* f);
+
+/*
+ * Has the distances around the tile at (x, y) worked out again by the next
+ * flush, after the tile changed in the grid. Only the tiles which may have had
+ * their nearest solid tile there, or may have it now, need to be, which is the
+ * area up to the distance of the furthest of them. That is found from the
+ * distances as they were at the last flush, so it holds for every tile marked
+ * since then together.
+ */
+void distancefield_mark(struct distancefield* f, int x, int y);
+
+/*
+ * Works out the distances around the tiles marked since the last flush again,
+ * in a single window which covers all of their areas.
+ */
+void distancefield_flush(struct distancefield* f, const struct collisiongrid* g);
+
+/*
+ * Returns the distance of the tile at (x, y). Tiles outside of the map are at
+ * 0, like solid ones. Tiles around a marked one may be out of date until the
+ * next flush.
+ */
+int distancefield_get(const struct distancefield* f, int x, int y);
+
+#endif // DISTANCEFIELD_H
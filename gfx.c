@@ -31,13 +31,20 @@ void anim_reset(struct anim* a) {
 	a->curr = 0;
 }
 
-void anim_next(struct anim* a) {
+bool anim_next(struct anim* a) {
 	int current_time = SDL_GetTicks();
 	if (current_time > a->counter + a->frame_time) {
+		int previous = a->curr;
 		a->curr++;
 		a->curr = a->curr % a->n; // circular buffer behaviour
 		a->counter = current_time;
+		return a->curr != previous;
 	}
+	return false;
+}
+
+uint32_t anim_deadline(const struct anim* a) {
+	return a->counter + a->frame_time + 1;
 }
 
 const SDL_Rect* anim_current(struct anim* a) {
@@ -2,6 +2,8 @@
 #define GFX_H
 
 #include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #include <SDL.h>
 
@@ -51,7 +53,19 @@ void anim_free(struct anim* a);
 void anim_add(struct anim* a, int x, int y, int w, int h);
 
 void anim_reset(struct anim* a);
-void anim_next(struct anim* a);
+
+/*
+ * Advances to the next frame when the frame time has passed. Returns true when
+ * the current frame changed.
+ */
+bool anim_next(struct anim* a);
+
+/*
+ * Returns the tick (as in SDL_GetTicks) at which anim_next will advance to the
+ * next frame.
+ */
+uint32_t anim_deadline(const struct anim* a);
+
 const SDL_Rect* anim_current(struct anim* a);
 
 #endif // GFX_H
\ No newline at end of file
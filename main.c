@@ -1,4 +1,8 @@
+#include "alphamap.h"
+#include "atlas.h"
 #include "camera.h"
+#include "chunkcache.h"
+#include "offscreen.h"
 #include "tilemap.h"
 #include "player.h"
 #include "bitmapfont.h"
@@ -9,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <inttypes.h>
 #include <time.h>
 
@@ -21,42 +26,26 @@ static bool quit = false;
 static bool pause = false;
 static bool drawgrid = false;
 static bool drawdebug = false;
+static bool native = false;
+static bool snap = false;
+static bool on_demand = false;
+static bool pack_atlas = true;
+static bool stream = false;
+static bool split_regions = false;
+static const char* map_path = "map01.tmx";
 static struct player* p;
+static struct offscreen* view = NULL;
 
-float tilewidth = 64;
-float tileheight = 64;
-
-struct background {
-	SDL_Texture* tex;
-	int w;
-	int h;
-};
-
-bool background_init(struct background* bg, SDL_Renderer* r, const char* path) {
-	bg->tex = IMG_LoadTexture(r, path);
-	if (bg->tex == NULL) {
-		return false;
-	}
-
-	SDL_QueryTexture(bg->tex, NULL, NULL, &bg->w, &bg->h);
-
-	return true;
-}
-
-void background_free(struct background* bg) {
-	SDL_DestroyTexture(bg->tex);
-	bg->tex = NULL;
-}
-
-void background_draw(struct background* bg, SDL_Renderer* r, struct camera* cam) {
-	SDL_SetRenderDrawColor(r, 0xff, 0xff, 0xff, 0xff);
-	SDL_Rect src = {0, 0, bg->w, bg->h};
-	SDL_Rect dst = {-cam->x / 6 - 1800, -cam->y / 6 - 200, bg->w * 2, bg->h * 2};
-	SDL_RenderCopy(r, bg->tex, &src, &dst);
-}
-
+// When rendering on demand: the longest time to sleep without any event, and
+// how often the debug overlay is refreshed (both in milliseconds).
+static const uint32_t IDLE_TIMEOUT = 1000;
+static const uint32_t OVERLAY_REFRESH = 250;
 
+// How much a single step zooms the camera in or out.
+static const float ZOOM_STEP = 1.25f;
 
+float tilewidth = 64;
+float tileheight = 64;
 
 void draw_grid(const struct camera* cam, const struct tilemap* tm, SDL_Renderer* r) {
 	(void)cam;
@@ -67,10 +56,10 @@ void draw_grid(const struct camera* cam, const struct tilemap* tm, SDL_Renderer*
 		float th = tm->tileheight;
 		SDL_SetRenderDrawColor(r, 0, 255, 0, 55);
 		for (int x = 0; x < mapwidth; x += tw) {
-			SDL_RenderDrawLine(r, x + tw - cam->x, 0, x + tw - cam->x, 600);
+			SDL_RenderDrawLine(r, x + tw - cam->x, 0, x + tw - cam->x, cam->winheight);
 		}
 		for (int y = 0; y < mapheight; y += th) {
-			SDL_RenderDrawLine(r, 0, y + th - cam->y, 800, y + th - cam->y);
+			SDL_RenderDrawLine(r, 0, y + th - cam->y, cam->winwidth, y + th - cam->y);
 		}
 	}
 }
@@ -84,6 +73,9 @@ void handle_keypress(const SDL_Event* event) {
 		switch (event->key.keysym.sym) {
 		case SDLK_d: drawgrid = !drawgrid; break;
 		case SDLK_p: drawdebug = !drawdebug; break;
+		case SDLK_n: native = !native; break;
+		case SDLK_i: snap = !snap; break;
+		case SDLK_o: on_demand = !on_demand; break;
 		case SDLK_f: SDL_SetWindowFullscreen(gWindow, SDL_WINDOW_FULLSCREEN); break;
 		case SDLK_ESCAPE: quit = true; break;
 		case SDLK_SPACE:
@@ -95,13 +87,132 @@ void handle_keypress(const SDL_Event* event) {
 	}
 }
 
+/*
+ * Zooms the camera with the plus and minus keys of the numpad, or the mouse
+ * wheel. Numpad 0 resets the zoom.
+ */
+void handle_zoom(struct camera* cam, const SDL_Event* event) {
+	if (event->type == SDL_KEYDOWN) {
+		switch (event->key.keysym.sym) {
+		case SDLK_KP_PLUS:  camera_zoom(cam, ZOOM_STEP); break;
+		case SDLK_KP_MINUS: camera_zoom(cam, 1.0f / ZOOM_STEP); break;
+		case SDLK_KP_0:     camera_zoom(cam, 1.0f / cam->scale); break;
+		}
+	} else if (event->type == SDL_MOUSEWHEEL && event->wheel.y != 0) {
+		camera_zoom(cam, event->wheel.y > 0 ? ZOOM_STEP : 1.0f / ZOOM_STEP);
+	}
+}
+
+void handle_event(struct tilemap* tm, struct camera* cam, const SDL_Event* event) {
+	if (event->type == SDL_QUIT) {
+		quit = true;
+	}
+	handle_keypress(event);
+	handle_zoom(cam, event);
+	tilemap_handle_event(tm, event);
+	player_handle_event(p, event);
+}
+
+/*
+ * Makes sure the offscreen view matches the current settings, tile size and
+ * zoom, and sizes the camera to the part of the world which is visible.
+ */
+void update_view(const struct tilemap* tm, struct camera* cam) {
+	float scale_x = tm->map->tile_width / tm->tilewidth;
+	float scale_y = tm->map->tile_height / tm->tileheight;
+
+	// Zoomed out beyond the native size of the tiles, the view would have more
+	// pixels than the window, so the world is drawn to the window instead.
+	bool use_native = native && cam->scale >= fmaxf(scale_x, scale_y);
+
+	if (view != NULL && (!use_native || view->snap != snap || view->scale_x != scale_x || view->scale_y != scale_y || view->zoom != cam->scale)) {
+		offscreen_free(view);
+		view = NULL;
+	}
+
+	if (use_native && view == NULL) {
+		view = offscreen_create(gRenderer, 800, 600, scale_x, scale_y, cam->scale, snap);
+		if (view == NULL) {
+			native = false;
+		}
+	}
+
+	if (view != NULL) {
+		offscreen_view_size(view, &cam->winwidth, &cam->winheight);
+	} else {
+		cam->winwidth = ceilf(800 / cam->scale);
+		cam->winheight = ceilf(600 / cam->scale);
+	}
+}
+
+/*
+ * Waits until an event arrives, or until something is due to change by itself:
+ * the player animation, animated tiles, or the debug overlay. Returns true when
+ * an event was received, which is stored in `e'.
+ */
+bool wait_event(const struct tilemap* tm, SDL_Event* e, uint32_t overlay_time) {
+	uint32_t deadline = player_deadline(p);
+	if (tilemap_animation_deadline(tm) < deadline) {
+		deadline = tilemap_animation_deadline(tm);
+	}
+	if (drawdebug && overlay_time + OVERLAY_REFRESH < deadline) {
+		deadline = overlay_time + OVERLAY_REFRESH;
+	}
+
+	uint32_t now = SDL_GetTicks();
+	uint32_t timeout = deadline > now ? deadline - now : 0;
+	if (timeout > IDLE_TIMEOUT) {
+		timeout = IDLE_TIMEOUT;
+	}
+	return SDL_WaitEventTimeout(e, timeout) == 1;
+}
+
 void* sdl_img_loader(const char *path) {
-	return IMG_LoadTexture(gRenderer, path);
+	SDL_Surface* surface = IMG_Load(path);
+	if (surface == NULL) {
+		fprintf(stderr, "%s\n", IMG_GetError());
+		return NULL;
+	}
+
+	SDL_Texture* texture = SDL_CreateTextureFromSurface(gRenderer, surface);
+	if (texture != NULL) {
+		// Scan the pixels while we still have them, so the tilemap knows
+		// which tiles are empty or opaque, and so they can be packed into
+		// an atlas.
+		alphamap_register(texture, surface);
+		if (pack_atlas) {
+			atlas_register(texture, surface);
+		}
+	}
+
+	SDL_FreeSurface(surface);
+	return texture;
+}
+
+void sdl_img_free(void* address) {
+	// Images whose texture was replaced by an atlas page have none left.
+	if (address == NULL) {
+		return;
+	}
+	alphamap_unregister(address);
+	atlas_unregister(address);
+	SDL_DestroyTexture(address);
 }
 
 int main(int argc, char* argv[]) {
-	(void)(argc);
-	(void)(argv);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--on-demand") == 0) {
+			on_demand = true;
+		} else if (strcmp(argv[i], "--no-atlas") == 0) {
+			pack_atlas = false;
+		} else if (strcmp(argv[i], "--stream") == 0) {
+			stream = true;
+		} else if (strcmp(argv[i], "--split-regions") == 0) {
+			split_regions = true;
+		} else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+			map_path = argv[++i];
+		}
+	}
 
 	srand(time(NULL));
 
@@ -139,24 +250,34 @@ int main(int argc, char* argv[]) {
 	SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
 
 	tmx_img_load_func = (void* (*)(const char*))sdl_img_loader;
-	tmx_img_free_func = (void (*)(void*)) SDL_DestroyTexture;
-
-#if 1
-	struct background bg;
-	if (!background_init(&bg, gRenderer, "background.png")) {
-		fprintf(stderr, "Unable to load background!\n");
-		exit(1);
-	}
-#endif
-
-	struct tilemap* tm = tilemap_create("map01.tmx");
+	tmx_img_free_func = sdl_img_free;
+
+	// Streamed maps are loaded around the player as it moves, from region
+	// files which have to be split from the map once.
+	SDL_Renderer* atlas_renderer = pack_atlas && !split_regions ? gRenderer : NULL;
+	struct tilemap* tm = stream
+		? tilemap_create_streamed(map_path, atlas_renderer)
+		: tilemap_create(map_path, atlas_renderer);
 	if (tm == NULL) {
 		tilemap_free(tm);
 		exit(1);
 	}
+	if (split_regions) {
+		bool ok = tilemap_write_regions(tm, map_path);
+		tilemap_free(tm);
+		exit(ok ? 0 : 1);
+	}
 	tm->tilewidth = tilewidth;
 	tm->tileheight = tileheight;
 
+	// Without a GPU, drawing every tile every frame is too slow, so reuse
+	// what was drawn in the previous frame as much as possible.
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(gRenderer, &info) == 0 && (info.flags & SDL_RENDERER_SOFTWARE)) {
+		debug_print("Using the software renderer, enabling scroll reuse\n");
+		tilemap_enable_scroll_reuse(tm);
+	}
+
 	p = player_create();
 	if (!player_load_texture(p, gRenderer, "player.png")) {
 		exit(1);
@@ -181,15 +302,20 @@ int main(int argc, char* argv[]) {
 	long total_frames = 0;
 	uint32_t timeBefore = 0;
 	uint32_t timeAfter = 0;
+	bool idle = false;         // Whether nothing changed in the previous iteration.
+	uint32_t overlay_time = 0; // When the debug overlay was drawn last.
 	while (!quit) {
+		// Always draw, unless we only draw when something changed.
+		bool changed = !on_demand;
+
+		if (on_demand && idle && wait_event(tm, &e, overlay_time)) {
+			handle_event(tm, cam, &e);
+			changed = true;
+		}
 
 		while (SDL_PollEvent(&e) != 0) {
-			if (e.type == SDL_QUIT) {
-				quit = true;
-			}
-			handle_keypress(&e);
-			tilemap_handle_event(tm, &e);
-			player_handle_event(p, &e);
+			handle_event(tm, cam, &e);
+			changed = true;
 		}
 
 		if (pause) {
@@ -197,6 +323,7 @@ int main(int argc, char* argv[]) {
 			// increase to very large amounts, resulting in real fast
 			// movement/behaviour. This has to be done better I guess.
 			deltaTime = SDL_GetTicks();
+			idle = true;
 			continue;
 		}
 
@@ -207,22 +334,56 @@ int main(int argc, char* argv[]) {
 		deltaTime = (timeAfter - timeBefore) / 1000.0f;
 		timeBefore = SDL_GetTicks();
 
-		player_update(p, deltaTime);
+		changed |= player_update(p, deltaTime);
+		changed |= tilemap_animate(tm, SDL_GetTicks());
+
+		update_view(tm, cam);
+		changed |= camera_update(cam, p, tm);
+
+		float vx = p->right ? p->dx : p->left ? -p->dx : 0.0f;
+		changed |= tilemap_stream(tm, cam, vx, p->dy);
 
-		camera_update(cam, p, tm);
+		if (drawdebug && SDL_GetTicks() >= overlay_time + OVERLAY_REFRESH) {
+			changed = true;
+		}
+
+		idle = !changed;
+		if (!changed) {
+			// Nothing to see, so skip clearing, drawing and presenting.
+			timeAfter = SDL_GetTicks();
+			continue;
+		}
 
 		// Render logic
 		SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
 		SDL_RenderClear(gRenderer);
 
-		background_draw(&bg, gRenderer, cam);
+		// Draw the world at the native tile size, and scale it up once.
+		if (view != NULL) {
+			offscreen_snap_camera(view, cam);
+			offscreen_begin(view, gRenderer);
+		} else {
+			SDL_RenderSetScale(gRenderer, cam->scale, cam->scale);
+		}
+
+		tilemap_reset_stats(tm);
 		tilemap_draw_background(tm, cam, gRenderer);
 		player_draw(p, cam, gRenderer);
 		tilemap_draw_foreground(tm, cam, gRenderer);
 
 		draw_grid(cam, tm, gRenderer);
+		if (drawdebug) {
+			tilemap_draw_debug(tm, cam, gRenderer);
+		}
+
+		if (view != NULL) {
+			offscreen_end(view, gRenderer);
+		} else {
+			SDL_RenderSetScale(gRenderer, 1.0f, 1.0f);
+		}
 
 		if (drawdebug) {
+			overlay_time = SDL_GetTicks();
 			bitmapfont_renderf(bmf, 0, 0 * 14, "P(%3.0f, %3.0f), vx: %f, dy: %f", p->x, p->y, p->dx, p->dy);
 			bitmapfont_renderf(bmf, 0, 1 * 14, "  jumping: %d", p->jumping);
 			bitmapfont_renderf(bmf, 0, 2 * 14, "  can jump: %d", p->can_jump);
@@ -230,9 +391,20 @@ int main(int argc, char* argv[]) {
 			// bitmapfont_renderf(bmf, 0, 4 * 14, "  anim: %d", p.anim);
 			// spacing
 			bitmapfont_renderf(bmf, 0, 6 * 14, "Delta time: %-3f", deltaTime);
-			bitmapfont_renderf(bmf, 0, 7 * 14, "FPS: %-3f", fps);
+			bitmapfont_renderf(bmf, 0, 7 * 14, "FPS: %-3f%s", fps, on_demand ? " (on demand)" : "");
 			bitmapfont_renderf(bmf, 0, 8 * 14, "Cam: %1.0f, %1.0f", cam->x, cam->y);
-			bitmapfont_renderf(bmf, 0, 9 * 14, "Tile size: %1.0f x %1.0f", tm->tilewidth, tm->tileheight);
+			bitmapfont_renderf(bmf, 0, 9 * 14, "Tile size: %1.0f x %1.0f, zoom %.2f, %s %d",
+				tm->tilewidth, tm->tileheight, cam->scale, tm->stats.overview ? "overview" : "mip level", tm->stats.mip_level);
+			bitmapfont_renderf(bmf, 0, 10 * 14, "Tiles: %d, skipped: %d, draw calls: %d (%s)",
+				tm->stats.tiles, tm->stats.skipped, tm->stats.draw_calls, tm->batching ? "batched" : "copies");
+			if (tm->chunks != NULL) {
+				bitmapfont_renderf(bmf, 0, 11 * 14, "Chunks: %d resident, %.1f / %.1f MB",
+					tm->chunks->resident, tm->chunks->used / 1048576.0, tm->chunks->budget / 1048576.0);
+			}
+			if (view != NULL) {
+				bitmapfont_renderf(bmf, 0, 12 * 14, "Native view: %d x %d%s",
+					view->w, view->h, view->snap ? " (snapped)" : "");
+			}
 		}
 
 		SDL_RenderPresent(gRenderer);
@@ -242,6 +414,9 @@ int main(int argc, char* argv[]) {
 		total_frames++;
 	}
 
+	if (view != NULL) {
+		offscreen_free(view);
+	}
 	player_free(p);
 	bitmapfont_free(bmf);
 	tilemap_free(tm);
@@ -0,0 +1,211 @@
+#include "mipmap.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <SDL.h>
+
+// The border around every tile in a page, in pixels.
+static const int PADDING = 1;
+
+// The width of the page of level 1. Every level after it is half as wide,
+// since its tiles are half as wide as well.
+static const int PAGE_WIDTH = 1024;
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+/*
+ * Places the tiles of a level on its page, left to right in rows of at most
+ * `page_w' pixels. Returns the height of the page.
+ */
+static int layout_level(struct mipmap* m, SDL_Texture* const* textures, const SDL_Rect* rects, int level, int page_w) {
+	int x = 0;
+	int y = 0;
+	int row_h = 0;
+	for (int i = 0; i < m->len; i++) {
+		SDL_Rect* dst = &m->rects[i * MIPMAP_LEVELS + level - 1];
+		if (textures[i] == NULL || rects[i].w <= 0 || rects[i].h <= 0) {
+			*dst = (SDL_Rect){ 0, 0, 0, 0 };
+			continue;
+		}
+
+		int w = SDL_max(1, rects[i].w >> level);
+		int h = SDL_max(1, rects[i].h >> level);
+		if (x > 0 && x + w + 2 * PADDING > page_w) {
+			x = 0;
+			y += row_h;
+			row_h = 0;
+		}
+		*dst = (SDL_Rect){ x + PADDING, y + PADDING, w, h };
+		x += w + 2 * PADDING;
+		row_h = SDL_max(row_h, h + 2 * PADDING);
+	}
+	return y + row_h;
+}
+
+/*
+ * Copies a tile onto the page being drawn, at `dst'. The tile is drawn over
+ * the border first, slightly stretched, so the border repeats its edge.
+ */
+static void copy_tile(SDL_Renderer* r, SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst) {
+	SDL_BlendMode blend;
+	Uint8 alpha;
+	SDL_ScaleMode scale;
+	SDL_GetTextureBlendMode(texture, &blend);
+	SDL_GetTextureAlphaMod(texture, &alpha);
+	SDL_GetTextureScaleMode(texture, &scale);
+
+	// Halving a texture with linear filtering averages every 2 x 2 block
+	// of pixels. The pixels are copied as they are, including their alpha.
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+	SDL_SetTextureAlphaMod(texture, 0xff);
+	SDL_SetTextureScaleMode(texture, SDL_ScaleModeLinear);
+
+	SDL_Rect border = { dst->x - PADDING, dst->y - PADDING, dst->w + 2 * PADDING, dst->h + 2 * PADDING };
+	SDL_RenderCopy(r, texture, src, &border);
+	SDL_RenderCopy(r, texture, src, dst);
+
+	SDL_SetTextureBlendMode(texture, blend);
+	SDL_SetTextureAlphaMod(texture, alpha);
+	SDL_SetTextureScaleMode(texture, scale);
+}
+
+/*
+ * Turns a page which was drawn as a render target into a static texture with
+ * the given pixels, so it keeps them when the renderer loses its targets.
+ * Returns the target itself when there are no pixels, or no texture.
+ */
+static SDL_Texture* make_static(SDL_Renderer* r, SDL_Texture* target, void* pixels, int w, int h) {
+	if (pixels == NULL) {
+		return target;
+	}
+
+	SDL_Texture* texture = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, w, h);
+	if (texture == NULL || SDL_UpdateTexture(texture, NULL, pixels, w * 4) != 0) {
+		debug_print("Unable to create the mip level texture: %s\n", SDL_GetError());
+		if (texture != NULL) {
+			SDL_DestroyTexture(texture);
+		}
+		free(pixels);
+		return target;
+	}
+
+	free(pixels);
+	SDL_DestroyTexture(target);
+	return texture;
+}
+
+/*
+ * Draws the page of a level, from the tiles themselves for level 1, and from
+ * the page of the previous level for the others. Returns NULL when the page
+ * does not fit the renderer.
+ */
+static SDL_Texture* make_level(struct mipmap* m, SDL_Renderer* r, SDL_Texture* const* textures, const SDL_Rect* rects, int level) {
+	int w = SDL_max(PAGE_WIDTH >> (level - 1), 1 + 2 * PADDING);
+	for (int i = 0; i < m->len; i++) {
+		if (textures[i] != NULL) {
+			w = SDL_max(w, (rects[i].w >> level) + 2 * PADDING);
+		}
+	}
+	int h = layout_level(m, textures, rects, level, w);
+	if (h == 0) {
+		return NULL;
+	}
+
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(r, &info) == 0 && info.max_texture_width > 0
+		&& (w > info.max_texture_width || h > info.max_texture_height)) {
+		debug_print("Mip level %d of %d x %d pixels is too large\n", level, w, h);
+		return NULL;
+	}
+
+	SDL_Texture* page = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+	if (page == NULL) {
+		debug_print("Unable to create mip level %d: %s\n", level, SDL_GetError());
+		return NULL;
+	}
+
+	SDL_Texture* target = SDL_GetRenderTarget(r);
+	float saved_x, saved_y;
+	SDL_RenderGetScale(r, &saved_x, &saved_y);
+	if (SDL_SetRenderTarget(r, page) != 0) {
+		debug_print("Unable to draw mip level %d: %s\n", level, SDL_GetError());
+		SDL_DestroyTexture(page);
+		return NULL;
+	}
+	SDL_RenderSetScale(r, 1.0f, 1.0f);
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+	SDL_RenderClear(r);
+
+	for (int i = 0; i < m->len; i++) {
+		if (textures[i] == NULL || rects[i].w <= 0 || rects[i].h <= 0) {
+			continue;
+		}
+		if (level == 1) {
+			copy_tile(r, textures[i], &rects[i], mipmap_rect(m, i, level));
+		} else {
+			copy_tile(r, m->pages[level - 2], mipmap_rect(m, i, level - 1), mipmap_rect(m, i, level));
+		}
+	}
+
+	// Read the pixels back while the page is still the target.
+	void* pixels = malloc((size_t)w * h * 4);
+	if (pixels != NULL && SDL_RenderReadPixels(r, NULL, SDL_PIXELFORMAT_RGBA8888, pixels, w * 4) != 0) {
+		debug_print("Unable to read mip level %d back: %s\n", level, SDL_GetError());
+		free(pixels);
+		pixels = NULL;
+	}
+	SDL_SetRenderTarget(r, target);
+	SDL_RenderSetScale(r, saved_x, saved_y);
+	page = make_static(r, page, pixels, w, h);
+
+	SDL_SetTextureBlendMode(page, SDL_BLENDMODE_BLEND);
+	SDL_SetTextureScaleMode(page, SDL_ScaleModeLinear);
+	return page;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct mipmap* mipmap_create(SDL_Renderer* r, SDL_Texture* const* textures, const SDL_Rect* rects, int len) {
+	struct mipmap* m = calloc(1, sizeof(struct mipmap));
+	m->len = len;
+	m->rects = calloc((size_t)len * MIPMAP_LEVELS, sizeof(SDL_Rect));
+
+	// Stop once the largest tile is down to a single pixel.
+	int largest = 0;
+	for (int i = 0; i < len; i++) {
+		if (textures[i] != NULL) {
+			largest = SDL_max(largest, SDL_max(rects[i].w, rects[i].h));
+		}
+	}
+
+	for (int level = 1; level <= MIPMAP_LEVELS && (largest >> (level - 1)) > 1; level++) {
+		SDL_Texture* page = make_level(m, r, textures, rects, level);
+		if (page == NULL) {
+			break;
+		}
+		m->pages[level - 1] = page;
+		m->levels = level;
+	}
+
+	if (m->levels == 0) {
+		mipmap_free(m);
+		return NULL;
+	}
+
+	debug_print("Made %d mip levels of %d tiles\n", m->levels, len);
+	return m;
+}
+
+void mipmap_free(struct mipmap* m) {
+	for (int i = 0; i < m->levels; i++) {
+		SDL_DestroyTexture(m->pages[i]);
+	}
+	free(m->rects);
+	free(m);
+}
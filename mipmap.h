@@ -0,0 +1,44 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <SDL.h>
+
+// The most levels made below the tiles themselves. Level 4 draws every tile
+// at a sixteenth of its size.
+#define MIPMAP_LEVELS 4
+
+/*
+ * The mip levels of the tiles of a map. Level 0 are the tiles themselves, and
+ * every level after it has the tiles at half the size of the previous one, so
+ * tiles drawn much smaller than their size are not drawn from far more pixels
+ * than they cover. That is both cheaper and does not shimmer.
+ *
+ * The tiles of a level are packed into a single page, with a border around
+ * every tile which repeats its edge, so the levels can be filtered without
+ * sampling a neighbouring tile.
+ */
+struct mipmap {
+	int levels;                        // The amount of levels below level 0.
+	SDL_Texture* pages[MIPMAP_LEVELS]; // The page of level 1 onwards.
+	SDL_Rect* rects;                   // MIPMAP_LEVELS rectangles per tile.
+	int len;                           // The amount of tiles.
+};
+
+/*
+ * Makes the mip levels of `len' tiles, where tile i is the `rects[i]'
+ * rectangle of `textures[i]'. Tiles without a texture are left out. Returns
+ * NULL when not even the first level could be made.
+ */
+struct mipmap* mipmap_create(SDL_Renderer* r, SDL_Texture* const* textures, const SDL_Rect* rects, int len);
+
+void mipmap_free(struct mipmap* m);
+
+/*
+ * Returns the rectangle of tile `i' in the page of the given level, which is
+ * between 1 and `levels'.
+ */
+static inline const SDL_Rect* mipmap_rect(const struct mipmap* m, int i, int level) {
+	return &m->rects[i * MIPMAP_LEVELS + level - 1];
+}
+
+#endif // MIPMAP_H
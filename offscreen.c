@@ -0,0 +1,80 @@
+#include "offscreen.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <SDL.h>
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct offscreen* offscreen_create(SDL_Renderer* r, int winwidth, int winheight, float scale_x, float scale_y, float zoom, bool snap) {
+	struct offscreen* o = calloc(1, sizeof(struct offscreen));
+	o->scale_x = scale_x;
+	o->scale_y = scale_y;
+	o->zoom = zoom;
+	o->snap = snap;
+
+	if (snap) {
+		// Use the whole factor closest to the scale the tiles were drawn at,
+		// and size the target so it covers the window after scaling.
+		float factor = roundf(fminf(zoom / scale_x, zoom / scale_y));
+		int k = factor < 1.0f ? 1 : (int)factor;
+		o->w = (winwidth + k - 1) / k;
+		o->h = (winheight + k - 1) / k;
+		o->dst = (SDL_Rect){ 0, 0, o->w * k, o->h * k };
+	} else {
+		// The target covers the same part of the world as the window. It is
+		// rounded up to whole pixels, so the copy may stick out a bit, but
+		// it is never stretched.
+		o->w = ceilf(winwidth / zoom * scale_x);
+		o->h = ceilf(winheight / zoom * scale_y);
+		o->dst = (SDL_Rect){ 0, 0, roundf(o->w / scale_x * zoom), roundf(o->h / scale_y * zoom) };
+	}
+
+	o->target = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, o->w, o->h);
+	if (o->target == NULL) {
+		debug_print("Unable to create offscreen target: %s\n", SDL_GetError());
+		free(o);
+		return NULL;
+	}
+	SDL_SetTextureScaleMode(o->target, SDL_ScaleModeNearest);
+
+	debug_print("Offscreen view of %d x %d pixels, drawn at %d x %d\n", o->w, o->h, o->dst.w, o->dst.h);
+	return o;
+}
+
+void offscreen_free(struct offscreen* o) {
+	SDL_DestroyTexture(o->target);
+	free(o);
+}
+
+void offscreen_view_size(const struct offscreen* o, int* w, int* h) {
+	*w = o->w / o->scale_x;
+	*h = o->h / o->scale_y;
+}
+
+void offscreen_snap_camera(const struct offscreen* o, struct camera* cam) {
+	cam->x = roundf(cam->x * o->scale_x) / o->scale_x;
+	cam->y = roundf(cam->y * o->scale_y) / o->scale_y;
+}
+
+bool offscreen_begin(struct offscreen* o, SDL_Renderer* r) {
+	if (SDL_SetRenderTarget(r, o->target) != 0) {
+		debug_print("Unable to draw offscreen: %s\n", SDL_GetError());
+		return false;
+	}
+
+	// Setting a target resets the scale, so this has to be done every frame.
+	SDL_RenderSetScale(r, o->scale_x, o->scale_y);
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+	SDL_RenderClear(r);
+	return true;
+}
+
+void offscreen_end(struct offscreen* o, SDL_Renderer* r) {
+	SDL_SetRenderTarget(r, NULL);
+	SDL_RenderCopy(r, o->target, NULL, &o->dst);
+}
@@ -0,0 +1,67 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include "camera.h"
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+/*
+ * An offscreen view draws the world at the native resolution of the tiles into
+ * one render target, which is scaled to the window with a single copy when the
+ * frame is done. The tiles themselves are then drawn unscaled, at whole pixel
+ * positions, which is cheaper and gets rid of the seams between them.
+ *
+ * Everything is still drawn in world units: the render scale of the target
+ * converts those to native pixels.
+ */
+struct offscreen {
+	SDL_Texture* target;
+	int w;           // Width of the target, in native pixels.
+	int h;           // Height of the target, in native pixels.
+	float scale_x;   // Native pixels per world unit.
+	float scale_y;   // Native pixels per world unit.
+	float zoom;      // Window pixels per world unit.
+	bool snap;       // Whether the target is scaled by a whole factor.
+	SDL_Rect dst;    // Where the target ends up in the window.
+};
+
+/*
+ * Creates an offscreen view for a window of the given size. The scale is the
+ * amount of native pixels per world unit, i.e. the size of a tile in the
+ * tileset divided by the size it is drawn at, and the zoom is the scale of the
+ * camera. The zoom should be at least the scale, or the target would have more
+ * pixels than the window. When `snap' is true, the target is scaled to the
+ * window by a whole factor, so every native pixel ends up the same size. The
+ * view then covers a slightly different part of the world.
+ *
+ * Returns NULL when the render target could not be created.
+ */
+struct offscreen* offscreen_create(SDL_Renderer* r, int winwidth, int winheight, float scale_x, float scale_y, float zoom, bool snap);
+
+void offscreen_free(struct offscreen* o);
+
+/*
+ * Gets the size of the part of the world which is visible through the view,
+ * in world units. This is what the camera should use as its window size.
+ */
+void offscreen_view_size(const struct offscreen* o, int* w, int* h);
+
+/*
+ * Rounds the camera position to whole native pixels, so the tiles do not
+ * shimmer when the camera moves.
+ */
+void offscreen_snap_camera(const struct offscreen* o, struct camera* cam);
+
+/*
+ * Redirects drawing to the offscreen target, and clears it.
+ */
+bool offscreen_begin(struct offscreen* o, SDL_Renderer* r);
+
+/*
+ * Redirects drawing back to the window, and copies the target onto it.
+ */
+void offscreen_end(struct offscreen* o, SDL_Renderer* r);
+
+#endif // OFFSCREEN_H
@@ -0,0 +1,296 @@
+#include "parallax.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+/*
+ * Reads a property as a float. Properties which were not given a type in Tiled
+ * are strings.
+ */
+static float property_float(tmx_properties* props, const char* name, float fallback) {
+	tmx_property* prop = tmx_get_property(props, name);
+	if (prop == NULL) {
+		return fallback;
+	}
+
+	switch (prop->type) {
+	case PT_FLOAT:
+		return prop->value.decimal;
+	case PT_INT:
+		return prop->value.integer;
+	case PT_NONE:
+	case PT_STRING:
+		return prop->value.string != NULL ? strtof(prop->value.string, NULL) : fallback;
+	default:
+		debug_print("Property '%s' is not a number\n", name);
+		return fallback;
+	}
+}
+
+static enum parallax_repeat property_repeat(tmx_properties* props) {
+	tmx_property* prop = tmx_get_property(props, "repeat");
+	if (prop == NULL || prop->value.string == NULL || (prop->type != PT_STRING && prop->type != PT_NONE)) {
+		return PARALLAX_REPEAT_NONE;
+	}
+
+	const char* value = prop->value.string;
+	if (strcmp(value, "x") == 0) {
+		return PARALLAX_REPEAT_X;
+	} else if (strcmp(value, "y") == 0) {
+		return PARALLAX_REPEAT_Y;
+	} else if (strcmp(value, "both") == 0) {
+		return PARALLAX_REPEAT_BOTH;
+	} else if (strcmp(value, "none") != 0) {
+		debug_print("Unknown repeat '%s', not repeating\n", value);
+	}
+	return PARALLAX_REPEAT_NONE;
+}
+
+/*
+ * Makes the scaled texture of a layer: the image scaled by (scale_x, scale_y)
+ * once, and repeated until it covers the view along the axes it repeats on.
+ */
+static void make_scaled(struct parallax_layer* pl, SDL_Renderer* r, float scale_x, float scale_y, int view_w, int view_h) {
+	if (pl->scaled != NULL) {
+		SDL_DestroyTexture(pl->scaled);
+		pl->scaled = NULL;
+	}
+
+	pl->copy_w = SDL_max(1, (int)lroundf(pl->w * scale_x));
+	pl->copy_h = SDL_max(1, (int)lroundf(pl->h * scale_y));
+	int copies_x = pl->repeat & PARALLAX_REPEAT_X ? SDL_max(1, (view_w + pl->copy_w - 1) / pl->copy_w) : 1;
+	int copies_y = pl->repeat & PARALLAX_REPEAT_Y ? SDL_max(1, (view_h + pl->copy_h - 1) / pl->copy_h) : 1;
+	pl->scaled_w = copies_x * pl->copy_w;
+	pl->scaled_h = copies_y * pl->copy_h;
+
+	pl->scaled = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, pl->scaled_w, pl->scaled_h);
+	if (pl->scaled == NULL) {
+		debug_print("Unable to create a %d x %d texture: %s\n", pl->scaled_w, pl->scaled_h, SDL_GetError());
+		return;
+	}
+
+	SDL_Texture* target = SDL_GetRenderTarget(r);
+	float saved_x, saved_y;
+	SDL_RenderGetScale(r, &saved_x, &saved_y);
+	if (SDL_SetRenderTarget(r, pl->scaled) != 0) {
+		debug_print("Unable to draw into texture: %s\n", SDL_GetError());
+		SDL_DestroyTexture(pl->scaled);
+		pl->scaled = NULL;
+		return;
+	}
+	SDL_RenderSetScale(r, 1.0f, 1.0f);
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+	SDL_RenderClear(r);
+
+	// Copy the pixels as they are, the opacity is applied when drawing.
+	SDL_BlendMode blend;
+	SDL_GetTextureBlendMode(pl->image, &blend);
+	SDL_SetTextureBlendMode(pl->image, SDL_BLENDMODE_NONE);
+	SDL_SetTextureAlphaMod(pl->image, 0xff);
+	for (int y = 0; y < copies_y; y++) {
+		for (int x = 0; x < copies_x; x++) {
+			SDL_Rect dst = { x * pl->copy_w, y * pl->copy_h, pl->copy_w, pl->copy_h };
+			SDL_RenderCopy(r, pl->image, NULL, &dst);
+		}
+	}
+	SDL_SetTextureBlendMode(pl->image, blend);
+
+	SDL_SetRenderTarget(r, target);
+	SDL_RenderSetScale(r, saved_x, saved_y);
+	SDL_SetTextureBlendMode(pl->scaled, SDL_BLENDMODE_BLEND);
+}
+
+/*
+ * Returns the first position, at or before 0, from which copies `size' apart
+ * cover the view.
+ */
+static float wrap(float pos, float size) {
+	float start = fmodf(pos, size);
+	return start > 0 ? start - size : start;
+}
+
+/*
+ * Draws a layer from its scaled texture. Positions are in output pixels, and
+ * converted back to world units through the render scale (rx, ry).
+ */
+static int draw_scaled(const struct parallax_layer* pl, SDL_Renderer* r, float x, float y, int view_w, int view_h, float rx, float ry) {
+	if (pl->repeat & PARALLAX_REPEAT_X) {
+		x = wrap(x, pl->copy_w);
+	}
+	if (pl->repeat & PARALLAX_REPEAT_Y) {
+		y = wrap(y, pl->copy_h);
+	}
+
+	// The texture is at least as large as the view along a repeating axis,
+	// and starts less than a copy before it, so two copies cover it.
+	int copies_x = pl->repeat & PARALLAX_REPEAT_X && x + pl->scaled_w < view_w ? 2 : 1;
+	int copies_y = pl->repeat & PARALLAX_REPEAT_Y && y + pl->scaled_h < view_h ? 2 : 1;
+
+	int count = 0;
+	SDL_SetTextureAlphaMod(pl->scaled, pl->opacity);
+	for (int j = 0; j < copies_y; j++) {
+		for (int i = 0; i < copies_x; i++) {
+			float cx = x + i * pl->scaled_w;
+			float cy = y + j * pl->scaled_h;
+			if (cx >= view_w || cy >= view_h || cx + pl->scaled_w <= 0 || cy + pl->scaled_h <= 0) {
+				continue;
+			}
+			SDL_FRect dst = { cx / rx, cy / ry, pl->scaled_w / rx, pl->scaled_h / ry };
+			SDL_RenderCopyF(r, pl->scaled, NULL, &dst);
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+ * Draws a layer by scaling its image every copy, when it has no scaled
+ * texture. This may take more than four copies.
+ */
+static int draw_unscaled(const struct parallax_layer* pl, SDL_Renderer* r, float x, float y, int view_w, int view_h, float sx, float sy, float rx, float ry) {
+	float w = pl->w * sx;
+	float h = pl->h * sy;
+	if (pl->repeat & PARALLAX_REPEAT_X) {
+		x = wrap(x, w);
+	}
+	if (pl->repeat & PARALLAX_REPEAT_Y) {
+		y = wrap(y, h);
+	}
+	int copies_x = pl->repeat & PARALLAX_REPEAT_X ? ceilf((view_w - x) / w) : 1;
+	int copies_y = pl->repeat & PARALLAX_REPEAT_Y ? ceilf((view_h - y) / h) : 1;
+
+	int count = 0;
+	SDL_SetTextureAlphaMod(pl->image, pl->opacity);
+	for (int j = 0; j < copies_y; j++) {
+		for (int i = 0; i < copies_x; i++) {
+			float cx = x + i * w;
+			float cy = y + j * h;
+			if (cx >= view_w || cy >= view_h || cx + w <= 0 || cy + h <= 0) {
+				continue;
+			}
+			SDL_FRect dst = { cx / rx, cy / ry, w / rx, h / ry };
+			SDL_RenderCopyF(r, pl->image, NULL, &dst);
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+ * Draws the layers [from, to) through the camera.
+ */
+static int draw_range(struct parallax* px, SDL_Renderer* r, const struct camera* cam, float scale_x, float scale_y, int from, int to) {
+	if (from >= to) {
+		return 0;
+	}
+
+	// Work in output pixels, so the scaled textures are copied without any
+	// scaling, also when drawing into a scaled offscreen view.
+	float rx, ry;
+	SDL_RenderGetScale(r, &rx, &ry);
+	float sx = scale_x * rx;
+	float sy = scale_y * ry;
+	int view_w = ceilf(cam->winwidth * rx);
+	int view_h = ceilf(cam->winheight * ry);
+
+	if (px->scale_x != sx || px->scale_y != sy || px->view_w != view_w || px->view_h != view_h) {
+		px->scale_x = sx;
+		px->scale_y = sy;
+		px->view_w = view_w;
+		px->view_h = view_h;
+		for (int i = 0; i < px->len; i++) {
+			make_scaled(&px->layers[i], r, sx, sy, view_w, view_h);
+		}
+	}
+
+	int count = 0;
+	for (int i = from; i < to; i++) {
+		const struct parallax_layer* pl = &px->layers[i];
+		float x = pl->offset_x * sx - cam->x * rx * pl->factor_x;
+		float y = pl->offset_y * sy - cam->y * ry * pl->factor_y;
+		if (pl->scaled != NULL) {
+			count += draw_scaled(pl, r, x, y, view_w, view_h, rx, ry);
+		} else {
+			count += draw_unscaled(pl, r, x, y, view_w, view_h, sx, sy, rx, ry);
+		}
+	}
+	return count;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct parallax* parallax_create(void) {
+	struct parallax* px = calloc(1, sizeof(struct parallax));
+	px->foreground = -1;
+	return px;
+}
+
+void parallax_free(struct parallax* px) {
+	for (int i = 0; i < px->len; i++) {
+		if (px->layers[i].scaled != NULL) {
+			SDL_DestroyTexture(px->layers[i].scaled);
+		}
+	}
+	free(px->layers);
+	free(px);
+}
+
+bool parallax_has_properties(const tmx_layer* layer) {
+	return tmx_get_property(layer->properties, "parallax") != NULL
+		|| tmx_get_property(layer->properties, "parallax_x") != NULL
+		|| tmx_get_property(layer->properties, "parallax_y") != NULL
+		|| tmx_get_property(layer->properties, "repeat") != NULL;
+}
+
+void parallax_add(struct parallax* px, const tmx_layer* layer, double opacity, int offsetx, int offsety, bool foreground) {
+	px->layers = realloc(px->layers, (px->len + 1) * sizeof(struct parallax_layer));
+	struct parallax_layer* pl = &px->layers[px->len];
+	memset(pl, 0, sizeof(struct parallax_layer));
+
+	pl->image = layer->content.image->resource_image;
+	pl->w = layer->content.image->width;
+	pl->h = layer->content.image->height;
+	if (pl->w == 0 || pl->h == 0) {
+		// The size of an image layer is optional in the TMX.
+		SDL_QueryTexture(pl->image, NULL, NULL, &pl->w, &pl->h);
+	}
+	pl->offset_x = offsetx;
+	pl->offset_y = offsety;
+
+	float factor = property_float(layer->properties, "parallax", 1.0f);
+	pl->factor_x = property_float(layer->properties, "parallax_x", factor);
+	pl->factor_y = property_float(layer->properties, "parallax_y", factor);
+	pl->repeat = property_repeat(layer->properties);
+	pl->opacity = opacity * 255;
+
+	debug_print("Parallax layer '%s': factor %.2f x %.2f, repeat %d\n", layer->name, pl->factor_x, pl->factor_y, pl->repeat);
+
+	if (foreground && px->foreground < 0) {
+		px->foreground = px->len;
+	}
+	px->len++;
+
+	// Make the scaled texture of the new layer as well.
+	parallax_invalidate(px);
+}
+
+int parallax_draw_background(struct parallax* px, SDL_Renderer* r, const struct camera* cam, float scale_x, float scale_y) {
+	return draw_range(px, r, cam, scale_x, scale_y, 0, px->foreground < 0 ? px->len : px->foreground);
+}
+
+int parallax_draw_foreground(struct parallax* px, SDL_Renderer* r, const struct camera* cam, float scale_x, float scale_y) {
+	return draw_range(px, r, cam, scale_x, scale_y, px->foreground < 0 ? px->len : px->foreground, px->len);
+}
+
+void parallax_invalidate(struct parallax* px) {
+	px->scale_x = 0;
+	px->scale_y = 0;
+}
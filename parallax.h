@@ -0,0 +1,104 @@
+#ifndef PARALLAX_H
+#define PARALLAX_H
+
+#include "camera.h"
+#include "tmx/tmx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+
+/*
+ * The axes along which a parallax layer repeats its image.
+ */
+enum parallax_repeat {
+	PARALLAX_REPEAT_NONE = 0,
+	PARALLAX_REPEAT_X    = 1,
+	PARALLAX_REPEAT_Y    = 2,
+	PARALLAX_REPEAT_BOTH = PARALLAX_REPEAT_X | PARALLAX_REPEAT_Y,
+};
+
+/*
+ * An image layer which scrolls at a speed of its own, to make it look further
+ * away (or closer) than the map. It is defined in the TMX as an image layer
+ * with these properties:
+ *
+ *   parallax    the scroll factor along both axes,
+ *   parallax_x  the scroll factor along the x axis, 1 by default,
+ *   parallax_y  the scroll factor along the y axis, 1 by default,
+ *   repeat      "none" (the default), "x", "y" or "both".
+ *
+ * A factor of 0 keeps the layer fixed to the screen, and a factor of 1 moves it
+ * along with the map.
+ */
+struct parallax_layer {
+	SDL_Texture* image; // The image of the TMX layer, which owns it.
+	int w;              // The size of the image, in map pixels.
+	int h;
+	float offset_x;     // The offset of the layer, in map pixels.
+	float offset_y;
+	float factor_x;     // The scroll factors.
+	float factor_y;
+	enum parallax_repeat repeat;
+	uint8_t opacity;
+
+	// The image scaled to its size on screen, and repeated along the axes it
+	// repeats on until it is at least as large as the view. Moving it then
+	// never takes more than two copies per axis. NULL when the texture
+	// could not be made, in which case the image is scaled every frame.
+	SDL_Texture* scaled;
+	int scaled_w;       // The size of the scaled texture, in output pixels.
+	int scaled_h;
+	int copy_w;         // The size of a single copy of the image in it.
+	int copy_h;
+};
+
+/*
+ * The parallax layers of a map. Like the layers of the draw plan, the ones
+ * before the 'Main' layer are drawn behind the map, and the others in front.
+ */
+struct parallax {
+	struct parallax_layer* layers;
+	int len;
+	int foreground; // The index of the first layer in front of the map.
+
+	// What the scaled textures were made for: the output pixels per map
+	// pixel, and the size of the view in output pixels. They are made again
+	// when any of this changes.
+	float scale_x;
+	float scale_y;
+	int view_w;
+	int view_h;
+};
+
+struct parallax* parallax_create(void);
+void parallax_free(struct parallax* px);
+
+/*
+ * Whether the image layer has any of the parallax properties, and should be
+ * drawn as a parallax layer.
+ */
+bool parallax_has_properties(const tmx_layer* layer);
+
+/*
+ * Adds an image layer, with the opacity and offset (in map pixels) of the
+ * groups it is in applied. Layers are drawn in the order they are added, and
+ * every layer in front of the map must be added after those behind it.
+ */
+void parallax_add(struct parallax* px, const tmx_layer* layer, double opacity, int offsetx, int offsety, bool foreground);
+
+/*
+ * Draws the layers behind or in front of the map through the camera. The scale
+ * is the amount of world units per map pixel. Returns the amount of copies.
+ */
+int parallax_draw_background(struct parallax* px, SDL_Renderer* r, const struct camera* cam, float scale_x, float scale_y);
+int parallax_draw_foreground(struct parallax* px, SDL_Renderer* r, const struct camera* cam, float scale_x, float scale_y);
+
+/*
+ * Makes the scaled textures again before they are used next, for when the
+ * contents of render targets were lost.
+ */
+void parallax_invalidate(struct parallax* px);
+
+#endif // PARALLAX_H
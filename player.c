@@ -97,6 +97,18 @@ static void player_trail_draw(const struct player_trail* list, const struct came
 	}
 }
 
+/*
+ * Checks whether any particle of the trail is still visible.
+ */
+static bool player_trail_visible(const struct player_trail* list) {
+	for (size_t i = 0; i < list->particle_len; i++) {
+		if (list->particles[i].life >= 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 //#############################################################################
 // Other cruft
 //#############################################################################
@@ -223,36 +235,87 @@ bool player_load_texture(struct player* p, SDL_Renderer* r, const char* path) {
 	return true;
 }
 
-static bool player_is_colliding(const struct player* p, float newx, float newy) {
+/*
+ * Returns the rectangle of the sprite sheet to draw, based on what the player
+ * is doing.
+ */
+static const SDL_Rect* player_sprite(const struct player* p) {
+	if (p->dy < 0.0f) {
+		// jumping animation.
+		return &p->rect_jump;
+	} else if (p->dy > 0.0f) {
+		// falling
+		return &p->rect_fall;
+	} else if ((p->left || p->right) && p->dy == 0.0f) {
+		return anim_current(p->move_animation);
+	}
+	return anim_current(p->rest_animation);
+}
+
+/*
+ * Moves the player by (movex, movey) through the map. Touching a tile stops the
+ * movement into the side it touched, and the rest of the movement slides along
+ * that side. Walking into a slope takes the player up along it. That takes
+ * three sweeps at most, one per side touched: the ground or the ceiling, a
+ * wall, and a slope. Two would drop what is left of a step onto a slope.
+ */
+static void player_move(struct player* p, float movex, float movey) {
 	assert(p->map != NULL);
 
-	// Get the tile coordinate of the top-left corner of the player's bounds.
-	int tilex1 = floorf(newx / p->map->tilewidth);
-	int tiley1 = floorf(newy / p->map->tileheight);
-
-	// Get the tile coordinate of the bottom-right corner of the player's bounds.
-	int tilex2 = floorf((newx + p->w) / p->map->tilewidth);
-	int tiley2 = floorf((newy + p->h) / p->map->tileheight);
-
-	// Now iterate over (tilex1, tiley1) - (tilex2, tiley2), and check
-	// whether the tile is collidable.
-	for (int x = tilex1; x <= tilex2; x++) {
-		for (int y = tiley1; y <= tiley2; y++) {
-			int tile = tilemap_tileat(p->map, x, y);
-			if (tile >= 1) {
-				return true;
+	for (int i = 0; i < 3 && (movex != 0.0f || movey != 0.0f); i++) {
+		struct sweep hit;
+		bool touched = tilemap_sweep(p->map, p->x, p->y, p->w, p->h, movex, movey, &hit);
+		p->x = hit.x;
+		p->y = hit.y;
+		if (!touched) {
+			break;
+		}
+
+		movex *= 1.0f - hit.t;
+		movey *= 1.0f - hit.t;
+		if (hit.normal_y >= 0.5f) {
+			// Collision with the ceiling.
+			debug_print("Collided with the ceiling at %.1f\n", p->y);
+			p->bx = p->x + (p->w / 4);
+			p->by = p->y - (p->h / 4);
+			p->jumping = false;
+			p->boop_life = 255;
+			p->dy = 0.0f;
+		} else if (hit.normal_y <= -0.5f) {
+			// Collision with the ground, we can jump again. The sweep put
+			// us right on top of the tile, so gravity does not pull us
+			// into it every frame. What is left of the fall is dropped,
+			// so we do not slide down slopes.
+			p->jumping = false;
+			p->can_jump = true;
+			if (p->dy > 1000.0f) {
+				debug_print("Hit the ground with a force of %.1f\n", p->dy);
 			}
+			p->dy = 0.0f;
+			movey = 0.0f;
 		}
-	}
 
-	return false;
+		// Take out the part of the movement going into the side.
+		float into = movex * hit.normal_x + movey * hit.normal_y;
+		if (into < 0.0f) {
+			movex -= hit.normal_x * into;
+			movey -= hit.normal_y * into;
+		}
+	}
 }
 
-void player_update(struct player* p, float delta_time) {
-	// First we have to have to possible new positions, so declare
-	// those, starting with our current x and y positions.
-	float newx = p->x;
-	float newy = p->y;
+bool player_update(struct player* p, float delta_time) {
+	// Remember what the player looked like, to tell whether it changed.
+	float oldx = p->x;
+	float oldy = p->y;
+	float oldscale = p->scale;
+	int oldboop = p->boop_life;
+	int olddirection = p->facing_direction;
+	bool oldtrail = player_trail_visible(p->particles);
+
+	// The distance to move this update, along both axes.
+	float movex = 0.0f;
+	float movey = 0.0f;
 
 	if (p->left || p->right) {
 		// increase the velocity of the player when moving, until
@@ -272,13 +335,13 @@ void player_update(struct player* p, float delta_time) {
 	// If we're moving left, calculate our possible new x position.
 	// Decrease the life of the particle and change the alpha.
 	if (p->left) {
-		newx -= p->dx * delta_time;
+		movex -= p->dx * delta_time;
 		p->facing_direction = -1;
 	}
 
 	// If we're moving right, calculate our possible new y position.
 	if (p->right) {
-		newx += p->dx * delta_time;
+		movex += p->dx * delta_time;
 		p->facing_direction = 1;
 	}
 
@@ -297,19 +360,10 @@ void player_update(struct player* p, float delta_time) {
 		p->dy = 0.0f;
 	}
 
-	// If we are moving left, or right, and if we are NOT colliding
-	// based on the new x position (but the same y position - this is
-	// important!), update our x position with the new x position.
-	if (p->left || p->right) {
-		if (!player_is_colliding(p, newx, p->y)) {
-			p->x = newx;
-		}
-	}
-
 	// Always apply some force downwards. Does not matter when we are
 	// jumping, or falling, or standing still...
 	p->dy += GRAVITY * delta_time;
-	newy += p->dy * delta_time;
+	movey += p->dy * delta_time;
 
 	if (p->boop_life > 0) {
 		p->boop_life -= (delta_time * 500.0f);
@@ -319,49 +373,37 @@ void player_update(struct player* p, float delta_time) {
 		p->boop_life = 0;
 	}
 
-	bool colliding = player_is_colliding(p, p->x, newy);
-	if (colliding) {
-		if (p->dy < 0.0f) {
-			// Collision with the ceiling, since our dy is negative.
-			debug_print("Collided with the ceiling at %.1f\n", newy);
-			p->bx = p->x + (p->w / 4);
-			p->by = p->y - (p->h / 4);
-			p->jumping = false;
-			p->boop_life = 255;
-		} else if (p->dy >= 0.0f) {
-			// Collision with the ground, we can jump again.
-			p->jumping = false;
-			p->can_jump = true;
-			// Align ourselves to the top of the tile we bumped into. If we don't
-			// do something like this, we get weird animation due to the gravity
-			// constantly wanting to pull us down. Explain this better for future
-			// self, I suppose...
-			struct tile tilehit = tilemap_gettile(p->map, p->x, newy + p->h);
-			// FIXME: NASTY HACK! Subtract with 0.001!
-			p->y = tilehit.r.y - p->h - 0.001;
-
-			if (p->dy > 1000.0f) {
-				debug_print("Hit the ground with a force of %.1f\n", p->dy);
-			}
-		}
-		// Whether we collided with the ceiling or the bottom,
-		// reset our y velocity to 0.
-		p->dy = 0.0f;
-	} else {
-		// We are not colliding with anything over the y-axis,j
-		// so update our actual position to the new y coordinate.
-		p->y = newy;
-	}
+	// Move along both axes at once. However far that is, every tile on the
+	// way is checked, so we do not tunnel through walls after a hitch.
+	player_move(p, movex, movey);
 
 	if (!p->left && !p->right && p->dy == 0.0f) {
 		anim_next(p->rest_animation);
 	}
 
 	// Update the collision rectangle to the new player position.
-	p->rect_collision.x = newx + 12;
-	p->rect_collision.y = newy + 5;
+	p->rect_collision.x = p->x + 12;
+	p->rect_collision.y = p->y + 5;
 	p->rect_collision.w = 25;
 	p->rect_collision.h = 38;
+
+	// The sprite is compared by address: every frame of an animation, and
+	// the jump and fall sprites, have their own rectangle.
+	const SDL_Rect* sprite = player_sprite(p);
+	bool changed = p->x != oldx || p->y != oldy
+		|| p->scale != oldscale || p->boop_life != oldboop
+		|| p->facing_direction != olddirection
+		|| sprite != p->last_sprite
+		|| oldtrail || player_trail_visible(p->particles);
+	p->last_sprite = sprite;
+	return changed;
+}
+
+uint32_t player_deadline(const struct player* p) {
+	if (p->left || p->right) {
+		return anim_deadline(p->move_animation);
+	}
+	return anim_deadline(p->rest_animation);
 }
 
 void player_handle_event(struct player* p, const SDL_Event* event) {
@@ -411,19 +453,7 @@ void player_draw(const struct player* p, const struct camera* cam, SDL_Renderer*
 		flip = SDL_FLIP_HORIZONTAL;
 	}
 
-	const SDL_Rect* rect = NULL;
-
-	if (p->dy < 0.0f) {
-		// jumping animation.
-		rect = &p->rect_jump;
-	} else if (p->dy > 0.0f) {
-		// falling
-		rect = &p->rect_fall;
-	} else if ((p->left || p->right) && p->dy == 0.0f) {
-		rect = anim_current(p->move_animation);
-	} else {
-		rect = anim_current(p->rest_animation);
-	}
+	const SDL_Rect* rect = player_sprite(p);
 
 	SDL_RenderCopyEx(r, p->texture, rect, &rect_sprite, 0, NULL, flip);
 
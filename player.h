@@ -85,6 +85,8 @@ struct player {
 	SDL_Rect rect_collision; // rectangle for collision purposes
 
 	struct player_trail* particles;
+
+	const SDL_Rect* last_sprite; // The sprite at the previous update.
 };
 
 struct player* player_create();
@@ -99,9 +101,16 @@ bool player_load_texture(struct player* p, SDL_Renderer* r, const char* path);
 
 /*
  * Update the player position. The delta_time is the time in milliseconds
- * between frames.
+ * between frames. Returns true when the player (or its particles) looks any
+ * different than before, and has to be drawn again.
+ */
+bool player_update(struct player* p, float delta_time);
+
+/*
+ * Returns the tick (as in SDL_GetTicks) at which the animation of the player
+ * advances, even when nothing else happens.
  */
-void player_update(struct player* p, float delta_time);
+uint32_t player_deadline(const struct player* p);
 
 /*
  * Handle SDL events on the player.
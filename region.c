@@ -0,0 +1,312 @@
+#include "region.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+/*
+ * Both files are little endian. The index is:
+ *
+ *   "TIDX", version, chunk_w, chunk_h, region_chunks, origin_x, origin_y,
+ *   width, height, layer count, then per layer its name length and name,
+ *   region count, then per region rx and ry.
+ *
+ * And a region is:
+ *
+ *   "TREG", version, rx, ry, chunk count, then per chunk its layer, cx, cy and
+ *   chunk_w x chunk_h gids.
+ *
+ * Every number is 32 bits.
+ */
+static const Uint32 INDEX_MAGIC = 0x58444954;  // "TIDX"
+static const Uint32 REGION_MAGIC = 0x47455254; // "TREG"
+static const Uint32 VERSION = 1;
+
+// Sanity limits, so a damaged file does not make us allocate the world.
+static const Uint32 MAX_NAME_LENGTH = 1024;
+static const Uint32 MAX_COUNT = 1 << 20;
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+/*
+ * Returns "<path><suffix>", which must be freed.
+ */
+static char* file_name(const char* path, const char* fmt, int rx, int ry) {
+	size_t size = strlen(path) + 64;
+	char* name = malloc(size);
+	snprintf(name, size, "%s", path);
+	snprintf(name + strlen(name), size - strlen(name), fmt, rx, ry);
+	return name;
+}
+
+static bool read_u32(SDL_RWops* rw, Uint32* value) {
+	Uint32 le;
+	if (SDL_RWread(rw, &le, sizeof(le), 1) != 1) {
+		return false;
+	}
+	*value = SDL_SwapLE32(le);
+	return true;
+}
+
+static bool read_int(SDL_RWops* rw, int* value) {
+	Uint32 u;
+	if (!read_u32(rw, &u)) {
+		return false;
+	}
+	*value = (int)(Sint32)u;
+	return true;
+}
+
+static bool write_u32(SDL_RWops* rw, Uint32 value) {
+	return SDL_WriteLE32(rw, value) == 1;
+}
+
+static bool write_int(SDL_RWops* rw, int value) {
+	return write_u32(rw, (Uint32)value);
+}
+
+/*
+ * Reads the magic and version of a file, and checks them.
+ */
+static bool read_header(SDL_RWops* rw, Uint32 magic) {
+	Uint32 m;
+	Uint32 v;
+	return read_u32(rw, &m) && m == magic && read_u32(rw, &v) && v == VERSION;
+}
+
+static int compare_coords(const void* a, const void* b) {
+	const struct region_coord* ca = a;
+	const struct region_coord* cb = b;
+	if (ca->ry != cb->ry) {
+		return ca->ry < cb->ry ? -1 : 1;
+	}
+	if (ca->rx != cb->rx) {
+		return ca->rx < cb->rx ? -1 : 1;
+	}
+	return 0;
+}
+
+static bool read_index(SDL_RWops* rw, struct region_index* ri) {
+	if (!read_header(rw, INDEX_MAGIC)
+			|| !read_int(rw, &ri->chunk_w) || !read_int(rw, &ri->chunk_h)
+			|| !read_int(rw, &ri->region_chunks)
+			|| !read_int(rw, &ri->origin_x) || !read_int(rw, &ri->origin_y)
+			|| !read_int(rw, &ri->width) || !read_int(rw, &ri->height)) {
+		return false;
+	}
+	if (ri->chunk_w <= 0 || ri->chunk_h <= 0 || ri->region_chunks <= 0 || ri->width < 0 || ri->height < 0) {
+		return false;
+	}
+
+	Uint32 count;
+	if (!read_u32(rw, &count) || count > MAX_COUNT) {
+		return false;
+	}
+	ri->layers = calloc(count, sizeof(char*));
+	for (Uint32 i = 0; i < count; i++) {
+		Uint32 len;
+		if (!read_u32(rw, &len) || len > MAX_NAME_LENGTH) {
+			return false;
+		}
+		ri->layers[i] = calloc(len + 1, 1);
+		ri->layers_len++;
+		if (len > 0 && SDL_RWread(rw, ri->layers[i], len, 1) != 1) {
+			return false;
+		}
+	}
+
+	if (!read_u32(rw, &count) || count > MAX_COUNT) {
+		return false;
+	}
+	ri->regions = calloc(count, sizeof(struct region_coord));
+	for (Uint32 i = 0; i < count; i++) {
+		if (!read_int(rw, &ri->regions[i].rx) || !read_int(rw, &ri->regions[i].ry)) {
+			return false;
+		}
+		ri->regions_len++;
+	}
+	return true;
+}
+
+static bool read_region(SDL_RWops* rw, struct region* rg, const struct region_index* ri) {
+	int rx;
+	int ry;
+	Uint32 count;
+	if (!read_header(rw, REGION_MAGIC) || !read_int(rw, &rx) || !read_int(rw, &ry)) {
+		return false;
+	}
+	if (rx != rg->rx || ry != rg->ry || !read_u32(rw, &count) || count > MAX_COUNT) {
+		return false;
+	}
+
+	size_t cells = (size_t)ri->chunk_w * ri->chunk_h;
+	rg->chunks = calloc(count, sizeof(struct region_chunk));
+	for (Uint32 i = 0; i < count; i++) {
+		struct region_chunk* c = &rg->chunks[i];
+		if (!read_int(rw, &c->layer) || !read_int(rw, &c->cx) || !read_int(rw, &c->cy)) {
+			return false;
+		}
+		if (c->layer < 0 || c->layer >= ri->layers_len) {
+			return false;
+		}
+		c->gids = malloc(cells * sizeof(int32_t));
+		rg->len++;
+		if (SDL_RWread(rw, c->gids, sizeof(int32_t), cells) != cells) {
+			return false;
+		}
+		for (size_t j = 0; j < cells; j++) {
+			c->gids[j] = (int32_t)SDL_SwapLE32((Uint32)c->gids[j]);
+		}
+	}
+	return true;
+}
+
+static void clear_region(struct region* rg) {
+	for (int i = 0; i < rg->len; i++) {
+		free(rg->chunks[i].gids);
+	}
+	free(rg->chunks);
+	rg->chunks = NULL;
+	rg->len = 0;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct region_index* region_index_load(const char* path) {
+	char* name = file_name(path, ".regions", 0, 0);
+	SDL_RWops* rw = SDL_RWFromFile(name, "rb");
+	if (rw == NULL) {
+		debug_print("Unable to open %s: %s\n", name, SDL_GetError());
+		free(name);
+		return NULL;
+	}
+
+	struct region_index* ri = calloc(1, sizeof(struct region_index));
+	bool ok = read_index(rw, ri);
+	SDL_RWclose(rw);
+	if (!ok) {
+		debug_print("%s is not a valid region index\n", name);
+		region_index_free(ri);
+		ri = NULL;
+	} else {
+		qsort(ri->regions, ri->regions_len, sizeof(struct region_coord), compare_coords);
+	}
+
+	free(name);
+	return ri;
+}
+
+bool region_index_write(const struct region_index* ri, const char* path) {
+	char* name = file_name(path, ".regions", 0, 0);
+	SDL_RWops* rw = SDL_RWFromFile(name, "wb");
+	if (rw == NULL) {
+		debug_print("Unable to create %s: %s\n", name, SDL_GetError());
+		free(name);
+		return false;
+	}
+
+	bool ok = write_u32(rw, INDEX_MAGIC) && write_u32(rw, VERSION)
+		&& write_int(rw, ri->chunk_w) && write_int(rw, ri->chunk_h)
+		&& write_int(rw, ri->region_chunks)
+		&& write_int(rw, ri->origin_x) && write_int(rw, ri->origin_y)
+		&& write_int(rw, ri->width) && write_int(rw, ri->height)
+		&& write_int(rw, ri->layers_len);
+
+	for (int i = 0; ok && i < ri->layers_len; i++) {
+		size_t len = strlen(ri->layers[i]);
+		ok = write_u32(rw, len) && (len == 0 || SDL_RWwrite(rw, ri->layers[i], len, 1) == 1);
+	}
+
+	ok = ok && write_int(rw, ri->regions_len);
+	for (int i = 0; ok && i < ri->regions_len; i++) {
+		ok = write_int(rw, ri->regions[i].rx) && write_int(rw, ri->regions[i].ry);
+	}
+
+	if (SDL_RWclose(rw) != 0 || !ok) {
+		debug_print("Unable to write %s: %s\n", name, SDL_GetError());
+		ok = false;
+	}
+	free(name);
+	return ok;
+}
+
+void region_index_free(struct region_index* ri) {
+	if (ri == NULL) {
+		return;
+	}
+	for (int i = 0; i < ri->layers_len; i++) {
+		free(ri->layers[i]);
+	}
+	free(ri->layers);
+	free(ri->regions);
+	free(ri);
+}
+
+bool region_index_contains(const struct region_index* ri, int rx, int ry) {
+	struct region_coord key = { rx, ry };
+	return bsearch(&key, ri->regions, ri->regions_len, sizeof(struct region_coord), compare_coords) != NULL;
+}
+
+bool region_load(struct region* rg, const char* path, const struct region_index* ri) {
+	char* name = file_name(path, ".%d.%d.region", rg->rx, rg->ry);
+	SDL_RWops* rw = SDL_RWFromFile(name, "rb");
+	if (rw == NULL) {
+		debug_print("Unable to open %s: %s\n", name, SDL_GetError());
+		free(name);
+		return false;
+	}
+
+	bool ok = read_region(rw, rg, ri);
+	SDL_RWclose(rw);
+	if (!ok) {
+		debug_print("%s is not a valid region\n", name);
+		clear_region(rg);
+	}
+
+	free(name);
+	return ok;
+}
+
+bool region_write(const struct region* rg, const char* path, const struct region_index* ri) {
+	char* name = file_name(path, ".%d.%d.region", rg->rx, rg->ry);
+	SDL_RWops* rw = SDL_RWFromFile(name, "wb");
+	if (rw == NULL) {
+		debug_print("Unable to create %s: %s\n", name, SDL_GetError());
+		free(name);
+		return false;
+	}
+
+	bool ok = write_u32(rw, REGION_MAGIC) && write_u32(rw, VERSION)
+		&& write_int(rw, rg->rx) && write_int(rw, rg->ry)
+		&& write_int(rw, rg->len);
+
+	int cells = ri->chunk_w * ri->chunk_h;
+	for (int i = 0; ok && i < rg->len; i++) {
+		const struct region_chunk* c = &rg->chunks[i];
+		ok = write_int(rw, c->layer) && write_int(rw, c->cx) && write_int(rw, c->cy);
+		for (int j = 0; ok && j < cells; j++) {
+			ok = write_u32(rw, (Uint32)c->gids[j]);
+		}
+	}
+
+	if (SDL_RWclose(rw) != 0 || !ok) {
+		debug_print("Unable to write %s: %s\n", name, SDL_GetError());
+		ok = false;
+	}
+	free(name);
+	return ok;
+}
+
+void region_free(struct region* rg) {
+	if (rg == NULL) {
+		return;
+	}
+	clear_region(rg);
+	free(rg);
+}
@@ -0,0 +1,94 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A chunk of a single tile layer in a region.
+ */
+struct region_chunk {
+	int layer;     // The index of the tile layer in the region index.
+	int cx;        // The chunk x coordinate, relative to the origin of the map.
+	int cy;        // The chunk y coordinate, relative to the origin of the map.
+	int32_t* gids; // chunk_w x chunk_h gids, including the TMX flip bits.
+};
+
+/*
+ * A region is a square of chunks of every tile layer of an infinite map, which
+ * is stored in a file of its own, so it can be loaded while the game runs. Only
+ * the chunks with tiles are stored.
+ */
+struct region {
+	int rx; // The region x coordinate (in regions, not chunks or tiles).
+	int ry; // The region y coordinate (in regions, not chunks or tiles).
+
+	struct region_chunk* chunks;
+	int len;
+};
+
+/*
+ * The coordinate of a region which has a file.
+ */
+struct region_coord {
+	int rx;
+	int ry;
+};
+
+/*
+ * Describes how a map was split into regions: the chunk grid, the area of the
+ * map, the tile layers the chunks belong to, and which regions have a file.
+ */
+struct region_index {
+	int chunk_w;       // The width of a chunk, in tiles.
+	int chunk_h;       // The height of a chunk, in tiles.
+	int region_chunks; // The width and height of a region, in chunks.
+	int origin_x;      // The TMX tile coordinate of tile (0, 0).
+	int origin_y;
+	int width;         // The size of the map, in tiles.
+	int height;
+
+	char** layers; // The names of the tile layers.
+	int layers_len;
+
+	struct region_coord* regions; // Sorted by y, then x.
+	int regions_len;
+};
+
+/*
+ * Reads the region index of the map at `path', which is stored next to it as
+ * "<path>.regions". Returns NULL when it cannot be read.
+ */
+struct region_index* region_index_load(const char* path);
+
+/*
+ * Writes the region index of the map at `path'. The regions must be sorted.
+ */
+bool region_index_write(const struct region_index* ri, const char* path);
+void region_index_free(struct region_index* ri);
+
+/*
+ * Whether the region has a file, so it has any tiles.
+ */
+bool region_index_contains(const struct region_index* ri, int rx, int ry);
+
+/*
+ * Reads the chunks of region (rg->rx, rg->ry) of the map at `path', which is
+ * stored next to it as "<path>.<rx>.<ry>.region". Only the index is shared, so
+ * this can be called from any thread. Returns false, leaving the region empty,
+ * when the file cannot be read.
+ */
+bool region_load(struct region* rg, const char* path, const struct region_index* ri);
+
+/*
+ * Writes the chunks of the region, for the map at `path'.
+ */
+bool region_write(const struct region* rg, const char* path, const struct region_index* ri);
+
+/*
+ * Frees the chunks of the region, and the region itself. Chunks whose gids
+ * were taken over are set to NULL.
+ */
+void region_free(struct region* rg);
+
+#endif // REGION_H
@@ -0,0 +1,195 @@
+#include "scrollview.h"
+#include "util.h"
+
+#include <stdlib.h>
+
+#include <SDL.h>
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+static void destroy_targets(struct scrollview* sv) {
+	if (sv->front != NULL) {
+		SDL_DestroyTexture(sv->front);
+	}
+	if (sv->back != NULL) {
+		SDL_DestroyTexture(sv->back);
+	}
+	sv->front = NULL;
+	sv->back = NULL;
+	sv->valid = false;
+}
+
+static SDL_Texture* create_target(SDL_Renderer* r, int w, int h) {
+	SDL_Texture* t = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+	if (t == NULL) {
+		debug_print("Unable to create scroll view target: %s\n", SDL_GetError());
+		return NULL;
+	}
+	SDL_SetTextureBlendMode(t, SDL_BLENDMODE_BLEND);
+	return t;
+}
+
+/*
+ * Makes sure both targets exist and have the given size.
+ */
+static bool ensure_targets(struct scrollview* sv, SDL_Renderer* r, int w, int h) {
+	if (sv->front != NULL && sv->back != NULL && sv->w == w && sv->h == h) {
+		return true;
+	}
+
+	destroy_targets(sv);
+	sv->front = create_target(r, w, h);
+	sv->back = create_target(r, w, h);
+	sv->w = w;
+	sv->h = h;
+	if (sv->front == NULL || sv->back == NULL) {
+		destroy_targets(sv);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Copies the contents of the front target into the back target, moved by
+ * (-dx, -dy), and swaps them. The uncovered parts are left transparent.
+ */
+static bool shift(struct scrollview* sv, SDL_Renderer* r, int dx, int dy) {
+	if (SDL_SetRenderTarget(r, sv->back) != 0) {
+		debug_print("Unable to scroll view: %s\n", SDL_GetError());
+		return false;
+	}
+
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+	SDL_RenderClear(r);
+
+	// Copy the pixels as they are, alpha included.
+	SDL_Rect dst = { -dx, -dy, sv->w, sv->h };
+	SDL_SetTextureBlendMode(sv->front, SDL_BLENDMODE_NONE);
+	SDL_RenderCopy(r, sv->front, NULL, &dst);
+	SDL_SetTextureBlendMode(sv->front, SDL_BLENDMODE_BLEND);
+
+	SDL_Texture* tmp = sv->front;
+	sv->front = sv->back;
+	sv->back = tmp;
+	return true;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct scrollview* scrollview_create(void) {
+	return calloc(1, sizeof(struct scrollview));
+}
+
+void scrollview_free(struct scrollview* sv) {
+	destroy_targets(sv);
+	free(sv);
+}
+
+int scrollview_begin(struct scrollview* sv, SDL_Renderer* r, int x, int y, int w, int h, SDL_Rect areas[SCROLLVIEW_MAX_AREAS]) {
+	sv->drawing = false;
+	if (!ensure_targets(sv, r, w, h)) {
+		return 0;
+	}
+
+	// The dirty area, moved to where it is in the view after scrolling.
+	SDL_Rect view = { 0, 0, w, h };
+	SDL_Rect dirty = { sv->dirty.x - x, sv->dirty.y - y, sv->dirty.w, sv->dirty.h };
+	bool is_dirty = SDL_IntersectRect(&dirty, &view, &dirty);
+	sv->dirty = (SDL_Rect){ 0, 0, 0, 0 };
+
+	int dx = x - sv->x;
+	int dy = y - sv->y;
+	if (sv->valid && dx == 0 && dy == 0 && !is_dirty) {
+		// Nothing changed, so whatever was drawn last time is still good.
+		return 0;
+	}
+
+	sv->previous = SDL_GetRenderTarget(r);
+	sv->drawing = true;
+
+	int count = 0;
+	if (sv->valid && abs(dx) < w && abs(dy) < h && shift(sv, r, dx, dy)) {
+		// The strip on the left or right which came into view.
+		if (dx != 0) {
+			areas[count++] = (SDL_Rect){ dx > 0 ? w - dx : 0, 0, abs(dx), h };
+		}
+		// The strip at the top or bottom, without the corner which is part
+		// of the strip above, so no tile is drawn twice.
+		if (dy != 0) {
+			areas[count++] = (SDL_Rect){ dx < 0 ? -dx : 0, dy > 0 ? h - dy : 0, w - abs(dx), abs(dy) };
+		}
+		if (is_dirty) {
+			areas[count++] = dirty;
+		}
+	} else {
+		areas[count++] = (SDL_Rect){ 0, 0, w, h };
+	}
+
+	if (SDL_SetRenderTarget(r, sv->front) != 0) {
+		debug_print("Unable to draw scroll view: %s\n", SDL_GetError());
+		sv->valid = false;
+		sv->drawing = false;
+		return 0;
+	}
+
+	sv->x = x;
+	sv->y = y;
+	sv->valid = true;
+	return count;
+}
+
+void scrollview_clear(SDL_Renderer* r, const SDL_Rect* area) {
+	// Write transparent pixels, instead of blending them with what is there.
+	SDL_BlendMode blend;
+	SDL_GetRenderDrawBlendMode(r, &blend);
+	SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+	SDL_RenderSetClipRect(r, area);
+	SDL_RenderFillRect(r, area);
+	SDL_SetRenderDrawBlendMode(r, blend);
+}
+
+void scrollview_end(struct scrollview* sv, SDL_Renderer* r) {
+	if (!sv->drawing) {
+		return;
+	}
+
+	SDL_RenderSetClipRect(r, NULL);
+	SDL_SetRenderTarget(r, sv->previous);
+	sv->drawing = false;
+}
+
+void scrollview_draw(const struct scrollview* sv, SDL_Renderer* r, float x, float y) {
+	if (!sv->valid) {
+		return;
+	}
+
+	SDL_FRect dst = { x, y, sv->w, sv->h };
+	SDL_RenderCopyF(r, sv->front, NULL, &dst);
+}
+
+void scrollview_invalidate(struct scrollview* sv) {
+	sv->valid = false;
+}
+
+void scrollview_dirty(struct scrollview* sv, const SDL_Rect* area) {
+	if (!sv->valid) {
+		return;
+	}
+
+	SDL_Rect view = { sv->x, sv->y, sv->w, sv->h };
+	SDL_Rect visible;
+	if (!SDL_IntersectRect(area, &view, &visible)) {
+		return;
+	}
+
+	if (SDL_RectEmpty(&sv->dirty)) {
+		sv->dirty = visible;
+	} else {
+		SDL_UnionRect(&sv->dirty, &visible, &sv->dirty);
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef SCROLLVIEW_H
+#define SCROLLVIEW_H
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+/*
+ * A scroll view keeps what was drawn in the previous frame in a persistent
+ * render target. When the view moves by (dx, dy) pixels, the contents which
+ * are still valid are shifted, and only the strips which came into view have
+ * to be drawn. When the view does not move, nothing has to be drawn at all.
+ *
+ * This is meant for the software renderer, where drawing every tile every
+ * frame is expensive but copying one large texture is not. Shifting is done by
+ * copying between two targets, since a texture cannot be copied onto itself.
+ */
+struct scrollview {
+	SDL_Texture* front; // The current contents.
+	SDL_Texture* back;  // Scratch target to shift the contents into.
+	int w;              // Size of the targets, in pixels.
+	int h;
+
+	bool valid; // Whether the front target holds the view at (x, y).
+	int x;      // World position of the top-left corner, in whole pixels.
+	int y;
+
+	SDL_Rect dirty; // World area which has to be drawn again, empty if none.
+
+	SDL_Texture* previous; // The render target to restore when done.
+	bool drawing;          // Whether scrollview_begin switched the target.
+};
+
+// The most areas scrollview_begin returns.
+#define SCROLLVIEW_MAX_AREAS 3
+
+struct scrollview* scrollview_create(void);
+void scrollview_free(struct scrollview* sv);
+
+/*
+ * Moves the view to world position (x, y), with the given size in pixels.
+ * The areas which have to be drawn are stored in `areas', in pixels relative
+ * to the top-left corner of the view, and the amount of them is returned:
+ * the strips which came into view when it scrolled, the area marked dirty,
+ * or the whole view when it could not be reused.
+ *
+ * When any area has to be drawn, the view is made the render target and has
+ * to be finished with scrollview_end. Areas may overlap, so every area has to
+ * be cleared with scrollview_clear before it is drawn.
+ */
+int scrollview_begin(struct scrollview* sv, SDL_Renderer* r, int x, int y, int w, int h, SDL_Rect areas[SCROLLVIEW_MAX_AREAS]);
+
+/*
+ * Makes an area of the view transparent, and clips drawing to it.
+ */
+void scrollview_clear(SDL_Renderer* r, const SDL_Rect* area);
+
+/*
+ * Restores the render target which was active before scrollview_begin.
+ */
+void scrollview_end(struct scrollview* sv, SDL_Renderer* r);
+
+/*
+ * Copies the view to the current render target, at the given offset.
+ */
+void scrollview_draw(const struct scrollview* sv, SDL_Renderer* r, float x, float y);
+
+/*
+ * Makes sure the whole view is drawn again the next time it is used.
+ */
+void scrollview_invalidate(struct scrollview* sv);
+
+/*
+ * Makes sure an area of the world, in pixels, is drawn again the next time the
+ * view is used. Areas outside of the view are ignored.
+ */
+void scrollview_dirty(struct scrollview* sv, const SDL_Rect* area);
+
+#endif // SCROLLVIEW_H
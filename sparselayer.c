@@ -0,0 +1,136 @@
+#include "sparselayer.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmx/tmx.h"
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct sparselayer* sparselayer_create(const uint32_t* gids, int width, int height) {
+	struct sparselayer* sl = calloc(1, sizeof(struct sparselayer));
+
+	sl->bands_len = (height + SPARSE_BAND_ROWS - 1) / SPARSE_BAND_ROWS;
+	sl->bands = calloc(sl->bands_len + 1, sizeof(int));
+
+	// First count the tiles, so we know how large the list has to be.
+	for (int i = 0; i < width * height; i++) {
+		if ((gids[i] & TMX_FLIP_BITS_REMOVAL) != 0) {
+			sl->len++;
+		}
+	}
+	sl->capacity = sl->len;
+	sl->tiles = malloc(sl->capacity * sizeof(struct sparse_tile));
+
+	// Then fill the bands one by one. Walking the columns before the rows
+	// within a band results in the tiles being sorted by x, then y.
+	int n = 0;
+	for (int b = 0; b < sl->bands_len; b++) {
+		sl->bands[b] = n;
+
+		int y1 = b * SPARSE_BAND_ROWS;
+		int y2 = y1 + SPARSE_BAND_ROWS > height ? height : y1 + SPARSE_BAND_ROWS;
+		for (int x = 0; x < width; x++) {
+			for (int y = y1; y < y2; y++) {
+				uint32_t gid = gids[y * width + x];
+				if ((gid & TMX_FLIP_BITS_REMOVAL) != 0) {
+					sl->tiles[n++] = (struct sparse_tile){ x, y, gid };
+				}
+			}
+		}
+	}
+	sl->bands[sl->bands_len] = n;
+	assert(n == sl->len);
+
+	return sl;
+}
+
+void sparselayer_free(struct sparselayer* sl) {
+	free(sl->tiles);
+	free(sl->bands);
+	free(sl);
+}
+
+float sparselayer_fill_ratio(const uint32_t* gids, int width, int height) {
+	if (width * height == 0) {
+		return 0.0f;
+	}
+
+	int filled = 0;
+	for (int i = 0; i < width * height; i++) {
+		if ((gids[i] & TMX_FLIP_BITS_REMOVAL) != 0) {
+			filled++;
+		}
+	}
+	return (float)filled / (width * height);
+}
+
+const struct sparse_tile* sparselayer_find(const struct sparselayer* sl, int band, int x) {
+	assert(band >= 0 && band < sl->bands_len);
+
+	// Binary search for the lower bound of x within the band.
+	int lo = sl->bands[band];
+	int hi = sl->bands[band + 1];
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (sl->tiles[mid].x < x) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return &sl->tiles[lo];
+}
+
+void sparselayer_set(struct sparselayer* sl, int x, int y, uint32_t gid) {
+	int band = y / SPARSE_BAND_ROWS;
+	assert(band >= 0 && band < sl->bands_len);
+
+	// Binary search for the lower bound of (x, y) within the band.
+	int lo = sl->bands[band];
+	int hi = sl->bands[band + 1];
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		const struct sparse_tile* t = &sl->tiles[mid];
+		if (t->x < x || (t->x == x && t->y < y)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	struct sparse_tile* t = &sl->tiles[lo];
+	bool found = lo < sl->bands[band + 1] && t->x == x && t->y == y;
+	bool empty = (gid & TMX_FLIP_BITS_REMOVAL) == 0;
+
+	if (found && !empty) {
+		t->gid = gid;
+	} else if (found && empty) {
+		memmove(t, t + 1, (sl->len - lo - 1) * sizeof(struct sparse_tile));
+		sl->len--;
+		for (int b = band + 1; b <= sl->bands_len; b++) {
+			sl->bands[b]--;
+		}
+	} else if (!found && !empty) {
+		if (sl->len == sl->capacity) {
+			sl->capacity = sl->capacity > 0 ? sl->capacity * 2 : 16;
+			sl->tiles = realloc(sl->tiles, sl->capacity * sizeof(struct sparse_tile));
+			t = &sl->tiles[lo];
+		}
+		memmove(t + 1, t, (sl->len - lo) * sizeof(struct sparse_tile));
+		*t = (struct sparse_tile){ x, y, gid };
+		sl->len++;
+		for (int b = band + 1; b <= sl->bands_len; b++) {
+			sl->bands[b]++;
+		}
+	}
+}
+
+const struct sparse_tile* sparselayer_band_end(const struct sparselayer* sl, int band) {
+	assert(band >= 0 && band < sl->bands_len);
+	return &sl->tiles[sl->bands[band + 1]];
+}
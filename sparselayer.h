@@ -0,0 +1,63 @@
+#ifndef SPARSELAYER_H
+#define SPARSELAYER_H
+
+#include <stdint.h>
+
+/*
+ * A single non-empty tile in a sparse layer.
+ */
+struct sparse_tile {
+	int32_t x;
+	int32_t y;
+	uint32_t gid; // The gid, including the TMX flip bits.
+};
+
+/*
+ * A sparse layer only stores the non-empty tiles of a tile layer. The tiles are
+ * bucketed in bands of SPARSE_BAND_ROWS rows, and sorted by x (then y) within a
+ * band. This way the tiles in a range of columns can be found with a binary
+ * search per band, instead of visiting every cell in the range.
+ */
+struct sparselayer {
+	struct sparse_tile* tiles;
+	int len;
+	int capacity; // The amount of tiles which fit in the list.
+
+	// The tiles of band b are tiles[bands[b]] up to tiles[bands[b + 1]].
+	int* bands;
+	int bands_len;
+};
+
+// The amount of rows in a band.
+#define SPARSE_BAND_ROWS 8
+
+/*
+ * Creates a sparse layer from the gids of a width x height layer.
+ */
+struct sparselayer* sparselayer_create(const uint32_t* gids, int width, int height);
+void sparselayer_free(struct sparselayer* sl);
+
+/*
+ * Returns the ratio of non-empty tiles in the gids of a layer, from 0 to 1.
+ */
+float sparselayer_fill_ratio(const uint32_t* gids, int width, int height);
+
+/*
+ * Returns the first tile in the band with an x coordinate of at least `x'.
+ * When there is none, the end of the band is returned.
+ */
+const struct sparse_tile* sparselayer_find(const struct sparselayer* sl, int band, int x);
+
+/*
+ * Sets the gid of the tile at (x, y), which adds or removes the tile when it
+ * becomes non-empty or empty. The cost depends on the amount of tiles in the
+ * layer, not on the size of the map.
+ */
+void sparselayer_set(struct sparselayer* sl, int x, int y, uint32_t gid);
+
+/*
+ * Returns the end of the band (one past its last tile).
+ */
+const struct sparse_tile* sparselayer_band_end(const struct sparselayer* sl, int band);
+
+#endif // SPARSELAYER_H
@@ -0,0 +1,138 @@
+#include "streamer.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+/*
+ * Adds a region to the queue. Called from the producing thread only. The
+ * queue is never full, because no more than STREAMER_QUEUE_SIZE regions are
+ * pending.
+ */
+static void queue_push(struct region_queue* q, struct region* rg) {
+	int tail = SDL_AtomicGet(&q->tail);
+	q->items[tail & (STREAMER_QUEUE_SIZE - 1)] = rg;
+	// The item must be visible before the consumer sees the new tail.
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&q->tail, tail + 1);
+}
+
+/*
+ * Takes a region from the queue, or returns NULL when it is empty. Called
+ * from the consuming thread only.
+ */
+static struct region* queue_pop(struct region_queue* q) {
+	int head = SDL_AtomicGet(&q->head);
+	if (head == SDL_AtomicGet(&q->tail)) {
+		return NULL;
+	}
+	SDL_MemoryBarrierAcquire();
+	struct region* rg = q->items[head & (STREAMER_QUEUE_SIZE - 1)];
+	SDL_AtomicSet(&q->head, head + 1);
+	return rg;
+}
+
+static int run(void* data) {
+	struct streamer* s = data;
+	for (;;) {
+		SDL_SemWait(s->wake);
+		if (SDL_AtomicGet(&s->quit)) {
+			break;
+		}
+
+		struct region* rg = queue_pop(&s->requests);
+		if (rg == NULL) {
+			continue;
+		}
+		region_load(rg, s->path, s->index);
+		queue_push(&s->results, rg);
+
+		if (s->event != (Uint32)-1) {
+			SDL_Event e;
+			SDL_zero(e);
+			e.type = s->event;
+			SDL_PushEvent(&e);
+		}
+	}
+	return 0;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct streamer* streamer_create(const char* path, const struct region_index* index) {
+	struct streamer* s = calloc(1, sizeof(struct streamer));
+	s->path = strdup(path);
+	s->index = index;
+	s->event = SDL_RegisterEvents(1);
+
+	s->wake = SDL_CreateSemaphore(0);
+	if (s->wake == NULL) {
+		debug_print("Unable to create a semaphore: %s\n", SDL_GetError());
+		streamer_free(s);
+		return NULL;
+	}
+
+	s->thread = SDL_CreateThread(run, "streamer", s);
+	if (s->thread == NULL) {
+		debug_print("Unable to start the streamer: %s\n", SDL_GetError());
+		streamer_free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+void streamer_free(struct streamer* s) {
+	if (s == NULL) {
+		return;
+	}
+
+	if (s->thread != NULL) {
+		SDL_AtomicSet(&s->quit, 1);
+		SDL_SemPost(s->wake);
+		SDL_WaitThread(s->thread, NULL);
+	}
+
+	// The thread is gone, so both queues can be drained from here.
+	struct region* rg;
+	while ((rg = queue_pop(&s->requests)) != NULL) {
+		region_free(rg);
+	}
+	while ((rg = queue_pop(&s->results)) != NULL) {
+		region_free(rg);
+	}
+
+	if (s->wake != NULL) {
+		SDL_DestroySemaphore(s->wake);
+	}
+	free(s->path);
+	free(s);
+}
+
+bool streamer_request(struct streamer* s, int rx, int ry) {
+	if (s->pending >= STREAMER_QUEUE_SIZE) {
+		return false;
+	}
+
+	struct region* rg = calloc(1, sizeof(struct region));
+	rg->rx = rx;
+	rg->ry = ry;
+	queue_push(&s->requests, rg);
+	s->pending++;
+	SDL_SemPost(s->wake);
+	return true;
+}
+
+struct region* streamer_poll(struct streamer* s) {
+	struct region* rg = queue_pop(&s->results);
+	if (rg != NULL) {
+		s->pending--;
+	}
+	return rg;
+}
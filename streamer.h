@@ -0,0 +1,69 @@
+#ifndef STREAMER_H
+#define STREAMER_H
+
+#include "region.h"
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+// The amount of regions which can be requested at once. A power of two.
+#define STREAMER_QUEUE_SIZE 64
+
+/*
+ * A queue of regions between exactly one producing and one consuming thread.
+ * It needs no lock: only the producer moves the tail, and only the consumer
+ * moves the head.
+ */
+struct region_queue {
+	struct region* items[STREAMER_QUEUE_SIZE];
+	SDL_atomic_t head; // The next item to take.
+	SDL_atomic_t tail; // The next slot to fill.
+};
+
+/*
+ * The streamer loads regions on a background thread, so the main loop never
+ * waits for the disk. The main thread requests a region, and picks it up when
+ * it has been loaded. When the map is loaded, an event of type `event' is
+ * pushed, so a loop which waits for events wakes up to show it.
+ */
+struct streamer {
+	char* path;                        // The path of the map.
+	const struct region_index* index;  // Shared with the thread, never changed.
+
+	SDL_Thread* thread;
+	SDL_sem* wake;     // Posted for every request, and to stop the thread.
+	SDL_atomic_t quit; // Set to stop the thread.
+
+	struct region_queue requests; // From the main thread to the loader.
+	struct region_queue results;  // From the loader to the main thread.
+	int pending;                  // Requested, but not picked up yet.
+
+	Uint32 event; // (Uint32)-1 when no event type could be registered.
+};
+
+/*
+ * Starts a thread which loads the regions of the map at `path'. Returns NULL
+ * when the thread cannot be started.
+ */
+struct streamer* streamer_create(const char* path, const struct region_index* index);
+
+/*
+ * Stops the thread, and frees the regions which were not picked up.
+ */
+void streamer_free(struct streamer* s);
+
+/*
+ * Requests region (rx, ry) to be loaded. Returns false when too many regions
+ * are pending, in which case it must be requested again later.
+ */
+bool streamer_request(struct streamer* s, int rx, int ry);
+
+/*
+ * Returns a region which has been loaded, or NULL when there is none. Regions
+ * come in the order they were requested. The caller owns the region, which is
+ * empty when it could not be read.
+ */
+struct region* streamer_poll(struct streamer* s);
+
+#endif // STREAMER_H
@@ -0,0 +1,191 @@
+#include "tilebatch.h"
+#include "util.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <SDL.h>
+
+// The initial amount of quads a buffer can hold. An 800x600 view of 32x32
+// tiles needs about 500 quads per layer.
+static const int INITIAL_QUADS = 512;
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+/*
+ * Finds the buffer for the given texture and blend mode, or adds a new one.
+ */
+static struct tilebatch_buffer* find_buffer(struct tilebatch* b, SDL_Texture* texture, SDL_BlendMode blend) {
+	for (int i = 0; i < b->buffers_len; i++) {
+		if (b->buffers[i].texture == texture && b->buffers[i].blend == blend) {
+			return &b->buffers[i];
+		}
+	}
+
+	b->buffers = realloc(b->buffers, (b->buffers_len + 1) * sizeof(struct tilebatch_buffer));
+	struct tilebatch_buffer* buf = &b->buffers[b->buffers_len++];
+
+	int w = 0;
+	int h = 0;
+	SDL_QueryTexture(texture, NULL, NULL, &w, &h);
+
+	buf->texture = texture;
+	buf->blend = blend;
+	buf->tex_w = w;
+	buf->tex_h = h;
+	buf->quads = 0;
+	buf->capacity = INITIAL_QUADS;
+	buf->vertices = malloc(buf->capacity * 4 * sizeof(SDL_Vertex));
+
+	return buf;
+}
+
+/*
+ * Makes sure the shared index list can hold at least `quads' quads. Every quad
+ * consists of the two triangles (0, 1, 2) and (2, 3, 0).
+ */
+static void reserve_indices(struct tilebatch* b, int quads) {
+	if (quads <= b->indices_capacity) {
+		return;
+	}
+
+	int capacity = b->indices_capacity > 0 ? b->indices_capacity : INITIAL_QUADS;
+	while (capacity < quads) {
+		capacity *= 2;
+	}
+
+	b->indices = realloc(b->indices, capacity * 6 * sizeof(int));
+	for (int q = b->indices_capacity; q < capacity; q++) {
+		int* idx = &b->indices[q * 6];
+		idx[0] = q * 4 + 0;
+		idx[1] = q * 4 + 1;
+		idx[2] = q * 4 + 2;
+		idx[3] = q * 4 + 2;
+		idx[4] = q * 4 + 3;
+		idx[5] = q * 4 + 0;
+	}
+	b->indices_capacity = capacity;
+}
+
+/*
+ * Finds the buffer for the given texture and blend mode, with room for one
+ * more quad.
+ */
+static struct tilebatch_buffer* reserve_quad(struct tilebatch* b, SDL_Texture* texture, SDL_BlendMode blend) {
+	struct tilebatch_buffer* buf = find_buffer(b, texture, blend);
+	if (buf->quads == buf->capacity) {
+		buf->capacity *= 2;
+		buf->vertices = realloc(buf->vertices, buf->capacity * 4 * sizeof(SDL_Vertex));
+	}
+	return buf;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct tilebatch* tilebatch_create(void) {
+	struct tilebatch* b = calloc(1, sizeof(struct tilebatch));
+	reserve_indices(b, INITIAL_QUADS);
+	return b;
+}
+
+void tilebatch_free(struct tilebatch* b) {
+	for (int i = 0; i < b->buffers_len; i++) {
+		free(b->buffers[i].vertices);
+	}
+	free(b->buffers);
+	free(b->indices);
+	free(b);
+}
+
+void tilebatch_add(struct tilebatch* b, SDL_Texture* texture, const SDL_Rect* src, const SDL_FRect* dst, unsigned int orientation, Uint8 alpha, SDL_BlendMode blend) {
+	struct tilebatch_buffer* buf = reserve_quad(b, texture, blend);
+
+	// The corners of the quad in clockwise order, starting at the top-left,
+	// expressed as (s, t) in the unit square of the tile.
+	static const int corners[4][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+
+	SDL_Vertex* v = &buf->vertices[buf->quads * 4];
+	for (int i = 0; i < 4; i++) {
+		int s = corners[i][0];
+		int t = corners[i][1];
+
+		v[i].position.x = dst->x + s * dst->w;
+		v[i].position.y = dst->y + t * dst->h;
+		v[i].color = (SDL_Color){ 0xff, 0xff, 0xff, alpha };
+
+		// Tiled applies the diagonal flip first, followed by the horizontal
+		// and vertical flips. To find which texel ends up at this corner, we
+		// undo those in the reverse order.
+		int a = s;
+		int c = t;
+		if (orientation & TILE_FLIP_HORIZONTAL) {
+			a = 1 - a;
+		}
+		if (orientation & TILE_FLIP_VERTICAL) {
+			c = 1 - c;
+		}
+		if (orientation & TILE_FLIP_DIAGONAL) {
+			int tmp = a;
+			a = c;
+			c = tmp;
+		}
+
+		v[i].tex_coord.x = (src->x + a * src->w) / buf->tex_w;
+		v[i].tex_coord.y = (src->y + c * src->h) / buf->tex_h;
+	}
+
+	buf->quads++;
+}
+
+void tilebatch_add_plain(struct tilebatch* b, SDL_Texture* texture, const SDL_Rect* src, const SDL_FRect* dst, Uint8 alpha, SDL_BlendMode blend) {
+	struct tilebatch_buffer* buf = reserve_quad(b, texture, blend);
+
+	float x1 = dst->x;
+	float y1 = dst->y;
+	float x2 = dst->x + dst->w;
+	float y2 = dst->y + dst->h;
+	float u1 = src->x / buf->tex_w;
+	float v1 = src->y / buf->tex_h;
+	float u2 = (src->x + src->w) / buf->tex_w;
+	float v2 = (src->y + src->h) / buf->tex_h;
+	SDL_Color color = { 0xff, 0xff, 0xff, alpha };
+
+	// Clockwise, starting at the top-left, like tilebatch_add.
+	SDL_Vertex* v = &buf->vertices[buf->quads * 4];
+	v[0] = (SDL_Vertex){ { x1, y1 }, color, { u1, v1 } };
+	v[1] = (SDL_Vertex){ { x2, y1 }, color, { u2, v1 } };
+	v[2] = (SDL_Vertex){ { x2, y2 }, color, { u2, v2 } };
+	v[3] = (SDL_Vertex){ { x1, y2 }, color, { u1, v2 } };
+
+	buf->quads++;
+}
+
+int tilebatch_flush(struct tilebatch* b, SDL_Renderer* r) {
+	int draw_calls = 0;
+
+	for (int i = 0; i < b->buffers_len; i++) {
+		struct tilebatch_buffer* buf = &b->buffers[i];
+		if (buf->quads == 0) {
+			continue;
+		}
+
+		reserve_indices(b, buf->quads);
+
+		// The opacity is in the vertex colors, so reset whatever alpha
+		// modulation was left on the texture by other drawing code.
+		SDL_SetTextureAlphaMod(buf->texture, 0xff);
+		SDL_SetTextureBlendMode(buf->texture, buf->blend);
+		if (SDL_RenderGeometry(r, buf->texture, buf->vertices, buf->quads * 4, b->indices, buf->quads * 6) != 0) {
+			debug_print("Unable to draw tile batch: %s\n", SDL_GetError());
+		}
+
+		buf->quads = 0;
+		draw_calls++;
+	}
+
+	return draw_calls;
+}
@@ -0,0 +1,67 @@
+#ifndef TILEBATCH_H
+#define TILEBATCH_H
+
+#include <stdint.h>
+
+#include <SDL.h>
+
+/*
+ * Orientation flags of a tile. These are the TMX flip bits of a gid, shifted
+ * down to the lowest three bits (i.e. `gid >> 29').
+ */
+enum tile_orientation {
+	TILE_FLIP_DIAGONAL   = 1,
+	TILE_FLIP_VERTICAL   = 2,
+	TILE_FLIP_HORIZONTAL = 4,
+};
+
+/*
+ * The quads of a batch which use the same texture.
+ */
+struct tilebatch_buffer {
+	SDL_Texture* texture;
+	SDL_BlendMode blend;
+	float tex_w; // Texture width, to calculate texture coordinates.
+	float tex_h; // Texture height, to calculate texture coordinates.
+
+	SDL_Vertex* vertices; // Four vertices per quad.
+	int quads;            // Amount of quads in the buffer.
+	int capacity;         // Amount of quads the buffer can hold.
+};
+
+/*
+ * A tile batch collects textured quads, and draws all quads which share a
+ * texture using a single SDL_RenderGeometry call. Flips and rotations are
+ * written into the texture coordinates, and the opacity into the vertex color,
+ * so no texture state has to be changed between tiles.
+ */
+struct tilebatch {
+	struct tilebatch_buffer* buffers; // One buffer per texture and blend mode.
+	int buffers_len;
+
+	int* indices;         // Shared index list, six indices per quad.
+	int indices_capacity; // Amount of quads the index list can hold.
+};
+
+struct tilebatch* tilebatch_create(void);
+void tilebatch_free(struct tilebatch* b);
+
+/*
+ * Adds a quad to the batch, which draws the `src' rectangle of the texture
+ * at `dst', using the given tile orientation flags, alpha and blend mode.
+ */
+void tilebatch_add(struct tilebatch* b, SDL_Texture* texture, const SDL_Rect* src, const SDL_FRect* dst, unsigned int orientation, Uint8 alpha, SDL_BlendMode blend);
+
+/*
+ * Adds a quad like tilebatch_add, for a tile which is not flipped. This skips
+ * working out the texture coordinates of every corner.
+ */
+void tilebatch_add_plain(struct tilebatch* b, SDL_Texture* texture, const SDL_Rect* src, const SDL_FRect* dst, Uint8 alpha, SDL_BlendMode blend);
+
+/*
+ * Draws every quad in the batch, and empties it. Returns the amount of draw
+ * calls which were issued: one per texture and blend mode.
+ */
+int tilebatch_flush(struct tilebatch* b, SDL_Renderer* r);
+
+#endif // TILEBATCH_H
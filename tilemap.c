@@ -1,137 +1,2449 @@
+#include "alphamap.h"
+#include "animtable.h"
+#include "atlas.h"
 #include "camera.h"
+#include "chunkcache.h"
+#include "collisiongrid.h"
+#include "collisionmesh.h"
+#include "coordmap.h"
+#include "distancefield.h"
+#include "mipmap.h"
+#include "parallax.h"
+#include "region.h"
+#include "scrollview.h"
+#include "sparselayer.h"
+#include "streamer.h"
+#include "tilebatch.h"
 #include "tilemap.h"
+#include "tileshape.h"
+#include "tilestore.h"
 #include "tmx/tmx.h"
 #include "util.h"
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <SDL_image.h>
 
 static const char* LAYER_MAIN      = "Main";
 static const char* LAYER_COLLISION = "Collision";
 
-static void draw_layer(struct tilemap* tm, struct camera* cam, SDL_Renderer* r, const tmx_layer* layer) {
+// The amount of tiles to draw beyond the edges of the camera. Rotated or
+// flipped tiles may be drawn slightly outside of their own cell.
+static const int CULL_MARGIN = 1;
+
+// The padding around every tile in the atlas, in pixels.
+static const int ATLAS_PADDING = 1;
+
+// Tile layers with a lower ratio of non-empty tiles are stored as sparse layers.
+static const float SPARSE_FILL_RATIO = 0.25f;
+
+// The width and height of a chunk in the chunk cache, in tiles.
+static const int CHUNK_TILES = 16;
+
+// The default texture memory budget of the chunk cache, in bytes.
+static const size_t CHUNK_CACHE_BUDGET = 64 * 1024 * 1024;
+
+// The width and height of a region when a map is split, in chunks.
+static const int REGION_CHUNKS = 8;
+
+// Regions within this many tiles of the camera are loaded when streaming, and
+// regions beyond the larger distance are evicted. The gap between both keeps
+// regions at the edge from being loaded and evicted over and over.
+static const int STREAM_LOAD_MARGIN = 32;
+static const int STREAM_EVICT_MARGIN = 96;
+
+// How far ahead the camera is predicted from its velocity, in seconds. The
+// regions there are requested as well, so they are in when the camera is.
+static const float STREAM_LOOKAHEAD = 1.0f;
+
+// When zoomed out so far that tiles are drawn at fewer pixels than this, the
+// layers are drawn from overview chunks of OVERVIEW_CHUNK_TILES square tiles,
+// which are baked at this many pixels per tile.
+static const int OVERVIEW_TILE_PIXELS = 4;
+static const int OVERVIEW_CHUNK_TILES = 64;
+static const size_t OVERVIEW_BUDGET = 32 * 1024 * 1024;
+
+// The cell which is outlined by tilemap_draw_debug.
+static const int DEBUG_CELL_X = 5;
+static const int DEBUG_CELL_Y = 5;
+
+// How far a box stopped by the shape of a tile is put off it, in world units,
+// so rounding does not leave it inside.
+static const float SHAPE_HAIR = 0.005f;
+
+// The least distance field value of a tile from which a ray skips the free
+// tiles around it, instead of walking them one by one.
+static const int RAY_SKIP_DISTANCE = 3;
+
+// The most solid rectangles outlined in the debug view.
+#define DEBUG_RECTS 256
+
+// Edited cells are kept track of in blocks of this many cells square, with a
+// word of bits per row.
+#define EDIT_BLOCK 32
+
+/*
+ * Calculates the range of tiles visible in a view of w x h pixels, of which
+ * the top-left corner is at (x, y) in the map.
+ */
+static bool visible_range_at(const struct tilemap* tm, float x, float y, int w, int h, struct tilerange* range) {
+	if (tm->tilewidth <= 0 || tm->tileheight <= 0) {
+		return false;
+	}
+
+	range->x1 = floorf(x / tm->tilewidth) - CULL_MARGIN;
+	range->y1 = floorf(y / tm->tileheight) - CULL_MARGIN;
+	range->x2 = floorf((x + w) / tm->tilewidth) + CULL_MARGIN;
+	range->y2 = floorf((y + h) / tm->tileheight) + CULL_MARGIN;
+
+	// Clamp the range to the map bounds.
+	range->x1 = range->x1 < 0 ? 0 : range->x1;
+	range->y1 = range->y1 < 0 ? 0 : range->y1;
+	range->x2 = range->x2 >= (int)tm->map->width  ? (int)tm->map->width  - 1 : range->x2;
+	range->y2 = range->y2 >= (int)tm->map->height ? (int)tm->map->height - 1 : range->y2;
+
+	return range->x1 <= range->x2 && range->y1 <= range->y2;
+}
+
+/*
+ * Decodes the TMX flip bits of a tile (as tile_orientation flags) to the
+ * rotation and flip to pass to SDL_RenderCopyEx.
+ */
+static void decode_orientation(unsigned int orientation, double* rotate, SDL_RendererFlip* flip) {
+	bool flipped_horizontally = orientation & TILE_FLIP_HORIZONTAL;
+	bool flipped_vertically   = orientation & TILE_FLIP_VERTICAL;
+	bool flipped_diagonally   = orientation & TILE_FLIP_DIAGONAL;
+
+	*rotate = 0;
+	*flip = SDL_FLIP_NONE;
+
+	// A diagonal flip is a swap of the x and y axes, which is the same as a
+	// rotation of 90 degrees combined with a flip.
+	if (flipped_diagonally) {
+		if (flipped_horizontally && flipped_vertically) {
+			*rotate = 90;
+			*flip |= SDL_FLIP_HORIZONTAL;
+		} else if (flipped_horizontally) {
+			*rotate = 90;
+		} else if (flipped_vertically) {
+			*rotate = -90;
+		} else {
+			*rotate = 90;
+			*flip |= SDL_FLIP_VERTICAL;
+		}
+	} else {
+		if (flipped_horizontally) {
+			*flip |= SDL_FLIP_HORIZONTAL;
+		}
+		if (flipped_vertically) {
+			*flip |= SDL_FLIP_VERTICAL;
+		}
+	}
+}
+
+/*
+ * Finds the size of the chunks of an infinite map, and the area they span in
+ * tiles, from (x1, y1) up to (x2, y2). Every chunk must have the same size and
+ * lie on a grid of that size, as Tiled writes them. Returns false when one
+ * does not.
+ */
+static bool find_chunk_bounds(tmx_layer* head, int* chunk_w, int* chunk_h, int* x1, int* y1, int* x2, int* y2) {
+	for (tmx_layer* layer = head; layer != NULL; layer = layer->next) {
+		if (layer->type == L_GROUP) {
+			if (!find_chunk_bounds(layer->content.group_head, chunk_w, chunk_h, x1, y1, x2, y2)) {
+				return false;
+			}
+			continue;
+		}
+		if (layer->type != L_LAYER) {
+			continue;
+		}
+
+		for (const tmx_chunk* c = layer->chunk_head; c != NULL; c = c->next) {
+			if (*chunk_w == 0) {
+				*chunk_w = c->width;
+				*chunk_h = c->height;
+			}
+			if ((int)c->width != *chunk_w || (int)c->height != *chunk_h || c->x % *chunk_w != 0 || c->y % *chunk_h != 0) {
+				fprintf(stderr, "Layer '%s' has a chunk of %u x %u at %d, %d, which is not on the %d x %d grid\n",
+					layer->name, c->width, c->height, c->x, c->y, *chunk_w, *chunk_h);
+				return false;
+			}
+
+			*x1 = c->x < *x1 ? c->x : *x1;
+			*y1 = c->y < *y1 ? c->y : *y1;
+			*x2 = c->x + *chunk_w > *x2 ? c->x + *chunk_w : *x2;
+			*y2 = c->y + *chunk_h > *y2 ? c->y + *chunk_h : *y2;
+		}
+	}
+	return true;
+}
+
+/*
+ * Creates a tile store for every tile layer of an infinite map, which is kept
+ * in the user data of the layer. Returns false when a store could not be
+ * allocated.
+ */
+static bool create_tile_stores(struct tilemap* tm, tmx_layer* head, int chunk_w, int chunk_h) {
+	for (tmx_layer* layer = head; layer != NULL; layer = layer->next) {
+		if (layer->type == L_GROUP) {
+			if (!create_tile_stores(tm, layer->content.group_head, chunk_w, chunk_h)) {
+				return false;
+			}
+		} else if (layer->type == L_LAYER) {
+			layer->user_data.pointer = tilestore_create(layer, chunk_w, chunk_h, tm->origin_x, tm->origin_y);
+			if (layer->user_data.pointer == NULL) {
+				fprintf(stderr, "Unable to allocate the tile store of layer '%s'\n", layer->name);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void free_tile_stores(tmx_layer* head) {
+	for (tmx_layer* layer = head; layer != NULL; layer = layer->next) {
+		if (layer->type == L_GROUP) {
+			free_tile_stores(layer->content.group_head);
+		} else if (layer->type == L_LAYER && layer->user_data.pointer != NULL) {
+			tilestore_free(layer->user_data.pointer);
+			layer->user_data.pointer = NULL;
+		}
+	}
+}
+
+/*
+ * Prepares the chunks of an infinite map. The map is resized to the area its
+ * chunks span, of which the top-left becomes tile (0, 0), so the rest of the
+ * tilemap does not have to deal with negative coordinates.
+ */
+static bool build_tile_stores(struct tilemap* tm) {
+	int chunk_w = 0;
+	int chunk_h = 0;
+	int x1 = INT_MAX;
+	int y1 = INT_MAX;
+	int x2 = INT_MIN;
+	int y2 = INT_MIN;
+	if (!find_chunk_bounds(tm->map->ly_head, &chunk_w, &chunk_h, &x1, &y1, &x2, &y2)) {
+		return false;
+	}
+
+	if (chunk_w == 0) {
+		// Not a single tile, so make up a chunk to have any size at all.
+		chunk_w = CHUNK_TILES;
+		chunk_h = CHUNK_TILES;
+		x1 = 0;
+		y1 = 0;
+		x2 = chunk_w;
+		y2 = chunk_h;
+	}
+
+	tm->origin_x = x1;
+	tm->origin_y = y1;
+	tm->map->width = x2 - x1;
+	tm->map->height = y2 - y1;
+	if (!create_tile_stores(tm, tm->map->ly_head, chunk_w, chunk_h)) {
+		return false;
+	}
+
+	debug_print("Infinite map spans %d x %d tiles from %d, %d, in chunks of %d x %d\n",
+		tm->map->width, tm->map->height, x1, y1, chunk_w, chunk_h);
+	return true;
+}
+
+/*
+ * Returns the gid at tile (x, y) of a tile layer, which must be within the map.
+ */
+static inline uint32_t layer_gid(const struct tilemap* tm, const tmx_layer* layer, int x, int y) {
+	if (tm->map->infinite) {
+		return tilestore_get(layer->user_data.pointer, x, y);
+	}
+	return layer->content.gids[(size_t)y * tm->map->width + x];
+}
+
+/*
+ * Builds the render table from the gid indexed tile array of the map, with an
+ * entry for every gid and flip combination. This way drawing a tile does not
+ * need to decode the flip bits, or to look up the tileset and its texture.
+ */
+static void build_render_table(struct tilemap* tm) {
+	tmx_map* map = tm->map;
+
+	tm->render_table_len = map->tilecount << 3;
+	tm->render_table = calloc(tm->render_table_len, sizeof(struct tile_render));
+
+	for (uint32_t gid = 0; gid < map->tilecount; gid++) {
+		const tmx_tile* tile = map->tiles[gid];
+		if (tile == NULL) {
+			continue;
+		}
+
+		SDL_Texture* texture = NULL;
+		SDL_Rect src = { 0, 0, 0, 0 };
+		if (tile->image != NULL) {
+			// Tiles from an image collection have an image of their own,
+			// which starts at the top-left unless it was packed in an atlas.
+			texture = tile->image->resource_image;
+			src.x = tile->ul_x;
+			src.y = tile->ul_y;
+			src.w = tile->image->width;
+			src.h = tile->image->height;
+		} else if (tile->tileset->image != NULL) {
+			texture = tile->tileset->image->resource_image;
+			src.x = tile->ul_x;
+			src.y = tile->ul_y;
+			src.w = tile->tileset->tile_width;
+			src.h = tile->tileset->tile_height;
+		}
+
+		// Tiles which are fully transparent are never drawn, and fully opaque
+		// ones can be drawn without blending.
+		enum alpha_class alpha = ALPHA_TRANSLUCENT;
+		const struct alphamap* am = alphamap_find(texture);
+		if (am != NULL) {
+			alpha = alphamap_classify(am, &src);
+		}
+
+		for (unsigned int orientation = 0; orientation < 8; orientation++) {
+			struct tile_render* tr = &tm->render_table[(gid << 3) | orientation];
+			tr->texture = alpha == ALPHA_EMPTY ? NULL : texture;
+			tr->alpha = alpha;
+			tr->src = src;
+			tr->orientation = orientation;
+			tr->tile = gid;
+			decode_orientation(orientation, &tr->rotate, &tr->flip);
+		}
+	}
+}
+
+/*
+ * Finds the animated tiles of the map, and marks their entries in the render
+ * table.
+ */
+static void build_animations(struct tilemap* tm) {
+	tm->anims = animtable_create(tm->map);
+	if (tm->anims == NULL) {
+		return;
+	}
+
+	tm->render_frames = malloc(tm->render_table_len * sizeof(struct tile_render));
+	memcpy(tm->render_frames, tm->render_table, tm->render_table_len * sizeof(struct tile_render));
+
+	for (int i = 0; i < tm->anims->len; i++) {
+		for (uint32_t orientation = 0; orientation < 8; orientation++) {
+			tm->render_table[(tm->anims->tiles[i].gid << 3) | orientation].animated = true;
+		}
+	}
+}
+
+/*
+ * Sets entry `idx' of the render table of a mip level from the same entry in
+ * the render table.
+ */
+static void update_mip_entry(struct tilemap* tm, int level, uint32_t idx) {
+	struct tile_render* tr = &tm->mip_tables[level - 1][idx];
+	*tr = tm->render_table[idx];
+	if (tr->texture != NULL) {
+		tr->texture = tm->mipmap->pages[level - 1];
+		tr->src = *mipmap_rect(tm->mipmap, tr->tile, level);
+	}
+}
+
+/*
+ * Makes the mip levels of every tile, and the render tables which use them.
+ */
+static void build_mipmap(struct tilemap* tm, SDL_Renderer* r) {
+	uint32_t len = tm->map->tilecount;
+	SDL_Texture** textures = malloc(len * sizeof(SDL_Texture*));
+	SDL_Rect* rects = malloc(len * sizeof(SDL_Rect));
+	for (uint32_t gid = 0; gid < len; gid++) {
+		textures[gid] = tm->render_table[gid << 3].texture;
+		rects[gid] = tm->render_table[gid << 3].src;
+	}
+	tm->mipmap = mipmap_create(r, textures, rects, len);
+	free(textures);
+	free(rects);
+
+	if (tm->mipmap == NULL) {
+		return;
+	}
+	for (int level = 1; level <= tm->mipmap->levels; level++) {
+		tm->mip_tables[level - 1] = malloc(tm->render_table_len * sizeof(struct tile_render));
+		for (uint32_t i = 0; i < tm->render_table_len; i++) {
+			update_mip_entry(tm, level, i);
+		}
+	}
+}
+
+/*
+ * Draws the tiles from the mip level which fits tiles drawn at the given size
+ * in pixels: the smallest one which still has at least that many pixels.
+ */
+static void select_mip_level(struct tilemap* tm, float pixels_w, float pixels_h) {
+	int level = 0;
+	if (tm->mipmap != NULL) {
+		while (level < tm->mipmap->levels
+			&& (tm->map->tile_width >> (level + 1)) >= pixels_w
+			&& (tm->map->tile_height >> (level + 1)) >= pixels_h) {
+			level++;
+		}
+	}
+	tm->draw_table = level > 0 ? tm->mip_tables[level - 1] : tm->render_table;
+	tm->stats.mip_level = level;
+}
+
+/*
+ * Lists the cells of a chunk of a layer which hold an animated tile.
+ */
+static void index_animated_chunk(struct tilemap* tm, int layer, const struct tilestore* ts, const struct tilestore_chunk* c) {
+	for (int j = 0; j < ts->chunk_w * ts->chunk_h; j++) {
+		struct anim_tile* t = animtable_find(tm->anims, c->chunk->gids[j]);
+		if (t != NULL) {
+			int x = c->cx * ts->chunk_w + j % ts->chunk_w;
+			int y = c->cy * ts->chunk_h + j / ts->chunk_w;
+			animtable_add_cell(t, layer, (size_t)y * tm->map->width + x);
+		}
+	}
+}
+
+/*
+ * Forgets the animated cells of a chunk of a layer, before it is removed.
+ */
+static void unindex_animated_chunk(struct tilemap* tm, int layer, const struct tilestore* ts, const struct tilestore_chunk* c) {
+	for (int j = 0; j < ts->chunk_w * ts->chunk_h; j++) {
+		struct anim_tile* t = animtable_find(tm->anims, c->chunk->gids[j]);
+		if (t != NULL) {
+			int x = c->cx * ts->chunk_w + j % ts->chunk_w;
+			int y = c->cy * ts->chunk_h + j / ts->chunk_w;
+			animtable_remove_cell(t, layer, (size_t)y * tm->map->width + x);
+		}
+	}
+}
+
+static void index_animated_chunks(struct tilemap* tm, int layer, const struct tilestore* ts) {
+	for (uint32_t s = 0; s < ts->chunks->capacity; s++) {
+		const struct tilestore_chunk* c = ts->chunks->slots[s].value;
+		if (c != NULL) {
+			index_animated_chunk(tm, layer, ts, c);
+		}
+	}
+}
+
+/*
+ * Lists the cells of every tile layer which hold an animated tile, so only
+ * those have to be drawn again when a frame changes.
+ */
+static void index_animated_cells(struct tilemap* tm) {
+	if (tm->anims == NULL) {
+		return;
+	}
+
+	size_t cells = (size_t)tm->map->width * tm->map->height;
+	for (int i = 0; i < tm->plan.len; i++) {
+		const struct plan_layer* pl = &tm->plan.layers[i];
+		if (pl->content != PLAN_TILES) {
+			continue;
+		}
+		if (pl->store != NULL) {
+			index_animated_chunks(tm, i, pl->store);
+			continue;
+		}
+		for (size_t idx = 0; idx < cells; idx++) {
+			struct anim_tile* t = animtable_find(tm->anims, pl->gids[idx]);
+			if (t != NULL) {
+				animtable_add_cell(t, i, idx);
+			}
+		}
+	}
+}
+
+/*
+ * Checks every gid in the tile layer against the render table. Gids which do
+ * not refer to a tile are cleared, so drawing never has to check them.
+ */
+static void validate_layer_gids(struct tilemap* tm, tmx_layer* layer) {
 	tmx_map* map = tm->map;
-	tmx_tileset* tileset = NULL;
-
-	SDL_Texture* tileset_texture = NULL;
-	SDL_Rect src_rect; // source rectangle for the texture
-	SDL_Rect dst_rect; // target rectangle, where the place the src_rect.
-
-
-	uint8_t opacity = layer->opacity * 255;
-	uintmax_t gid;
-	for (uintmax_t i = 0; i < map->height; i++) {
-		for (uintmax_t j = 0; j < map->width; j++) {
-			SDL_RendererFlip flip = SDL_FLIP_NONE;
-			double rotate = 0;
-
-			int idx = i * map->width + j;
-			gid = layer->content.gids[idx];
-
-			bool flipped_horizontally = (gid & TMX_FLIPPED_HORIZONTALLY);
-			bool flipped_vertically   = (gid & TMX_FLIPPED_VERTICALLY);
-			bool flipped_diagonally   = (gid & TMX_FLIPPED_DIAGONALLY);
-
-			// XXX: what a clusterfuck this is. What am I missing here?
-			// This part just screams "I don't get these flags" and begs
-			// for a bit of refactoring.
-			if (flipped_diagonally) {
-				if (flipped_horizontally && flipped_vertically) {
-					rotate = 90;
-					flip |= SDL_FLIP_HORIZONTAL;
-				} else if (flipped_horizontally) {
-					rotate = 90;
-				} else if (flipped_vertically) {
-					rotate = -90;
-				} else {
-					rotate = 90;
-					flip |= SDL_FLIP_VERTICAL;
+	if (map->infinite) {
+		for (tmx_chunk* c = layer->chunk_head; c != NULL; c = c->next) {
+			for (uint32_t i = 0; i < c->width * c->height; i++) {
+				uint32_t gid = c->gids[i];
+				if (tile_render_index(gid) >= tm->render_table_len) {
+					fprintf(stderr, "Layer '%s' has an invalid gid %u at %d, %d\n",
+						layer->name, gid & TMX_FLIP_BITS_REMOVAL, c->x + (int)(i % c->width), c->y + (int)(i / c->width));
+					c->gids[i] = 0;
 				}
-			} else {
-				if (flipped_horizontally) {
-					flip |= SDL_FLIP_HORIZONTAL;
+			}
+		}
+		return;
+	}
+
+	for (uint32_t i = 0; i < map->width * map->height; i++) {
+		uint32_t gid = layer->content.gids[i];
+		if (tile_render_index(gid) >= tm->render_table_len) {
+			fprintf(stderr, "Layer '%s' has an invalid gid %u at %u, %u\n",
+				layer->name, gid & TMX_FLIP_BITS_REMOVAL, i % map->width, i / map->width);
+			layer->content.gids[i] = 0;
+		}
+	}
+}
+
+/*
+ * Returns the transform a tile needs, from the flip bits of its gid.
+ */
+static inline enum plan_transform gid_transform(uint32_t gid) {
+	if (gid & TMX_FLIPPED_DIAGONALLY) {
+		return TRANSFORM_FULL;
+	}
+	return gid & (TMX_FLIPPED_HORIZONTALLY | TMX_FLIPPED_VERTICALLY) ? TRANSFORM_FLIP : TRANSFORM_NONE;
+}
+
+/*
+ * Returns the transform the most transformed of the gids needs.
+ */
+static enum plan_transform gids_transform(const uint32_t* gids, size_t len) {
+	uint32_t flips = 0;
+	for (size_t i = 0; i < len; i++) {
+		flips |= gids[i];
+	}
+	return gid_transform(flips);
+}
+
+/*
+ * Works out the transform of a tile layer, by scanning all of its tiles.
+ */
+static enum plan_transform layer_transform(const struct tilemap* tm, const struct plan_layer* pl) {
+	if (pl->store == NULL) {
+		return gids_transform(pl->gids, tm->map->width * tm->map->height);
+	}
+
+	const struct tilestore* ts = pl->store;
+	enum plan_transform transform = TRANSFORM_NONE;
+	for (uint32_t s = 0; s < ts->chunks->capacity; s++) {
+		const struct tilestore_chunk* c = ts->chunks->slots[s].value;
+		if (c != NULL) {
+			transform = SDL_max(transform, gids_transform((const uint32_t*)c->chunk->gids, ts->chunk_w * ts->chunk_h));
+		}
+	}
+	return transform;
+}
+
+/*
+ * Adds a layer to the end of the draw plan.
+ */
+static struct plan_layer* plan_append(struct drawplan* plan, const tmx_layer* layer, enum plan_content content, double opacity, int offsetx, int offsety) {
+	plan->layers = realloc(plan->layers, (plan->len + 1) * sizeof(struct plan_layer));
+	struct plan_layer* pl = &plan->layers[plan->len];
+
+	pl->content = content;
+	pl->layer = layer;
+	pl->index = plan->len;
+	pl->opacity = opacity * 255;
+	pl->offsetx = offsetx;
+	pl->offsety = offsety;
+	pl->gids = NULL;
+	pl->sparse = NULL;
+	pl->store = NULL;
+	pl->transform = TRANSFORM_NONE;
+	pl->occluded = NULL;
+	pl->image.texture = NULL;
+
+	plan->len++;
+	return pl;
+}
+
+/*
+ * Walks the list of layers starting at `head', and adds the ones to draw to
+ * the draw plan. Groups are flattened, passing along their opacity, offsets
+ * and whether they are hidden to the layers in them. Hidden layers are still
+ * walked, since the collision layer may be one of them.
+ */
+static void plan_add_layers(struct tilemap* tm, tmx_layer* head, double opacity, int offsetx, int offsety, bool hidden) {
+	struct drawplan* plan = &tm->plan;
+
+	for (tmx_layer* layer = head; layer != NULL; layer = layer->next) {
+		double layer_opacity = opacity * layer->opacity;
+		int layer_offsetx = offsetx + layer->offsetx;
+		int layer_offsety = offsety + layer->offsety;
+		bool layer_hidden = hidden || !layer->visible || layer_opacity <= 0.0;
+
+		if (layer->type == L_LAYER) {
+			validate_layer_gids(tm, layer);
+
+			if (strcmp(LAYER_COLLISION, layer->name) == 0) {
+				// Never draw the collision layer, that would be stupid.
+				if (plan->collision == NULL) {
+					plan->collision = layer;
+				}
+				continue;
+			}
+		}
+
+		if (strcmp(LAYER_MAIN, layer->name) == 0 && plan->foreground < 0) {
+			// The foreground is the 'Main' layer, and all layers after it.
+			plan->foreground = plan->len;
+		}
+
+		switch (layer->type) {
+		case L_LAYER:
+			if (!layer_hidden) {
+				struct plan_layer* pl = plan_append(plan, layer, PLAN_TILES, layer_opacity, layer_offsetx, layer_offsety);
+				if (tm->map->infinite) {
+					// Empty regions of infinite maps have no chunks, so
+					// those are sparse already.
+					pl->store = layer->user_data.pointer;
+					pl->transform = layer_transform(tm, pl);
+					break;
+				}
+				pl->gids = (const uint32_t*)layer->content.gids;
+				pl->transform = layer_transform(tm, pl);
+
+				// Mostly empty layers are cheaper to draw from a list of
+				// their tiles, than by checking every cell.
+				float fill = sparselayer_fill_ratio(pl->gids, tm->map->width, tm->map->height);
+				if (fill < SPARSE_FILL_RATIO) {
+					debug_print("Layer '%s' is sparse (%.0f%% filled)\n", layer->name, fill * 100);
+					pl->sparse = sparselayer_create(pl->gids, tm->map->width, tm->map->height);
+				}
+			}
+			break;
+		case L_IMAGE:
+			if (!layer_hidden && layer->content.image != NULL && layer->content.image->resource_image != NULL) {
+				if (parallax_has_properties(layer)) {
+					// These scroll at a speed of their own, so they are
+					// drawn apart from the map.
+					parallax_add(tm->parallax, layer, layer_opacity, layer_offsetx, layer_offsety, plan->foreground >= 0);
+					break;
 				}
-				if (flipped_vertically) {
-					flip |= SDL_FLIP_VERTICAL;
+				struct plan_layer* pl = plan_append(plan, layer, PLAN_IMAGE, layer_opacity, layer_offsetx, layer_offsety);
+				pl->image.texture = layer->content.image->resource_image;
+				pl->image.w = layer->content.image->width;
+				pl->image.h = layer->content.image->height;
+				if (pl->image.w == 0 || pl->image.h == 0) {
+					// The size of an image layer is optional in the TMX.
+					SDL_QueryTexture(pl->image.texture, NULL, NULL, &pl->image.w, &pl->image.h);
 				}
 			}
+			break;
+		case L_GROUP:
+			plan_add_layers(tm, layer->content.group_head, layer_opacity, layer_offsetx, layer_offsety, layer_hidden);
+			break;
+		default:
+			// Object groups are not drawn.
+			break;
+		}
+	}
+}
+
+static inline bool bit_get(const uint32_t* bits, size_t idx) {
+	return (bits[idx >> 5] >> (idx & 31)) & 1;
+}
+
+static inline void bit_set(uint32_t* bits, size_t idx) {
+	bits[idx >> 5] |= 1u << (idx & 31);
+}
+
+static inline void bit_clear(uint32_t* bits, size_t idx) {
+	bits[idx >> 5] &= ~(1u << (idx & 31));
+}
+
+static size_t cell_bits_size(const struct tilemap* tm) {
+	size_t cells = (size_t)tm->map->width * tm->map->height;
+	return ((cells + 31) / 32) * sizeof(uint32_t);
+}
+
+/*
+ * Whether the layer can cover, or be covered by, other layers. Only tile layers
+ * without an offset line up with each other.
+ */
+static bool plan_layer_aligned(const struct plan_layer* pl) {
+	return pl->content == PLAN_TILES && pl->offsetx == 0 && pl->offsety == 0;
+}
+
+/*
+ * Returns the gid at cell `idx' of a tile layer in the draw plan.
+ */
+static inline uint32_t plan_gid(const struct tilemap* tm, const struct plan_layer* pl, size_t idx) {
+	if (pl->store != NULL) {
+		return tilestore_get(pl->store, idx % tm->map->width, idx / tm->map->width);
+	}
+	return pl->gids[idx];
+}
+
+/*
+ * Finds the chunk of a store which holds cell `idx', and the index of the cell
+ * within the chunk.
+ */
+static struct tilestore_chunk* find_store_cell(const struct tilemap* tm, const struct tilestore* ts, size_t idx, size_t* cell) {
+	int x = idx % tm->map->width;
+	int y = idx / tm->map->width;
+	*cell = (y % ts->chunk_h) * ts->chunk_w + (x % ts->chunk_w);
+	return tilestore_find(ts, x / ts->chunk_w, y / ts->chunk_h);
+}
+
+/*
+ * Whether cell `idx' of the layer is covered by the layers drawn after it.
+ */
+static bool is_occluded(const struct tilemap* tm, const struct plan_layer* pl, size_t idx) {
+	if (pl->store != NULL) {
+		size_t cell;
+		const struct tilestore_chunk* c = find_store_cell(tm, pl->store, idx, &cell);
+		return c != NULL && c->occluded != NULL && bit_get(c->occluded, cell);
+	}
+	return pl->occluded != NULL && bit_get(pl->occluded, idx);
+}
+
+/*
+ * Marks cell `idx' of the layer as covered or not. Cells of a store outside of
+ * its chunks have no tile to cover, so there is nothing to mark.
+ */
+static void set_occluded(const struct tilemap* tm, struct plan_layer* pl, size_t idx, bool occluded) {
+	uint32_t** bits = &pl->occluded;
+	size_t size = cell_bits_size(tm);
+	size_t cell = idx;
+	if (pl->store != NULL) {
+		struct tilestore_chunk* c = find_store_cell(tm, pl->store, idx, &cell);
+		if (c == NULL) {
+			return;
+		}
+		bits = &c->occluded;
+		size = ((pl->store->chunk_w * pl->store->chunk_h + 31) / 32) * sizeof(uint32_t);
+	}
+
+	if (*bits == NULL) {
+		if (!occluded) {
+			return;
+		}
+		*bits = calloc(1, size);
+	}
+	if (occluded) {
+		bit_set(*bits, cell);
+	} else {
+		bit_clear(*bits, cell);
+	}
+}
+
+/*
+ * Whether the tile at cell `idx' of the layer completely covers the cells of
+ * the layers below it. Tiles in translucent layers never cover anything.
+ */
+static bool covers_cell(const struct tilemap* tm, const struct plan_layer* pl, size_t idx) {
+	if (pl->opacity != 0xff) {
+		return false;
+	}
+
+	// Animated tiles may not be opaque in every frame.
+	const struct tile_render* tr = &tm->render_table[tile_render_index(plan_gid(tm, pl, idx))];
+	return tr->alpha == ALPHA_OPAQUE && !(tr->orientation & TILE_FLIP_DIAGONAL) && !tr->animated;
+}
+
+/*
+ * Finds the covered cells of a chunk of plan layer `layer'. Only the cells with
+ * a tile are visited.
+ */
+static void occlude_chunk(struct tilemap* tm, int layer, const struct tilestore_chunk* c) {
+	struct drawplan* plan = &tm->plan;
+	struct plan_layer* pl = &plan->layers[layer];
+	const struct tilestore* ts = pl->store;
+
+	for (int j = 0; j < ts->chunk_w * ts->chunk_h; j++) {
+		if (c->chunk->gids[j] == 0) {
+			continue;
+		}
+		int x = c->cx * ts->chunk_w + j % ts->chunk_w;
+		int y = c->cy * ts->chunk_h + j / ts->chunk_w;
+		size_t idx = (size_t)y * tm->map->width + x;
+		for (int k = layer + 1; k < plan->len; k++) {
+			if (plan_layer_aligned(&plan->layers[k]) && covers_cell(tm, &plan->layers[k], idx)) {
+				set_occluded(tm, pl, idx, true);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Finds the covered cells of the layers of an infinite map. Only the chunks
+ * are visited, so the cost does not depend on the area of the map.
+ */
+static void build_chunk_occlusion(struct tilemap* tm) {
+	struct drawplan* plan = &tm->plan;
+	for (int i = 0; i < plan->len; i++) {
+		if (!plan_layer_aligned(&plan->layers[i])) {
+			continue;
+		}
+
+		const struct tilestore* ts = plan->layers[i].store;
+		for (uint32_t s = 0; s < ts->chunks->capacity; s++) {
+			const struct tilestore_chunk* c = ts->chunks->slots[s].value;
+			if (c != NULL) {
+				occlude_chunk(tm, i, c);
+			}
+		}
+	}
+}
+
+/*
+ * Finds the cells of every tile layer which are completely covered by an
+ * opaque tile in a layer drawn after it. Only layers without an offset are
+ * considered, since only those line up with each other. Rotated tiles are not
+ * counted as covering their cell, since SDL_RenderCopyEx rotates non-square
+ * tiles around their center.
+ */
+static void build_occlusion(struct tilemap* tm) {
+	struct drawplan* plan = &tm->plan;
+	if (tm->map->infinite) {
+		build_chunk_occlusion(tm);
+		return;
+	}
+
+	size_t cells = (size_t)tm->map->width * tm->map->height;
+	size_t size = cell_bits_size(tm);
+
+	// The cells covered by the layers visited so far, walking top to bottom.
+	uint32_t* covered = calloc(1, size);
+	bool any_covered = false;
+
+	for (int i = plan->len - 1; i >= 0; i--) {
+		struct plan_layer* pl = &plan->layers[i];
+		if (!plan_layer_aligned(pl)) {
+			continue;
+		}
+
+		if (any_covered) {
+			pl->occluded = malloc(size);
+			memcpy(pl->occluded, covered, size);
+		}
+
+		for (size_t idx = 0; idx < cells; idx++) {
+			if (covers_cell(tm, pl, idx)) {
+				bit_set(covered, idx);
+				any_covered = true;
+			}
+		}
+	}
+
+	free(covered);
+}
+
+/*
+ * Works out again which layers are covered at cell `idx', after it has been
+ * edited. Chunks which were baked with the old state are marked out of date.
+ */
+static void update_occlusion(struct tilemap* tm, size_t idx) {
+	struct drawplan* plan = &tm->plan;
+	int x = idx % tm->map->width;
+	int y = idx / tm->map->width;
+
+	bool covered = false;
+	for (int i = plan->len - 1; i >= 0; i--) {
+		struct plan_layer* pl = &plan->layers[i];
+		if (!plan_layer_aligned(pl)) {
+			continue;
+		}
+
+		bool was_covered = is_occluded(tm, pl, idx);
+		if (covered != was_covered) {
+			set_occluded(tm, pl, idx, covered);
+
+			if (tm->chunks != NULL) {
+				int n = tm->chunks->chunk_tiles;
+				chunkcache_dirty(tm->chunks, i, x / n, y / n);
+			}
+		}
+
+		covered = covered || covers_cell(tm, pl, idx);
+	}
+}
+
+/*
+ * Returns the largest offset of the layers, in pixels.
+ */
+static void scroll_margin(const struct tilemap* tm, float* margin_x, float* margin_y) {
+	*margin_x = 0;
+	*margin_y = 0;
+	for (int i = 0; i < tm->plan.len; i++) {
+		const struct plan_layer* pl = &tm->plan.layers[i];
+		*margin_x = fmaxf(*margin_x, fabsf(pl->offsetx * tm->tilewidth / tm->map->tile_width));
+		*margin_y = fmaxf(*margin_y, fabsf(pl->offsety * tm->tileheight / tm->map->tile_height));
+	}
+}
+
+/*
+ * Redraws the part of the scroll views around an edited cell. Layers may be
+ * drawn with an offset, so the largest one is taken into account.
+ */
+static void update_scroll_views(struct tilemap* tm, size_t idx) {
+	if (tm->scroll_background == NULL) {
+		return;
+	}
+
+	float margin_x;
+	float margin_y;
+	scroll_margin(tm, &margin_x, &margin_y);
+	SDL_Rect area = {
+		floorf((idx % tm->map->width) * tm->tilewidth - margin_x) - 1,
+		floorf((idx / tm->map->width) * tm->tileheight - margin_y) - 1,
+		ceilf(tm->tilewidth + 2 * margin_x) + 2,
+		ceilf(tm->tileheight + 2 * margin_y) + 2,
+	};
+	scrollview_dirty(tm->scroll_background, &area);
+	scrollview_dirty(tm->scroll_foreground, &area);
+}
+
+/*
+ * Marks the cell at (x, y) as edited, so tilemap_apply_edits brings what
+ * depends on it up to date. There is a bit per cell, in blocks which only
+ * exist where a cell was edited, so the edits of a huge map take no more
+ * memory than those of a small one.
+ */
+static void mark_edited(struct tilemap* tm, int x, int y) {
+	if (tm->edited == NULL) {
+		tm->edited = coordmap_create();
+	}
+
+	uint32_t* rows = coordmap_get(tm->edited, x / EDIT_BLOCK, y / EDIT_BLOCK);
+	if (rows == NULL) {
+		rows = calloc(EDIT_BLOCK, sizeof(uint32_t));
+		if (rows == NULL || !coordmap_put(tm->edited, x / EDIT_BLOCK, y / EDIT_BLOCK, rows)) {
+			debug_print("Unable to keep track of the edit of (%d, %d)\n", x, y);
+			free(rows);
+			return;
+		}
+	}
+	rows[y % EDIT_BLOCK] |= 1u << (x % EDIT_BLOCK);
+}
+
+/*
+ * Lists the tile layers of the map, depth first. Region files refer to the
+ * layers by their index in this list.
+ */
+static void collect_tile_layers(tmx_layer* head, tmx_layer*** layers, int* len) {
+	for (tmx_layer* layer = head; layer != NULL; layer = layer->next) {
+		if (layer->type == L_GROUP) {
+			collect_tile_layers(layer->content.group_head, layers, len);
+		} else if (layer->type == L_LAYER) {
+			*layers = realloc(*layers, (*len + 1) * sizeof(tmx_layer*));
+			(*layers)[(*len)++] = layer;
+		}
+	}
+}
+
+/*
+ * Returns the index of a layer in the draw plan, or -1 when it is not drawn.
+ */
+static int plan_index_of(const struct tilemap* tm, const tmx_layer* layer) {
+	for (int i = 0; i < tm->plan.len; i++) {
+		if (tm->plan.layers[i].layer == layer) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Prepares streaming the infinite map at `path', of which the chunks were not
+ * loaded. The size of the map is taken from its region index, and its layers
+ * get empty stores for the chunks of the regions to come.
+ */
+static bool open_stream(struct tilemap* tm, const char* path) {
+	struct region_index* ri = region_index_load(path);
+	if (ri == NULL) {
+		return false;
+	}
+
+	struct tilemap_stream* st = calloc(1, sizeof(struct tilemap_stream));
+	st->path = strdup(path);
+	st->index = ri;
+	tm->stream = st;
+
+	collect_tile_layers(tm->map->ly_head, &st->layers, &st->layers_len);
+	bool match = st->layers_len == ri->layers_len;
+	for (int i = 0; match && i < st->layers_len; i++) {
+		match = strcmp(st->layers[i]->name, ri->layers[i]) == 0;
+	}
+	if (!match) {
+		fprintf(stderr, "The regions of %s were split from other layers\n", path);
+		return false;
+	}
+
+	tm->origin_x = ri->origin_x;
+	tm->origin_y = ri->origin_y;
+	tm->map->width = ri->width;
+	tm->map->height = ri->height;
+	if (!create_tile_stores(tm, tm->map->ly_head, ri->chunk_w, ri->chunk_h)) {
+		return false;
+	}
+	for (int i = 0; i < st->layers_len; i++) {
+		struct tilestore* ts = st->layers[i]->user_data.pointer;
+		ts->streamed = true;
+	}
+
+	debug_print("Streaming %s: %d x %d tiles in %d regions of %d x %d chunks\n",
+		path, ri->width, ri->height, ri->regions_len, ri->region_chunks, ri->region_chunks);
+	return true;
+}
+
+static void close_stream(struct tilemap_stream* st) {
+	streamer_free(st->streamer);
+	region_index_free(st->index);
+	free(st->layers);
+	free(st->slots);
+	free(st->path);
+	free(st);
+}
+
+static struct region_slot* find_region(struct tilemap_stream* st, int rx, int ry) {
+	for (int i = 0; i < st->slots_len; i++) {
+		if (st->slots[i].rx == rx && st->slots[i].ry == ry) {
+			return &st->slots[i];
+		}
+	}
+	return NULL;
+}
+
+static struct region_slot* add_region(struct tilemap_stream* st, int rx, int ry) {
+	if (st->slots_len == st->slots_capacity) {
+		st->slots_capacity = st->slots_capacity > 0 ? st->slots_capacity * 2 : 16;
+		st->slots = realloc(st->slots, st->slots_capacity * sizeof(struct region_slot));
+	}
+	struct region_slot* slot = &st->slots[st->slots_len++];
+	slot->rx = rx;
+	slot->ry = ry;
+	slot->resident = false;
+	slot->edited = false;
+	return slot;
+}
+
+/*
+ * Returns the area of a region in tiles, clamped to the map.
+ */
+static SDL_Rect region_area(const struct tilemap* tm, int rx, int ry) {
+	const struct region_index* ri = tm->stream->index;
+	int span_x = ri->region_chunks * ri->chunk_w;
+	int span_y = ri->region_chunks * ri->chunk_h;
+	SDL_Rect area = { rx * span_x, ry * span_y, span_x, span_y };
+	area.w = SDL_min(area.w, (int)tm->map->width - area.x);
+	area.h = SDL_min(area.h, (int)tm->map->height - area.y);
+	return area;
+}
+
+/*
+ * Makes sure the tiles in an area of the map (in tiles) are drawn again, when
+ * its chunks came or went.
+ */
+static void dirty_area(struct tilemap* tm, const SDL_Rect* tiles) {
+	if (tm->overview != NULL) {
+		int n = tm->overview->chunk_tiles;
+		for (int layer = 0; layer < 2; layer++) {
+			for (int cy = tiles->y / n; cy <= (tiles->y + tiles->h - 1) / n; cy++) {
+				for (int cx = tiles->x / n; cx <= (tiles->x + tiles->w - 1) / n; cx++) {
+					chunkcache_dirty(tm->overview, layer, cx, cy);
+				}
+			}
+		}
+	}
+
+	if (tm->chunks != NULL) {
+		int n = tm->chunks->chunk_tiles;
+		for (int i = 0; i < tm->plan.len; i++) {
+			for (int cy = tiles->y / n; cy <= (tiles->y + tiles->h - 1) / n; cy++) {
+				for (int cx = tiles->x / n; cx <= (tiles->x + tiles->w - 1) / n; cx++) {
+					chunkcache_dirty(tm->chunks, i, cx, cy);
+				}
+			}
+		}
+	}
+
+	if (tm->scroll_background != NULL) {
+		float margin_x;
+		float margin_y;
+		scroll_margin(tm, &margin_x, &margin_y);
+		SDL_Rect area = {
+			floorf(tiles->x * tm->tilewidth - margin_x) - 1,
+			floorf(tiles->y * tm->tileheight - margin_y) - 1,
+			ceilf(tiles->w * tm->tilewidth + 2 * margin_x) + 2,
+			ceilf(tiles->h * tm->tileheight + 2 * margin_y) + 2,
+		};
+		scrollview_dirty(tm->scroll_background, &area);
+		scrollview_dirty(tm->scroll_foreground, &area);
+	}
+}
+
+/*
+ * Adds the chunks of a loaded region to the stores of their layers, and works
+ * out what is derived from them. Every layer of the region comes in at once,
+ * so the covered cells only depend on chunks of the region itself.
+ */
+static void insert_region(struct tilemap* tm, struct region* rg) {
+	struct tilemap_stream* st = tm->stream;
+	const struct region_index* ri = st->index;
+	SDL_Rect area = region_area(tm, rg->rx, rg->ry);
+
+	for (int i = 0; i < rg->len; i++) {
+		struct region_chunk* rc = &rg->chunks[i];
+		tmx_layer* layer = st->layers[rc->layer];
+		struct tilestore* ts = layer->user_data.pointer;
+
+		int x = rc->cx * ri->chunk_w;
+		int y = rc->cy * ri->chunk_h;
+		if (x < area.x || x >= area.x + area.w || y < area.y || y >= area.y + area.h) {
+			fprintf(stderr, "Region %d, %d has a chunk at %d, %d outside of it\n", rg->rx, rg->ry, rc->cx, rc->cy);
+			continue;
+		}
+		if (tilestore_find(ts, rc->cx, rc->cy) != NULL) {
+			continue;
+		}
+
+		for (int j = 0; j < ri->chunk_w * ri->chunk_h; j++) {
+			if (tile_render_index(rc->gids[j]) >= tm->render_table_len) {
+				fprintf(stderr, "Layer '%s' has an invalid gid %u in region %d, %d\n",
+					layer->name, (uint32_t)rc->gids[j] & TMX_FLIP_BITS_REMOVAL, rg->rx, rg->ry);
+				rc->gids[j] = 0;
+			}
+		}
+
+		if (tilestore_insert(ts, rc->cx, rc->cy, rc->gids) == NULL) {
+			fprintf(stderr, "Unable to add chunk %d, %d of region %d, %d to layer '%s'\n", rc->cx, rc->cy, rg->rx, rg->ry, layer->name);
+			continue;
+		}
+		if (layer == tm->collision_layer) {
+			if (!collisiongrid_set_area(tm->collision, x, y, ri->chunk_w, ri->chunk_h, (const uint32_t*)rc->gids, tm->shapes)) {
+				fprintf(stderr, "Unable to add chunk %d, %d of region %d, %d to the collision grid\n", rc->cx, rc->cy, rg->rx, rg->ry);
+			}
+			collisionmesh_dirty(tm->collision_mesh, x, y, x + ri->chunk_w - 1, y + ri->chunk_h - 1);
+		}
+		rc->gids = NULL;
+	}
+
+	for (int i = 0; i < rg->len; i++) {
+		// Chunks which were skipped above still have their gids.
+		const struct region_chunk* rc = &rg->chunks[i];
+		int p = plan_index_of(tm, st->layers[rc->layer]);
+		if (rc->gids != NULL || p < 0) {
+			continue;
+		}
+		struct plan_layer* pl = &tm->plan.layers[p];
+		const struct tilestore* ts = pl->store;
+		const struct tilestore_chunk* c = tilestore_find(ts, rc->cx, rc->cy);
+		pl->transform = SDL_max(pl->transform, gids_transform((const uint32_t*)c->chunk->gids, ts->chunk_w * ts->chunk_h));
+		if (plan_layer_aligned(pl)) {
+			occlude_chunk(tm, p, c);
+		}
+		if (tm->anims != NULL) {
+			index_animated_chunk(tm, p, ts, c);
+		}
+	}
+
+	dirty_area(tm, &area);
+}
+
+/*
+ * Removes the chunks of a region from the stores of their layers.
+ */
+static void evict_region(struct tilemap* tm, int rx, int ry) {
+	struct tilemap_stream* st = tm->stream;
+	const struct region_index* ri = st->index;
+
+	for (int l = 0; l < st->layers_len; l++) {
+		struct tilestore* ts = st->layers[l]->user_data.pointer;
+		int p = plan_index_of(tm, st->layers[l]);
+
+		for (int cy = ry * ri->region_chunks; cy < (ry + 1) * ri->region_chunks; cy++) {
+			for (int cx = rx * ri->region_chunks; cx < (rx + 1) * ri->region_chunks; cx++) {
+				const struct tilestore_chunk* c = tilestore_find(ts, cx, cy);
+				if (c == NULL) {
+					continue;
+				}
+				if (p >= 0 && tm->anims != NULL) {
+					unindex_animated_chunk(tm, p, ts, c);
+				}
+				tilestore_remove(ts, cx, cy);
+			}
+		}
+	}
+
+	// The collision grid keeps the tiles of the region. They are the same
+	// when it is read again, since edited regions are never evicted.
+	SDL_Rect area = region_area(tm, rx, ry);
+	dirty_area(tm, &area);
+}
+
+/*
+ * Makes sure the region with tile (x, y) is resident. Collisions cannot wait
+ * for the loader, so a region which is not in yet is read right away. When it
+ * was requested, the copy from the loader is dropped when it comes in.
+ */
+static struct region_slot* ensure_resident(struct tilemap* tm, int x, int y) {
+	struct tilemap_stream* st = tm->stream;
+	int rx = x / (st->index->region_chunks * st->index->chunk_w);
+	int ry = y / (st->index->region_chunks * st->index->chunk_h);
+
+	struct region_slot* slot = find_region(st, rx, ry);
+	if (slot != NULL && slot->resident) {
+		return slot;
+	}
+	if (slot == NULL) {
+		slot = add_region(st, rx, ry);
+	}
+
+	// Regions without a file have no tiles, so there is nothing to read.
+	struct region* rg = calloc(1, sizeof(struct region));
+	rg->rx = rx;
+	rg->ry = ry;
+	if (region_index_contains(st->index, rx, ry)) {
+		region_load(rg, st->path, st->index);
+	}
+	insert_region(tm, rg);
+	region_free(rg);
+
+	slot->resident = true;
+	return slot;
+}
+
+/*
+ * Makes sure every region with tiles from (x1, y1) up to and including (x2, y2)
+ * is resident. Tiles outside of the map are left alone.
+ */
+static void ensure_area_resident(struct tilemap* tm, int x1, int y1, int x2, int y2) {
+	int span_x = tm->stream->index->region_chunks * tm->stream->index->chunk_w;
+	int span_y = tm->stream->index->region_chunks * tm->stream->index->chunk_h;
+	x1 = SDL_max(x1, 0) / span_x;
+	y1 = SDL_max(y1, 0) / span_y;
+	x2 = SDL_min(x2, (int)tm->map->width - 1);
+	y2 = SDL_min(y2, (int)tm->map->height - 1);
+	if (x2 < 0 || y2 < 0) {
+		return;
+	}
+
+	for (int ry = y1; ry <= y2 / span_y; ry++) {
+		for (int rx = x1; rx <= x2 / span_x; rx++) {
+			ensure_resident(tm, rx * span_x, ry * span_y);
+		}
+	}
+}
+
+/*
+ * Like tilemap_solid_rects, for the regions of a streamed map which are loaded
+ * already. The others are left out rather than loaded.
+ */
+static int resident_rects(struct tilemap* tm, float x, float y, float w, float h, SDL_FRect* rects, int max) {
+	int n = collisionmesh_query(tm->collision_mesh,
+		x / tm->tilewidth, y / tm->tileheight, (x + w) / tm->tilewidth, (y + h) / tm->tileheight,
+		rects, max);
+	for (int i = 0; i < SDL_min(n, max); i++) {
+		rects[i].x *= tm->tilewidth;
+		rects[i].y *= tm->tileheight;
+		rects[i].w *= tm->tilewidth;
+		rects[i].h *= tm->tileheight;
+	}
+	return n;
+}
+
+/*
+ * Whether any tile from (x1, y1) up to and including (x2, y2) is solid all
+ * over. Tiles with a collision shape are left to the callers.
+ */
+static bool area_solid(struct tilemap* tm, int x1, int y1, int x2, int y2) {
+	if (tm->stream != NULL) {
+		ensure_area_resident(tm, x1, y1, x2, y2);
+	}
+	return collisiongrid_overlaps_whole(tm->collision, x1, y1, x2, y2);
+}
+
+/*
+ * Returns the collision shape of the tile at (x, y), or NULL when the tile is
+ * not partly solid. The tile must be resident.
+ */
+static const struct tileshape* shape_at(const struct tilemap* tm, int x, int y) {
+	if (!collisiongrid_partial(tm->collision, x, y)) {
+		return NULL;
+	}
+	return tileshapes_find(tm->shapes, layer_gid(tm, tm->collision_layer, x, y));
+}
+
+/*
+ * Whether the box at (x, y) of w x h world units overlaps the shape of any
+ * partly solid tile from (x1, y1) up to and including (x2, y2).
+ */
+static bool area_shapes_overlap(struct tilemap* tm, int x1, int y1, int x2, int y2, float x, float y, float w, float h) {
+	if (!collisiongrid_overlaps_partial(tm->collision, x1, y1, x2, y2)) {
+		return false;
+	}
+	if (tm->stream != NULL) {
+		ensure_area_resident(tm, x1, y1, x2, y2);
+	}
+
+	for (int ty = y1; ty <= y2; ty++) {
+		for (int tx = x1; tx <= x2; tx++) {
+			const struct tileshape* s = shape_at(tm, tx, ty);
+			for (int i = 0; s != NULL && i < s->len; i++) {
+				if (tileshape_overlaps(&tm->shapes->polygons[s->first + i], tx * tm->tilewidth, ty * tm->tileheight,
+					tm->tilewidth, tm->tileheight, x, y, w, h)) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/*
+ * Sweeps the box at (x, y) of w x h world units, moving (dx, dy), against the
+ * shapes of the partly solid tiles from (x1, y1) up to and including (x2, y2).
+ * The first shape it touches is put in `hit' when that is before the tile
+ * which is already in it, or when `touched' is false. Returns whether it was.
+ */
+static bool area_shapes_sweep(struct tilemap* tm, int x1, int y1, int x2, int y2,
+	float x, float y, float w, float h, float dx, float dy, bool touched, struct sweep* hit) {
+
+	if (!collisiongrid_overlaps_partial(tm->collision, x1, y1, x2, y2)) {
+		return false;
+	}
+	if (tm->stream != NULL) {
+		ensure_area_resident(tm, x1, y1, x2, y2);
+	}
+
+	float best = hit->t;
+	float normal_x = 0.0f;
+	float normal_y = 0.0f;
+	bool found = false;
+	for (int ty = y1; ty <= y2; ty++) {
+		for (int tx = x1; tx <= x2; tx++) {
+			const struct tileshape* s = shape_at(tm, tx, ty);
+			for (int i = 0; s != NULL && i < s->len; i++) {
+				float nx, ny;
+				float t = tileshape_sweep(&tm->shapes->polygons[s->first + i], tx * tm->tilewidth, ty * tm->tileheight,
+					tm->tilewidth, tm->tileheight, x, y, w, h, dx, dy, &nx, &ny);
+				// A tile solid all over wins a tie, since its contact
+				// is exact.
+				if (t < best || (t == best && !touched && !found)) {
+					best = t;
+					normal_x = nx;
+					normal_y = ny;
+					found = true;
+				}
+			}
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	hit->t = best;
+	hit->x = x + dx * best + normal_x * SHAPE_HAIR;
+	hit->y = y + dy * best + normal_y * SHAPE_HAIR;
+	hit->normal_x = normal_x;
+	hit->normal_y = normal_y;
+	return true;
+}
+
+/*
+ * Finds the first and last tile covered by the span [lo, hi) along an axis of
+ * tiles `size' long, right after it moved at speed `v'. An end exactly on the
+ * edge of a tile covers it when it is moving into that tile.
+ */
+static inline void span_tiles(float lo, float hi, float v, float size, int* first, int* last) {
+	if (v > 0) {
+		*first = floorf(lo / size);
+		*last = floorf(hi / size);
+	} else if (v < 0) {
+		*first = ceilf(lo / size) - 1;
+		*last = ceilf(hi / size) - 1;
+	} else {
+		*first = floorf(lo / size);
+		*last = ceilf(hi / size) - 1;
+	}
+}
+
+/*
+ * Whether the ray from (x, y) in the direction (dx, dy) meets the shape of the
+ * tile at (tile_x, tile_y) within `end' world units. If so, that is put in
+ * `hit'.
+ */
+static bool trace_shape(const struct tilemap* tm, const struct tileshape* s, int tile_x, int tile_y,
+	float x, float y, float dx, float dy, float end, struct ray_hit* hit) {
+
+	float best = INFINITY;
+	float normal_x = 0.0f;
+	float normal_y = 0.0f;
+	for (int i = 0; i < s->len; i++) {
+		float nx, ny;
+		float t = tileshape_sweep(&tm->shapes->polygons[s->first + i], tile_x * tm->tilewidth, tile_y * tm->tileheight,
+			tm->tilewidth, tm->tileheight, x, y, 0.0f, 0.0f, dx * end, dy * end, &nx, &ny);
+		if (t < best) {
+			best = t;
+			normal_x = nx;
+			normal_y = ny;
+		}
+	}
+	if (best > 1.0f) {
+		return false;
+	}
+
+	hit->tile_x = tile_x;
+	hit->tile_y = tile_y;
+	hit->distance = best * end;
+	hit->x = x + dx * hit->distance;
+	hit->y = y + dy * hit->distance;
+	hit->normal_x = normal_x;
+	hit->normal_y = normal_y;
+	return true;
+}
+
+/*
+ * Moves a ray to the last tile it passes within the square of tiles `reach'
+ * tiles around its current one, which must all be free. The ray carries on
+ * from there, so it leaves the square the way it would have tile by tile.
+ * Returns the distance at which the ray leaves the square.
+ */
+static float skip_free_square(const float* pos, const float* dir, const float* size, int reach, int* cell, float* t_max) {
+	int lo[2], hi[2];
+	float t_exit = INFINITY;
+	int exit = 0;
+	for (int a = 0; a < 2; a++) {
+		lo[a] = cell[a] - reach;
+		hi[a] = cell[a] + reach;
+		float t = INFINITY;
+		if (dir[a] > 0) {
+			t = ((hi[a] + 1) * size[a] - pos[a]) / dir[a];
+		} else if (dir[a] < 0) {
+			t = (lo[a] * size[a] - pos[a]) / dir[a];
+		}
+		if (t < t_exit) {
+			t_exit = t;
+			exit = a;
+		}
+	}
+
+	for (int a = 0; a < 2; a++) {
+		if (a == exit) {
+			cell[a] = dir[a] > 0 ? hi[a] : lo[a];
+			t_max[a] = t_exit;
+		} else if (dir[a] != 0) {
+			// Rounding may put a ray leaving through a corner just
+			// outside of the square, which it has not left yet.
+			int c = floorf((pos[a] + dir[a] * t_exit) / size[a]);
+			cell[a] = SDL_min(SDL_max(c, lo[a]), hi[a]);
+			t_max[a] = dir[a] > 0
+				? ((cell[a] + 1) * size[a] - pos[a]) / dir[a]
+				: (cell[a] * size[a] - pos[a]) / dir[a];
+		}
+	}
+	return t_exit;
+}
+
+/*
+ * Returns the distance field, with the distances around the tiles edited since
+ * it was used last worked out again, or NULL when the map has none.
+ */
+static const struct distancefield* distance_field(struct tilemap* tm) {
+	if (tm->distance != NULL) {
+		distancefield_flush(tm->distance, tm->collision);
+	}
+	return tm->distance;
+}
+
+/*
+ * Returns how far the point (x, y) in the tile at (tile_x, tile_y) is from the
+ * nearest solid tile at least, in world units. The tiles within the distance
+ * field value of the tile, less one, are free, and so is the part of the tile
+ * itself around the point.
+ */
+static float clearance_at(const struct tilemap* tm, const struct distancefield* field, int tile_x, int tile_y, float x, float y) {
+	int d = distancefield_get(field, tile_x, tile_y);
+	if (d == 0) {
+		return 0.0f;
+	}
+	float u = SDL_min(SDL_max(x - tile_x * tm->tilewidth, 0.0f), tm->tilewidth);
+	float v = SDL_min(SDL_max(y - tile_y * tm->tileheight, 0.0f), tm->tileheight);
+	float across = (d - 1) * tm->tilewidth + SDL_min(u, tm->tilewidth - u);
+	float down = (d - 1) * tm->tileheight + SDL_min(v, tm->tileheight - v);
+	return SDL_min(across, down);
+}
+
+/*
+ * Walks the tiles along a ray from (x, y) in the direction (dx, dy), which is
+ * of unit length, from tile to tile like Amanatides and Woo do. The first
+ * solid tile within `max_distance' is put in `hit'. Tiles with a collision
+ * shape are passed when the ray misses their shape. Where the distance field
+ * says the tiles around the ray are free, it skips them all at once.
+ */
+static bool trace_ray(struct tilemap* tm, float x, float y, float dx, float dy, float max_distance, struct ray_hit* hit) {
+	const float pos[2] = { x, y };
+	const float dir[2] = { dx, dy };
+	const float size[2] = { tm->tilewidth, tm->tileheight };
+	const struct distancefield* field = distance_field(tm);
+
+	int cell[2];
+	int step[2];
+	float t_max[2];   // The distance at which the ray leaves the current column or row.
+	float t_delta[2]; // The distance between two columns or rows along the ray.
+	for (int a = 0; a < 2; a++) {
+		cell[a] = floorf(pos[a] / size[a]);
+		step[a] = dir[a] > 0 ? 1 : -1;
+		if (dir[a] > 0) {
+			t_max[a] = ((cell[a] + 1) * size[a] - pos[a]) / dir[a];
+			t_delta[a] = size[a] / dir[a];
+		} else if (dir[a] < 0) {
+			t_max[a] = (cell[a] * size[a] - pos[a]) / dir[a];
+			t_delta[a] = -size[a] / dir[a];
+		} else {
+			t_max[a] = INFINITY;
+			t_delta[a] = INFINITY;
+		}
+	}
+
+	// The region of the last tile made resident, for streamed maps.
+	int span_x = tm->stream != NULL ? tm->stream->index->region_chunks * tm->stream->index->chunk_w : 1;
+	int span_y = tm->stream != NULL ? tm->stream->index->region_chunks * tm->stream->index->chunk_h : 1;
+	int region_x = INT_MIN;
+	int region_y = INT_MIN;
+
+	float t = 0.0f;
+	int axis = -1;
+	while (true) {
+		if (tm->stream != NULL && (cell[0] / span_x != region_x || cell[1] / span_y != region_y)) {
+			region_x = cell[0] / span_x;
+			region_y = cell[1] / span_y;
+			ensure_area_resident(tm, cell[0], cell[1], cell[0], cell[1]);
+		}
+		// A tile the distance field puts away from any solid tile is free,
+		// which saves looking it up in the grid.
+		int d = field != NULL ? distancefield_get(field, cell[0], cell[1]) : 0;
+		if (d == 0 && collisiongrid_get(tm->collision, cell[0], cell[1])) {
+			const struct tileshape* s = shape_at(tm, cell[0], cell[1]);
+			if (s == NULL) {
+				break;
+			}
+			// A tile with a shape is only hit where the ray meets one
+			// of its polygons before it leaves the tile.
+			float end = SDL_min(SDL_min(t_max[0], t_max[1]), max_distance);
+			if (trace_shape(tm, s, cell[0], cell[1], x, y, dx, dy, end, hit)) {
+				return true;
+			}
+		}
+
+		// Far from any solid tile, the ray skips the square of free tiles
+		// around it at once, like sphere tracing does. When it is still in
+		// the square at the end, it hits nothing.
+		if (d >= RAY_SKIP_DISTANCE) {
+			if (skip_free_square(pos, dir, size, d - 1, cell, t_max) > max_distance) {
+				return false;
+			}
+			continue;
+		}
+
+		axis = t_max[1] < t_max[0] ? 1 : 0;
+		t = t_max[axis];
+		if (t > max_distance) {
+			return false;
+		}
+		cell[axis] += step[axis];
+		t_max[axis] += t_delta[axis];
+	}
+
+	hit->tile_x = cell[0];
+	hit->tile_y = cell[1];
+	hit->distance = t;
+	hit->x = x + dx * t;
+	hit->y = y + dy * t;
+	hit->normal_x = 0;
+	hit->normal_y = 0;
+	if (axis == 0) {
+		// Put the point exactly on the side of the tile.
+		hit->x = (step[0] > 0 ? cell[0] : cell[0] + 1) * size[0];
+		hit->normal_x = -step[0];
+	} else if (axis == 1) {
+		hit->y = (step[1] > 0 ? cell[1] : cell[1] + 1) * size[1];
+		hit->normal_y = -step[1];
+	}
+	return true;
+}
+
+/*
+ * Whether the tile with the point (x, y) is solid all over, so that every ray
+ * from the point hits it right where it starts. A tile with a collision shape
+ * is left to the rays themselves.
+ */
+static bool trace_origin(struct tilemap* tm, float x, float y, struct ray_hit* hit) {
+	int tile_x = floorf(x / tm->tilewidth);
+	int tile_y = floorf(y / tm->tileheight);
+	if (tm->stream != NULL) {
+		ensure_area_resident(tm, tile_x, tile_y, tile_x, tile_y);
+	}
+	if (!collisiongrid_get(tm->collision, tile_x, tile_y) || shape_at(tm, tile_x, tile_y) != NULL) {
+		return false;
+	}
+
+	hit->tile_x = tile_x;
+	hit->tile_y = tile_y;
+	hit->x = x;
+	hit->y = y;
+	hit->distance = 0.0f;
+	hit->normal_x = 0;
+	hit->normal_y = 0;
+	return true;
+}
+
+/*
+ * Packs the collision layer into the collision grid, merges it into the
+ * collision mesh, and works out its distance field. The regions of a streamed
+ * map add their tiles to the grid as they come in, and their blocks of the
+ * mesh are merged once they are first needed. Infinite maps, and so streamed
+ * ones, get a sparse grid. They have no distance field, since it would cover
+ * the whole of their bounds, and the grid of a streamed one does not know the
+ * regions which were never loaded. Returns
+ * false when the grid or the mesh could not be allocated.
+ */
+static bool build_collision_grid(struct tilemap* tm) {
+	tm->collision = collisiongrid_create(tm->map->width, tm->map->height, tm->map->infinite);
+	if (tm->collision == NULL) {
+		return false;
+	}
+	if (tm->stream != NULL) {
+		tm->collision_mesh = collisionmesh_create(tm->collision);
+		return tm->collision_mesh != NULL;
+	}
+
+	if (!tm->map->infinite) {
+		if (!collisiongrid_set_area(tm->collision, 0, 0, tm->map->width, tm->map->height, (const uint32_t*)tm->collision_layer->content.gids, tm->shapes)) {
+			return false;
+		}
+	} else {
+		const struct tilestore* ts = tm->collision_layer->user_data.pointer;
+		for (uint32_t i = 0; i < ts->chunks->capacity; i++) {
+			const struct tilestore_chunk* c = ts->chunks->slots[i].value;
+			if (c != NULL && !collisiongrid_set_area(tm->collision, c->cx * ts->chunk_w, c->cy * ts->chunk_h,
+					ts->chunk_w, ts->chunk_h, (const uint32_t*)c->chunk->gids, tm->shapes)) {
+				return false;
+			}
+		}
+	}
+	tm->collision_mesh = collisionmesh_create(tm->collision);
+	if (tm->collision_mesh == NULL) {
+		return false;
+	}
+
+	// Rays and clearances do without the field, only slower.
+	if (!tm->map->infinite) {
+		tm->distance = distancefield_create(tm->collision);
+		if (tm->distance == NULL) {
+			fprintf(stderr, "Unable to allocate the distance field of %d x %d tiles\n", tm->map->width, tm->map->height);
+		}
+	}
+	return true;
+}
+
+/*
+ * Converts the camera at (x, y), grown by `margin' tiles on every side, to the
+ * range of regions it overlaps.
+ */
+static void stream_range(const struct tilemap* tm, const struct camera* cam, float x, float y, int margin, struct tilerange* range) {
+	const struct region_index* ri = tm->stream->index;
+	int span_x = ri->region_chunks * ri->chunk_w;
+	int span_y = ri->region_chunks * ri->chunk_h;
+
+	int x1 = SDL_max((int)floorf(x / tm->tilewidth) - margin, 0);
+	int y1 = SDL_max((int)floorf(y / tm->tileheight) - margin, 0);
+	int x2 = SDL_min((int)floorf((x + cam->winwidth) / tm->tilewidth) + margin, (int)tm->map->width - 1);
+	int y2 = SDL_min((int)floorf((y + cam->winheight) / tm->tileheight) + margin, (int)tm->map->height - 1);
+
+	if (x1 > x2 || y1 > y2) {
+		// Nothing of the map is near, so no region either.
+		range->x1 = 0;
+		range->y1 = 0;
+		range->x2 = -1;
+		range->y2 = -1;
+		return;
+	}
+
+	range->x1 = x1 / span_x;
+	range->y1 = y1 / span_y;
+	range->x2 = x2 / span_x;
+	range->y2 = y2 / span_y;
+}
+
+static inline bool in_range(const struct tilerange* range, int x, int y) {
+	return x >= range->x1 && x <= range->x2 && y >= range->y1 && y <= range->y2;
+}
+
+/*
+ * Requests the regions in the range which are not resident or requested yet.
+ * Returns false when the loader cannot take any more requests.
+ */
+static bool request_regions(struct tilemap* tm, const struct tilerange* range) {
+	struct tilemap_stream* st = tm->stream;
+	for (int ry = range->y1; ry <= range->y2; ry++) {
+		for (int rx = range->x1; rx <= range->x2; rx++) {
+			if (find_region(st, rx, ry) != NULL || !region_index_contains(st->index, rx, ry)) {
+				continue;
+			}
+			if (!streamer_request(st->streamer, rx, ry)) {
+				return false;
+			}
+			add_region(st, rx, ry);
+		}
+	}
+	return true;
+}
+
+/*
+ * Works out which layers to draw, in which order and how, so drawing a frame
+ * does not have to walk the layer list.
+ */
+static void build_draw_plan(struct tilemap* tm) {
+	struct drawplan* plan = &tm->plan;
+	plan->layers = NULL;
+	plan->len = 0;
+	plan->foreground = -1;
+	plan->collision = NULL;
+	tm->parallax = parallax_create();
+
+	plan_add_layers(tm, tm->map->ly_head, 1.0, 0, 0, false);
+
+	if (plan->foreground < 0) {
+		// Without a 'Main' layer, everything is background.
+		plan->foreground = plan->len;
+	}
+
+	build_occlusion(tm);
+
+	debug_print("Draw plan: %d background layers, %d foreground layers\n",
+		plan->foreground, plan->len - plan->foreground);
+}
+
+/*
+ * The texture state set by the last tile drawn without batching. Most tiles
+ * come from the same atlas, so it rarely has to be set again.
+ */
+struct copy_state {
+	SDL_Texture* texture;
+	SDL_BlendMode blend;
+};
+
+/*
+ * Draws a single tile at tile coordinate (x, y), relative to the origin (in
+ * pixels). The origin is the camera position when drawing to the screen, or the
+ * top-left corner of a chunk when baking one. When batching, the tile is only
+ * added to the batch, which is drawn by flush_tiles.
+ *
+ * The transform and whether the opacity is below 0xff are constants in every
+ * draw kernel, so each of them only keeps the branches it needs.
+ */
+SDL_FORCE_INLINE void draw_tile(struct tilemap* tm, SDL_Renderer* r, struct copy_state* cs, const struct tile_render* tr, int x, int y, float originx, float originy, uint8_t opacity, enum plan_transform transform, bool translucent) {
+	SDL_BlendMode blend = SDL_BLENDMODE_BLEND;
+	if (!translucent && tr->alpha == ALPHA_OPAQUE) {
+		blend = SDL_BLENDMODE_NONE;
+	}
+
+	// Keep the fractional positions, so tiles line up exactly when the
+	// renderer scales them to native pixels.
+	SDL_FRect dst_rect = {
+		.x = x * tm->tilewidth - originx,
+		.y = y * tm->tileheight - originy,
+		.w = tm->tilewidth,
+		.h = tm->tileheight,
+	};
+
+	if (tm->batching) {
+		if (transform == TRANSFORM_NONE) {
+			tilebatch_add_plain(tm->batch, tr->texture, &tr->src, &dst_rect, opacity, blend);
+		} else {
+			tilebatch_add(tm->batch, tr->texture, &tr->src, &dst_rect, tr->orientation, opacity, blend);
+		}
+	} else {
+		if (tr->texture != cs->texture || blend != cs->blend) {
+			SDL_SetTextureAlphaMod(tr->texture, opacity);
+			SDL_SetTextureBlendMode(tr->texture, blend);
+			cs->texture = tr->texture;
+			cs->blend = blend;
+		}
+		if (transform == TRANSFORM_NONE) {
+			SDL_RenderCopyF(r, tr->texture, &tr->src, &dst_rect);
+		} else if (transform == TRANSFORM_FLIP) {
+			SDL_RenderCopyExF(r, tr->texture, &tr->src, &dst_rect, 0.0, NULL, tr->flip);
+		} else {
+			SDL_RenderCopyExF(r, tr->texture, &tr->src, &dst_rect, tr->rotate, NULL, tr->flip);
+		}
+		tm->stats.draw_calls++;
+	}
+	tm->stats.tiles++;
+}
+
+/*
+ * Draws the tiles collected in the batch, if any.
+ */
+static void flush_tiles(struct tilemap* tm, SDL_Renderer* r) {
+	if (tm->batching) {
+		tm->stats.draw_calls += tilebatch_flush(tm->batch, r);
+	}
+}
+
+/*
+ * Checks whether a tile does not have to be drawn, because it is empty or
+ * hidden behind an opaque tile. The `occluded' bits are those of the layer or
+ * chunk, and `idx' is the cell within them.
+ */
+SDL_FORCE_INLINE bool is_skipped(struct tilemap* tm, const uint32_t* occluded, const struct tile_render* tr, size_t idx) {
+	if (tr->texture == NULL) {
+		// Either no tile at all, or one without any visible pixels.
+		tm->stats.skipped += tr->alpha == ALPHA_EMPTY;
+		return true;
+	}
+
+	if (occluded != NULL && bit_get(occluded, idx)) {
+		tm->stats.skipped++;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Draws the tiles of a dense layer within the given range, by visiting every
+ * cell in it.
+ */
+SDL_FORCE_INLINE void draw_tiles_dense(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, const struct tilerange* range, float originx, float originy, uint8_t opacity, enum plan_transform transform, bool translucent) {
+	struct copy_state cs = { NULL, SDL_BLENDMODE_INVALID };
+	for (int i = range->y1; i <= range->y2; i++) {
+		const uint32_t* row = &pl->gids[(size_t)i * tm->map->width];
+		for (int j = range->x1; j <= range->x2; j++) {
+			const struct tile_render* tr = &tm->draw_table[tile_render_index(row[j])];
+			if (is_skipped(tm, pl->occluded, tr, (size_t)i * tm->map->width + j)) {
+				continue;
+			}
+			draw_tile(tm, r, &cs, tr, j, i, originx, originy, opacity, transform, translucent);
+		}
+	}
+}
+
+/*
+ * Draws the tiles of a sparse layer within the given range, by only visiting
+ * the stored tiles in the bands and columns of the range.
+ */
+SDL_FORCE_INLINE void draw_tiles_sparse(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, const struct tilerange* range, float originx, float originy, uint8_t opacity, enum plan_transform transform, bool translucent) {
+	struct copy_state cs = { NULL, SDL_BLENDMODE_INVALID };
+	const struct sparselayer* sl = pl->sparse;
+	for (int band = range->y1 / SPARSE_BAND_ROWS; band <= range->y2 / SPARSE_BAND_ROWS; band++) {
+		const struct sparse_tile* end = sparselayer_band_end(sl, band);
+		for (const struct sparse_tile* t = sparselayer_find(sl, band, range->x1); t < end && t->x <= range->x2; t++) {
+			if (t->y < range->y1 || t->y > range->y2) {
+				continue;
+			}
+
+			const struct tile_render* tr = &tm->draw_table[tile_render_index(t->gid)];
+			if (is_skipped(tm, pl->occluded, tr, (size_t)t->y * tm->map->width + t->x)) {
+				continue;
+			}
+			draw_tile(tm, r, &cs, tr, t->x, t->y, originx, originy, opacity, transform, translucent);
+		}
+	}
+}
+
+/*
+ * Draws the tiles of a layer of an infinite map within the given range, by
+ * visiting the cells of the chunks in it. Regions without a chunk are skipped
+ * as a whole.
+ */
+SDL_FORCE_INLINE void draw_tiles_chunked(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, const struct tilerange* range, float originx, float originy, uint8_t opacity, enum plan_transform transform, bool translucent) {
+	struct copy_state cs = { NULL, SDL_BLENDMODE_INVALID };
+	const struct tilestore* ts = pl->store;
+	int cw = ts->chunk_w;
+	int ch = ts->chunk_h;
+
+	for (int cy = range->y1 / ch; cy <= range->y2 / ch; cy++) {
+		for (int cx = range->x1 / cw; cx <= range->x2 / cw; cx++) {
+			const struct tilestore_chunk* c = tilestore_find(ts, cx, cy);
+			if (c == NULL) {
+				continue;
+			}
+
+			// The part of the range within this chunk, in cells of the chunk.
+			int x1 = SDL_max(range->x1 - cx * cw, 0);
+			int y1 = SDL_max(range->y1 - cy * ch, 0);
+			int x2 = SDL_min(range->x2 - cx * cw, cw - 1);
+			int y2 = SDL_min(range->y2 - cy * ch, ch - 1);
+			for (int i = y1; i <= y2; i++) {
+				const int32_t* row = &c->chunk->gids[i * cw];
+				for (int j = x1; j <= x2; j++) {
+					const struct tile_render* tr = &tm->draw_table[tile_render_index(row[j])];
+					if (is_skipped(tm, c->occluded, tr, i * cw + j)) {
+						continue;
+					}
+					draw_tile(tm, r, &cs, tr, cx * cw + j, cy * ch + i, originx, originy, opacity, transform, translucent);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * A draw kernel draws the tiles of a layer within a range, for a single
+ * transform and opacity.
+ */
+typedef void (*draw_kernel)(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, const struct tilerange* range, float originx, float originy, uint8_t opacity);
+
+/*
+ * Defines the draw kernel for a transform and opacity. Both are constants in
+ * it, so the compiler leaves out every branch on them in the loops below.
+ */
+#define DRAW_KERNEL(name, transform, translucent) \
+	static void name(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, const struct tilerange* range, float originx, float originy, uint8_t opacity) { \
+		if (pl->store != NULL) { \
+			draw_tiles_chunked(tm, r, pl, range, originx, originy, opacity, transform, translucent); \
+		} else if (pl->sparse != NULL) { \
+			draw_tiles_sparse(tm, r, pl, range, originx, originy, opacity, transform, translucent); \
+		} else { \
+			draw_tiles_dense(tm, r, pl, range, originx, originy, opacity, transform, translucent); \
+		} \
+	}
+
+DRAW_KERNEL(draw_plain_opaque, TRANSFORM_NONE, false)
+DRAW_KERNEL(draw_plain_translucent, TRANSFORM_NONE, true)
+DRAW_KERNEL(draw_flip_opaque, TRANSFORM_FLIP, false)
+DRAW_KERNEL(draw_flip_translucent, TRANSFORM_FLIP, true)
+DRAW_KERNEL(draw_full_opaque, TRANSFORM_FULL, false)
+DRAW_KERNEL(draw_full_translucent, TRANSFORM_FULL, true)
+
+#undef DRAW_KERNEL
+
+// The draw kernels by transform, and whether the opacity is below 0xff.
+static const draw_kernel DRAW_KERNELS[TRANSFORM_COUNT][2] = {
+	[TRANSFORM_NONE] = { draw_plain_opaque, draw_plain_translucent },
+	[TRANSFORM_FLIP] = { draw_flip_opaque, draw_flip_translucent },
+	[TRANSFORM_FULL] = { draw_full_opaque, draw_full_translucent },
+};
+
+/*
+ * Draws the tiles of the layer within the given range, with the kernel which
+ * fits the layer.
+ */
+static void draw_tiles(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, const struct tilerange* range, float originx, float originy, uint8_t opacity) {
+	DRAW_KERNELS[pl->transform][opacity != 0xff](tm, r, pl, range, originx, originy, opacity);
+	flush_tiles(tm, r);
+}
+
+/*
+ * The render target and scale to go back to after drawing into a texture.
+ */
+struct target_state {
+	SDL_Texture* target;
+	float scale_x;
+	float scale_y;
+};
+
+/*
+ * Makes the texture the render target, drawing at the given scale. Switching
+ * targets resets the render scale, so that has to be set again both ways.
+ */
+static bool push_target(SDL_Renderer* r, SDL_Texture* texture, float scale_x, float scale_y, struct target_state* saved) {
+	saved->target = SDL_GetRenderTarget(r);
+	SDL_RenderGetScale(r, &saved->scale_x, &saved->scale_y);
+
+	if (SDL_SetRenderTarget(r, texture) != 0) {
+		debug_print("Unable to draw into texture: %s\n", SDL_GetError());
+		return false;
+	}
+	SDL_RenderSetScale(r, scale_x, scale_y);
+	return true;
+}
+
+static void pop_target(SDL_Renderer* r, const struct target_state* saved) {
+	SDL_SetRenderTarget(r, saved->target);
+	SDL_RenderSetScale(r, saved->scale_x, saved->scale_y);
+}
+
+/*
+ * Bakes the tiles of a chunk into its texture. Returns false when the chunk
+ * could not get a texture.
+ */
+static bool bake_chunk(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, struct chunk* c, const struct tilerange* tiles) {
+	if (!chunkcache_bind(tm->chunks, c, r)) {
+		return false;
+	}
+
+	// The chunk has to be baked at the same scale as it is drawn, which is
+	// not 1 when drawing to a scaled offscreen view.
+	float scale_x, scale_y;
+	SDL_RenderGetScale(r, &scale_x, &scale_y);
+
+	struct target_state saved;
+	if (!push_target(r, c->texture, scale_x, scale_y, &saved)) {
+		return false;
+	}
+
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+	SDL_RenderClear(r);
+	// The layer opacity is applied when drawing the chunk, not when baking.
+	draw_tiles(tm, r, pl, tiles, tiles->x1 * tm->tilewidth, tiles->y1 * tm->tileheight, 0xff);
+	pop_target(r, &saved);
+
+	c->baked = true;
+	return true;
+}
+
+/*
+ * Draws a single cell of a baked chunk again, instead of baking all of it.
+ */
+static void redraw_chunk_cell(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, int x, int y) {
+	struct chunkcache* cc = tm->chunks;
+	int n = cc->chunk_tiles;
+	struct chunk* c = chunkcache_peek(cc, pl->index, x / n, y / n);
+	if (c == NULL || c->texture == NULL || !c->baked || cc->tilewidth <= 0 || cc->tileheight <= 0) {
+		// Chunks which are not baked get the current frame when they are.
+		return;
+	}
+
+	// Draw at the scale the chunk was baked with.
+	select_mip_level(tm, cc->tilewidth, cc->tileheight);
+	struct target_state saved;
+	if (!push_target(r, c->texture, cc->tilewidth / tm->tilewidth, cc->tileheight / tm->tileheight, &saved)) {
+		return;
+	}
+
+	float originx = (x / n) * n * tm->tilewidth;
+	float originy = (y / n) * n * tm->tileheight;
+	SDL_FRect cell = {
+		.x = x * tm->tilewidth - originx,
+		.y = y * tm->tileheight - originy,
+		.w = tm->tilewidth,
+		.h = tm->tileheight,
+	};
+
+	// Clear the previous frame, without blending.
+	SDL_BlendMode blend;
+	SDL_GetRenderDrawBlendMode(r, &blend);
+	SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+	SDL_RenderFillRectF(r, &cell);
+	SDL_SetRenderDrawBlendMode(r, blend);
+
+	struct tilerange tiles = { x, y, x, y };
+	draw_tiles(tm, r, pl, &tiles, originx, originy, 0xff);
+	pop_target(r, &saved);
+}
+
+/*
+ * Draws the cells whose animation frame changed again in the chunks and scroll
+ * views they are cached in. Layers drawn directly need nothing.
+ */
+static void redraw_animated_cells(struct tilemap* tm, SDL_Renderer* r) {
+	for (int i = 0; i < tm->anim_pending_len; i++) {
+		const struct anim_cell* cell = &tm->anim_pending[i];
+		const struct plan_layer* pl = &tm->plan.layers[cell->layer];
+		int x = cell->idx % tm->map->width;
+		int y = cell->idx / tm->map->width;
+
+		if (tm->chunks != NULL) {
+			redraw_chunk_cell(tm, r, pl, x, y);
+		}
+
+		if (tm->scroll_background != NULL) {
+			float offsetx = pl->offsetx * tm->tilewidth / tm->map->tile_width;
+			float offsety = pl->offsety * tm->tileheight / tm->map->tile_height;
+			SDL_Rect area = {
+				.x = floorf(x * tm->tilewidth + offsetx),
+				.y = floorf(y * tm->tileheight + offsety),
+				.w = ceilf(tm->tilewidth) + 1,
+				.h = ceilf(tm->tileheight) + 1,
+			};
+			bool background = cell->layer < tm->plan.foreground;
+			scrollview_dirty(background ? tm->scroll_background : tm->scroll_foreground, &area);
+		}
+	}
+	tm->anim_pending_len = 0;
+}
+
+/*
+ * Draws the layer by copying the chunks which overlap the visible range. The
+ * chunks are baked the first time they come into view.
+ */
+static void draw_layer_chunked(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, const struct tilerange* range, float originx, float originy) {
+	// Chunks are baked in pixels, which differ from world units when drawing
+	// to a scaled offscreen view.
+	float scale_x, scale_y;
+	SDL_RenderGetScale(r, &scale_x, &scale_y);
+
+	struct chunkcache* cc = tm->chunks;
+	if (cc->tilewidth != tm->tilewidth * scale_x || cc->tileheight != tm->tileheight * scale_y) {
+		// The tile size has changed, so every baked chunk is out of date.
+		chunkcache_invalidate(cc, tm->tilewidth * scale_x, tm->tileheight * scale_y);
+	}
+
+	int n = cc->chunk_tiles;
+	float chunkw = n * tm->tilewidth;
+	float chunkh = n * tm->tileheight;
+
+	for (int cy = range->y1 / n; cy <= range->y2 / n; cy++) {
+		for (int cx = range->x1 / n; cx <= range->x2 / n; cx++) {
+			struct chunk* c = chunkcache_get(cc, pl->index, cx, cy);
 
-			// Always clear the motherflippin' bits :)
-			gid &= TMX_FLIP_BITS_REMOVAL;
-			if (map->tiles[gid] == NULL) {
+			// The tiles covered by this chunk, clamped to the map bounds.
+			struct tilerange tiles = {
+				.x1 = cx * n,
+				.y1 = cy * n,
+				.x2 = cx * n + n - 1,
+				.y2 = cy * n + n - 1,
+			};
+			tiles.x2 = tiles.x2 >= (int)tm->map->width  ? (int)tm->map->width  - 1 : tiles.x2;
+			tiles.y2 = tiles.y2 >= (int)tm->map->height ? (int)tm->map->height - 1 : tiles.y2;
+
+			if (c == NULL || (!c->baked && !bake_chunk(tm, r, pl, c, &tiles))) {
+				// No texture available, draw the tiles the slow way.
+				draw_tiles(tm, r, pl, &tiles, originx, originy, pl->opacity);
 				continue;
 			}
 
-			tileset = map->tiles[gid]->tileset;
-			tileset_texture = tileset->image->resource_image;
+			SDL_FRect dst_rect = {
+				.x = cx * chunkw - originx,
+				.y = cy * chunkh - originy,
+				.w = cc->pixel_w / scale_x,
+				.h = cc->pixel_h / scale_y,
+			};
+			SDL_SetTextureAlphaMod(c->texture, pl->opacity);
+			SDL_RenderCopyF(r, c->texture, NULL, &dst_rect);
+			tm->stats.draw_calls++;
+		}
+	}
+}
+
+/*
+ * Draws a single layer of the draw plan, as seen from world position (viewx,
+ * viewy). Only the tiles within `area' are visited, which is relative to the
+ * view position. Tiles are drawn from baked chunks when `chunked' is true.
+ */
+static void draw_plan_layer(struct tilemap* tm, SDL_Renderer* r, const struct plan_layer* pl, float viewx, float viewy, const SDL_Rect* area, bool chunked) {
+	// Layer offsets are in map pixels, so scale them to the current tile size.
+	float offsetx = pl->offsetx * tm->tilewidth / tm->map->tile_width;
+	float offsety = pl->offsety * tm->tileheight / tm->map->tile_height;
+	float originx = viewx - offsetx;
+	float originy = viewy - offsety;
+
+	if (pl->content == PLAN_IMAGE) {
+		SDL_Rect dst_rect = {
+			.x = -originx,
+			.y = -originy,
+			.w = pl->image.w * tm->tilewidth / tm->map->tile_width,
+			.h = pl->image.h * tm->tileheight / tm->map->tile_height,
+		};
+		SDL_SetTextureAlphaMod(pl->image.texture, pl->opacity);
+		SDL_RenderCopy(r, pl->image.texture, NULL, &dst_rect);
+		tm->stats.draw_calls++;
+		return;
+	}
+
+	// Only visit the tiles which are visible through the camera, so the cost
+	// of drawing a layer does not depend on the size of the map.
+	struct tilerange range;
+	if (!visible_range_at(tm, originx + area->x, originy + area->y, area->w, area->h, &range)) {
+		return;
+	}
+
+	if (chunked) {
+		draw_layer_chunked(tm, r, pl, &range, originx, originy);
+		return;
+	}
+
+	draw_tiles(tm, r, pl, &range, originx, originy, pl->opacity);
+}
+
+/*
+ * Bakes the layers [from, to) within an overview chunk.
+ */
+static bool bake_overview(struct tilemap* tm, SDL_Renderer* r, struct chunk* c, int from, int to) {
+	struct chunkcache* ov = tm->overview;
+	if (!chunkcache_bind(ov, c, r)) {
+		return false;
+	}
+	// Overview chunks are drawn smaller than they were baked.
+	SDL_SetTextureScaleMode(c->texture, SDL_ScaleModeLinear);
+
+	struct target_state saved;
+	if (!push_target(r, c->texture, ov->tilewidth / tm->tilewidth, ov->tileheight / tm->tileheight, &saved)) {
+		return false;
+	}
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+	SDL_RenderClear(r);
 
-			src_rect.x = map->tiles[gid]->ul_x;
-			src_rect.y = map->tiles[gid]->ul_y;
-			src_rect.w = tileset->tile_width;
-			src_rect.h = tileset->tile_height;
+	select_mip_level(tm, ov->tilewidth, ov->tileheight);
+	int n = ov->chunk_tiles;
+	SDL_Rect area = { 0, 0, ceilf(n * tm->tilewidth), ceilf(n * tm->tileheight) };
+	for (int i = from; i < to; i++) {
+		draw_plan_layer(tm, r, &tm->plan.layers[i], c->cx * n * tm->tilewidth, c->cy * n * tm->tileheight, &area, false);
+	}
+	pop_target(r, &saved);
 
-			dst_rect.x = j * tm->tilewidth - cam->x;
-			dst_rect.y = i * tm->tileheight - cam->y;
-			dst_rect.w = tm->tilewidth;
-			dst_rect.h = tm->tileheight;
+	c->baked = true;
+	return true;
+}
 
+/*
+ * Draws the layers [from, to) of the draw plan through the camera from the
+ * overview chunks. Chunks which cannot be baked are drawn tile by tile. The
+ * overview shows animated tiles at the frame they had when it was baked.
+ */
+static void draw_overview(struct tilemap* tm, struct camera* cam, SDL_Renderer* r, int from, int to) {
+	if (tm->overview == NULL) {
+		tm->overview = chunkcache_create(2, tm->map->width, tm->map->height, OVERVIEW_CHUNK_TILES, OVERVIEW_BUDGET);
+		chunkcache_invalidate(tm->overview, OVERVIEW_TILE_PIXELS, OVERVIEW_TILE_PIXELS);
+	}
+	tm->stats.overview = true;
 
-			SDL_SetTextureAlphaMod(tileset_texture, opacity);
-			SDL_RenderCopyEx(r, tileset_texture, &src_rect, &dst_rect, rotate, NULL, flip);
+	struct tilerange range;
+	if (from >= to || !visible_range_at(tm, cam->x, cam->y, cam->winwidth, cam->winheight, &range)) {
+		return;
+	}
 
-			if (j == 5 && i == 5) {
-				SDL_SetRenderDrawColor(r, 0xff, 0xff, 0xff, 0xff);
-				SDL_RenderDrawRect(r, &dst_rect);
+	struct chunkcache* ov = tm->overview;
+	int layer = from < tm->plan.foreground ? 0 : 1;
+	int n = ov->chunk_tiles;
+	float chunkw = n * tm->tilewidth;
+	float chunkh = n * tm->tileheight;
+	for (int cy = range.y1 / n; cy <= range.y2 / n; cy++) {
+		for (int cx = range.x1 / n; cx <= range.x2 / n; cx++) {
+			struct chunk* c = chunkcache_get(ov, layer, cx, cy);
+			if (c == NULL || (!c->baked && !bake_overview(tm, r, c, from, to))) {
+				SDL_Rect area = { floorf(cx * chunkw - cam->x), floorf(cy * chunkh - cam->y), ceilf(chunkw) + 1, ceilf(chunkh) + 1 };
+				select_mip_level(tm, OVERVIEW_TILE_PIXELS, OVERVIEW_TILE_PIXELS);
+				for (int i = from; i < to; i++) {
+					draw_plan_layer(tm, r, &tm->plan.layers[i], cam->x, cam->y, &area, false);
+				}
+				continue;
 			}
+
+			SDL_FRect dst_rect = { cx * chunkw - cam->x, cy * chunkh - cam->y, chunkw, chunkh };
+			SDL_RenderCopyF(r, c->texture, NULL, &dst_rect);
+			tm->stats.draw_calls++;
 		}
 	}
 }
 
-/**
- * Finds the layer namd "Collision". Every set gid in that map will
- * count as a collidable tile for the player to check with.
+/*
+ * Draws the layers [from, to) of the draw plan through the camera. With a
+ * scroll view, the layers are drawn into it, which only needs the parts which
+ * came into view since the previous frame.
  */
-static tmx_layer* find_collision_layer(const tmx_map* map) {
-	for (tmx_layer* layer = map->ly_head; layer != NULL; layer = layer->next) {
-		if (strcmp(LAYER_COLLISION, layer->name) == 0) {
-			return layer;
+static void draw_plan_range(struct tilemap* tm, struct camera* cam, SDL_Renderer* r, struct scrollview* sv, int from, int to) {
+	float scale_x, scale_y;
+	SDL_RenderGetScale(r, &scale_x, &scale_y);
+
+	// Far out, tiles are too small to be worth drawing one by one.
+	float pixels_w = tm->tilewidth * scale_x;
+	float pixels_h = tm->tileheight * scale_y;
+	if (pixels_w < OVERVIEW_TILE_PIXELS && pixels_h < OVERVIEW_TILE_PIXELS) {
+		draw_overview(tm, cam, r, from, to);
+		return;
+	}
+	select_mip_level(tm, pixels_w, pixels_h);
+
+	if (sv == NULL || scale_x != 1.0f || scale_y != 1.0f) {
+		// Scroll views work in whole pixels, so scaled views (such as the
+		// native offscreen view) are drawn directly.
+		SDL_Rect view = { 0, 0, cam->winwidth, cam->winheight };
+		for (int i = from; i < to; i++) {
+			draw_plan_layer(tm, r, &tm->plan.layers[i], cam->x, cam->y, &view, tm->chunks != NULL);
 		}
+		return;
 	}
 
-	return NULL;
+	if (tm->scroll_tilewidth != tm->tilewidth || tm->scroll_tileheight != tm->tileheight) {
+		// The tile size has changed, so nothing in either view is any good.
+		scrollview_invalidate(tm->scroll_background);
+		scrollview_invalidate(tm->scroll_foreground);
+		tm->scroll_tilewidth = tm->tilewidth;
+		tm->scroll_tileheight = tm->tileheight;
+	}
+
+	// The view is kept at whole pixels, and is one pixel larger so it still
+	// covers the window when the camera is in between pixels.
+	int x = floorf(cam->x);
+	int y = floorf(cam->y);
+	SDL_Rect areas[SCROLLVIEW_MAX_AREAS];
+	int count = scrollview_begin(sv, r, x, y, cam->winwidth + 1, cam->winheight + 1, areas);
+	for (int a = 0; a < count; a++) {
+		// This also clips, so tiles sticking out of the area do not draw
+		// over the pixels which were kept.
+		scrollview_clear(r, &areas[a]);
+		for (int i = from; i < to; i++) {
+			draw_plan_layer(tm, r, &tm->plan.layers[i], x, y, &areas[a], tm->chunks != NULL);
+		}
+	}
+	scrollview_end(sv, r);
+
+	if (!sv->valid) {
+		// No targets could be created, so draw everything directly.
+		SDL_Rect view = { 0, 0, cam->winwidth, cam->winheight };
+		for (int i = from; i < to; i++) {
+			draw_plan_layer(tm, r, &tm->plan.layers[i], cam->x, cam->y, &view, tm->chunks != NULL);
+		}
+		return;
+	}
+
+	scrollview_draw(sv, r, x - cam->x, y - cam->y);
+	tm->stats.draw_calls++;
 }
 
-struct tilemap* tilemap_create(const char* path) {
-	struct tilemap* tm = malloc(sizeof(struct tilemap));
+/*
+ * Loads the map at `path'. When streaming, the chunks are left out, and come
+ * in with their regions later.
+ */
+static struct tilemap* load(const char* path, SDL_Renderer* r, bool streamed) {
+	struct tilemap* tm = calloc(1, sizeof(struct tilemap));
 
+	tmx_skip_chunks = streamed;
 	tm->map = tmx_load(path);
+	tmx_skip_chunks = 0;
 	if (tm->map == NULL) {
 		tmx_perror("tmx_load");
 		return NULL;
 	}
 
+	if (streamed) {
+		if (!tm->map->infinite || !open_stream(tm, path)) {
+			fprintf(stderr, "Unable to stream %s, it must be an infinite map split into regions\n", path);
+			tilemap_free(tm);
+			return NULL;
+		}
+	} else if (tm->map->infinite && !build_tile_stores(tm)) {
+		fprintf(stderr, "Unsupported chunks in infinite map %s\n", path);
+		tilemap_free(tm);
+		return NULL;
+	}
+
 	debug_print("Tilemap is loaded: width = %d, height = %d\n", tm->map->width, tm->map->height);
 
-	tm->collision_layer = find_collision_layer(tm->map);
+	if (r != NULL) {
+		tm->atlas = atlas_create(r, tm->map, ATLAS_PADDING);
+	}
+
+	build_render_table(tm);
+	build_animations(tm);
+	if (r != NULL) {
+		build_mipmap(tm, r);
+	}
+	tm->draw_table = tm->render_table;
+	build_draw_plan(tm);
+	index_animated_cells(tm);
+
+	tm->collision_layer = tm->plan.collision;
 	if (tm->collision_layer == NULL) {
 		fprintf(stderr, "Could not find collision layer!?\n");
 		tilemap_free(tm);
 		return NULL;
 	}
+	tm->shapes = tileshapes_create(tm->map);
+	if (!build_collision_grid(tm)) {
+		fprintf(stderr, "Unable to allocate the collision grid of %s\n", path);
+		tilemap_free(tm);
+		return NULL;
+	}
+
+	if (streamed) {
+		tm->stream->streamer = streamer_create(path, tm->stream->index);
+		if (tm->stream->streamer == NULL) {
+			tilemap_free(tm);
+			return NULL;
+		}
+	}
+
+	tm->chunks = NULL;
+	tm->batch = tilebatch_create();
+	tm->batching = true;
+	tilemap_reset_stats(tm);
 
 	tm->tilewidth = 0;
-	tm->tilewidth = 0;
+	tm->tileheight = 0;
 
 	return tm;
 }
 
+struct tilemap* tilemap_create(const char* path, SDL_Renderer* r) {
+	return load(path, r, false);
+}
+
+struct tilemap* tilemap_create_streamed(const char* path, SDL_Renderer* r) {
+	return load(path, r, true);
+}
+
 void tilemap_free(struct tilemap* tm) {
+	if (tm->stream != NULL) {
+		// Stop the loader first, it may still be reading a region.
+		close_stream(tm->stream);
+		tm->stream = NULL;
+	}
+	tilemap_disable_chunk_cache(tm);
+	tilemap_disable_scroll_reuse(tm);
+	if (tm->edited != NULL) {
+		for (uint32_t s = 0; s < tm->edited->capacity; s++) {
+			free(tm->edited->slots[s].value);
+		}
+		coordmap_free(tm->edited);
+		tm->edited = NULL;
+	}
+	if (tm->anims != NULL) {
+		animtable_free(tm->anims);
+	}
+	free(tm->render_frames);
+	free(tm->anim_pending);
+	if (tm->batch != NULL) {
+		tilebatch_free(tm->batch);
+		tm->batch = NULL;
+	}
+	if (tm->mipmap != NULL) {
+		for (int level = 1; level <= tm->mipmap->levels; level++) {
+			free(tm->mip_tables[level - 1]);
+		}
+		mipmap_free(tm->mipmap);
+		tm->mipmap = NULL;
+	}
+	if (tm->overview != NULL) {
+		chunkcache_free(tm->overview);
+		tm->overview = NULL;
+	}
+	if (tm->collision != NULL) {
+		collisiongrid_free(tm->collision);
+		tm->collision = NULL;
+	}
+	if (tm->collision_mesh != NULL) {
+		collisionmesh_free(tm->collision_mesh);
+		tm->collision_mesh = NULL;
+	}
+	if (tm->distance != NULL) {
+		distancefield_free(tm->distance);
+		tm->distance = NULL;
+	}
+	if (tm->shapes != NULL) {
+		tileshapes_free(tm->shapes);
+		tm->shapes = NULL;
+	}
+	free(tm->render_table);
+	tm->render_table = NULL;
+	for (int i = 0; i < tm->plan.len; i++) {
+		if (tm->plan.layers[i].sparse != NULL) {
+			sparselayer_free(tm->plan.layers[i].sparse);
+		}
+		free(tm->plan.layers[i].occluded);
+	}
+	free(tm->plan.layers);
+	tm->plan.layers = NULL;
+	if (tm->parallax != NULL) {
+		parallax_free(tm->parallax);
+		tm->parallax = NULL;
+	}
+	if (tm->atlas != NULL) {
+		atlas_free(tm->atlas);
+		tm->atlas = NULL;
+	}
+	if (tm->map->infinite) {
+		free_tile_stores(tm->map->ly_head);
+	}
 	tmx_map_free(tm->map);
 	tm->map = NULL;
 }
@@ -140,13 +2452,11 @@ int tilemap_tileat(struct tilemap* tm, int x, int y) {
 	if (x < 0 || x >= (int)tm->map->width || y < 0 || y >= (int)tm->map->height) {
 		return 1;
 	}
+	if (tm->stream != NULL) {
+		ensure_resident(tm, x, y);
+	}
 
-	tmx_map* map = tm->map;
-
-	uintmax_t gid;
-	int idx = y * map->width + x;
-	gid = tm->collision_layer->content.gids[idx];
-	return gid;
+	return layer_gid(tm, tm->collision_layer, x, y);
 }
 
 struct tile tilemap_gettile(struct tilemap* tm, float x, float y) {
@@ -167,46 +2477,239 @@ struct tile tilemap_gettile(struct tilemap* tm, float x, float y) {
 	if (tilex < 0 || tilex >= (int)tm->map->width || tiley < 0 || tiley >= (int)tm->map->height) {
 		return t;
 	}
+	if (tm->stream != NULL) {
+		ensure_resident(tm, tilex, tiley);
+	}
 
-	tmx_map* map = tm->map;
-
-	int idx = y * map->width + x;
-	t.gid = tm->collision_layer->content.gids[idx];
+	t.gid = layer_gid(tm, tm->collision_layer, tilex, tiley);
 	return t;
 }
 
-void tilemap_draw_foreground(struct tilemap* tm, struct camera* cam, SDL_Renderer* r) {
-	tmx_map* map = tm->map;
-	bool start_drawing = false;
-	// Iterate over every layer until we hit the 'Main' layer. The foreground
-	// is everything including 'Main', and all layers after (on top of it).
-	for(tmx_layer* layer = map->ly_head; layer != NULL; layer = layer->next) {
-		if (strcmp(LAYER_MAIN, layer->name) == 0) {
-			// So, we found our 'Main' layer. We can start drawing layers.
-			start_drawing = true;
-		}
+bool tilemap_collides(struct tilemap* tm, float x, float y, float w, float h) {
+	int x1, y1, x2, y2;
+	span_tiles(x, x + w, 0, tm->tilewidth, &x1, &x2);
+	span_tiles(y, y + h, 0, tm->tileheight, &y1, &y2);
+	return area_solid(tm, x1, y1, x2, y2) || area_shapes_overlap(tm, x1, y1, x2, y2, x, y, w, h);
+}
 
-		if (start_drawing) {
-			draw_layer(tm, cam, r, layer);
+int tilemap_collide_batch(struct tilemap* tm, const struct box_batch* boxes, struct box_hits* hits) {
+	if (tm->stream != NULL) {
+		for (int i = 0; i < boxes->len; i++) {
+			int x1, y1, x2, y2;
+			span_tiles(boxes->x[i], boxes->x[i] + boxes->w[i], 0, tm->tilewidth, &x1, &x2);
+			span_tiles(boxes->y[i], boxes->y[i] + boxes->h[i], 0, tm->tileheight, &y1, &y2);
+			ensure_area_resident(tm, x1, y1, x2, y2);
 		}
 	}
+
+	return collisiongrid_find_batch(tm->collision, tm->tilewidth, tm->tileheight,
+		boxes->x, boxes->y, boxes->w, boxes->h, boxes->len,
+		hits->mask, hits->tile_x, hits->tile_y);
 }
 
-void tilemap_draw_background(struct tilemap* tm, struct camera* cam, SDL_Renderer* r) {
-	tmx_map* map = tm->map;
-	// Iterate over every layer until we hit the 'Main' layer. The background
-	// is everything up until that 'Main' layer (but not inclusive).
-	for(tmx_layer* layer = map->ly_head; layer != NULL; layer = layer->next) {
-		if (strcmp(LAYER_COLLISION, layer->name) == 0) {
-			// Do not draw our collision layer, that would be stupid.
-			continue;
+bool tilemap_sweep(struct tilemap* tm, float x, float y, float w, float h, float dx, float dy, struct sweep* hit) {
+	const float pos[2] = { x, y };
+	const float ext[2] = { w, h };
+	const float move[2] = { dx, dy };
+	const float size[2] = { tm->tilewidth, tm->tileheight };
+
+	// The column and row the leading sides of the box enter next, and when
+	// they do, as a fraction of the movement.
+	int next[2];
+	int step[2];
+	float t_next[2];
+	for (int a = 0; a < 2; a++) {
+		step[a] = move[a] > 0 ? 1 : -1;
+		if (move[a] > 0) {
+			next[a] = ceilf((pos[a] + ext[a]) / size[a]);
+			t_next[a] = (next[a] * size[a] - pos[a] - ext[a]) / move[a];
+		} else if (move[a] < 0) {
+			next[a] = floorf(pos[a] / size[a]) - 1;
+			t_next[a] = ((next[a] + 1) * size[a] - pos[a]) / move[a];
+		} else {
+			next[a] = 0;
+			t_next[a] = INFINITY;
+		}
+	}
+
+	hit->t = 1.0f;
+	hit->x = x + dx;
+	hit->y = y + dy;
+	hit->normal_x = 0.0f;
+	hit->normal_y = 0.0f;
+
+	bool touched = false;
+	while (!touched) {
+		// On a tie the row goes first, so a box sliding over a floor does
+		// not catch on the seams between its tiles.
+		int a = t_next[1] <= t_next[0] ? 1 : 0;
+		int b = 1 - a;
+		float t = SDL_max(t_next[a], 0.0f);
+		if (t > 1.0f) {
+			break;
 		}
 
-		draw_layer(tm, cam, r, layer);
-		// We draw up until the 'Main' layer. That are our background layers.
-		if (strcmp(LAYER_MAIN, layer->name) == 0) {
+		// The tiles the box enters along the axis it is crossing into.
+		int first, last;
+		float lo = pos[b] + move[b] * t;
+		span_tiles(lo, lo + ext[b], move[b], size[b], &first, &last);
+		bool solid = a == 0
+			? area_solid(tm, next[a], first, next[a], last)
+			: area_solid(tm, first, next[a], last, next[a]);
+
+		if (solid) {
+			// Put the box exactly against the tile, instead of where the
+			// time of impact would put it after rounding.
+			float contact = move[a] > 0 ? next[a] * size[a] - ext[a] : (next[a] + 1) * size[a];
+			hit->t = t;
+			hit->x = a == 0 ? contact : lo;
+			hit->y = a == 1 ? contact : lo;
+			hit->normal_x = a == 0 ? -step[a] : 0;
+			hit->normal_y = a == 1 ? -step[a] : 0;
+			touched = true;
 			break;
 		}
+
+		next[a] += step[a];
+		float edge = move[a] > 0 ? next[a] * size[a] - ext[a] : (next[a] + 1) * size[a];
+		t_next[a] = (edge - pos[a]) / move[a];
+	}
+
+	// The tiles with a shape are tested against the area the box passes up
+	// to where it stopped, which is just a few tiles for a single frame.
+	int x1, y1, x2, y2;
+	float ex = x + dx * hit->t;
+	float ey = y + dy * hit->t;
+	span_tiles(SDL_min(x, ex), SDL_max(x, ex) + w, 0, tm->tilewidth, &x1, &x2);
+	span_tiles(SDL_min(y, ey), SDL_max(y, ey) + h, 0, tm->tileheight, &y1, &y2);
+	return area_shapes_sweep(tm, x1, y1, x2, y2, x, y, w, h, dx, dy, touched, hit) || touched;
+}
+
+int tilemap_solid_rects(struct tilemap* tm, float x, float y, float w, float h, SDL_FRect* rects, int max) {
+	if (tm->stream != NULL) {
+		ensure_area_resident(tm, floorf(x / tm->tilewidth), floorf(y / tm->tileheight),
+			ceilf((x + w) / tm->tilewidth), ceilf((y + h) / tm->tileheight));
+	}
+	return resident_rects(tm, x, y, w, h, rects, max);
+}
+
+bool tilemap_point_solid(struct tilemap* tm, float x, float y) {
+	float tx = x / tm->tilewidth;
+	float ty = y / tm->tileheight;
+	if (tm->stream != NULL) {
+		ensure_area_resident(tm, floorf(tx), floorf(ty), floorf(tx), floorf(ty));
+	}
+	return collisionmesh_contains(tm->collision_mesh, tx, ty);
+}
+
+bool tilemap_segment_solid(struct tilemap* tm, float x1, float y1, float x2, float y2, float* t) {
+	x1 /= tm->tilewidth;
+	y1 /= tm->tileheight;
+	x2 /= tm->tilewidth;
+	y2 /= tm->tileheight;
+	if (tm->stream != NULL) {
+		ensure_area_resident(tm, floorf(SDL_min(x1, x2)), floorf(SDL_min(y1, y2)), floorf(SDL_max(x1, x2)), floorf(SDL_max(y1, y2)));
+	}
+	return collisionmesh_segment(tm->collision_mesh, x1, y1, x2, y2, t);
+}
+
+bool tilemap_raycast(struct tilemap* tm, float x, float y, float dx, float dy, float max_distance, struct ray_hit* hit) {
+	float len = sqrtf(dx * dx + dy * dy);
+	if (len == 0.0f) {
+		return false;
+	}
+	return trace_ray(tm, x, y, dx / len, dy / len, max_distance, hit);
+}
+
+int tilemap_raycast_batch(struct tilemap* tm, float x, float y, const float* dx, const float* dy, int len, float max_distance, uint32_t* mask, struct ray_hit* hits) {
+	memset(mask, 0, ((len + 31) / 32) * sizeof(uint32_t));
+
+	// Every ray starts in the same tile, which only has to be tested once.
+	// When it is solid, that is what all of them hit.
+	struct ray_hit origin;
+	if (trace_origin(tm, x, y, &origin)) {
+		for (int i = 0; i < len; i++) {
+			hits[i] = origin;
+			mask[i >> 5] |= 1u << (i & 31);
+		}
+		return len;
+	}
+
+	int count = 0;
+	for (int i = 0; i < len; i++) {
+		if (tilemap_raycast(tm, x, y, dx[i], dy[i], max_distance, &hits[i])) {
+			mask[i >> 5] |= 1u << (i & 31);
+			count++;
+		}
+	}
+	return count;
+}
+
+float tilemap_clearance(struct tilemap* tm, float x, float y) {
+	const struct distancefield* field = distance_field(tm);
+	if (field == NULL) {
+		return 0.0f;
+	}
+	return clearance_at(tm, field, floorf(x / tm->tilewidth), floorf(y / tm->tileheight), x, y);
+}
+
+bool tilemap_line_of_sight(struct tilemap* tm, float x1, float y1, float x2, float y2) {
+	float dx = x2 - x1;
+	float dy = y2 - y1;
+	float len = sqrtf(dx * dx + dy * dy);
+	struct ray_hit hit;
+	if (len == 0.0f) {
+		return !trace_origin(tm, x1, y1, &hit);
+	}
+
+	// A tile which only starts at the other point does not block the view.
+	return !trace_ray(tm, x1, y1, dx / len, dy / len, len, &hit) || hit.distance >= len;
+}
+
+void tilemap_draw_foreground(struct tilemap* tm, struct camera* cam, SDL_Renderer* r) {
+	// The foreground is the 'Main' layer, and all layers after (on top of it).
+	draw_plan_range(tm, cam, r, tm->scroll_foreground, tm->plan.foreground, tm->plan.len);
+
+	float scale_x = tm->tilewidth / tm->map->tile_width;
+	float scale_y = tm->tileheight / tm->map->tile_height;
+	tm->stats.draw_calls += parallax_draw_foreground(tm->parallax, r, cam, scale_x, scale_y);
+}
+
+void tilemap_draw_background(struct tilemap* tm, struct camera* cam, SDL_Renderer* r) {
+	tilemap_apply_edits(tm);
+	redraw_animated_cells(tm, r);
+
+	float scale_x = tm->tilewidth / tm->map->tile_width;
+	float scale_y = tm->tileheight / tm->map->tile_height;
+	tm->stats.draw_calls += parallax_draw_background(tm->parallax, r, cam, scale_x, scale_y);
+
+	// The background is everything up until the 'Main' layer (not inclusive).
+	draw_plan_range(tm, cam, r, tm->scroll_background, 0, tm->plan.foreground);
+}
+
+void tilemap_draw_debug(struct tilemap* tm, struct camera* cam, SDL_Renderer* r) {
+	SDL_Rect debug_rect = {
+		.x = DEBUG_CELL_X * tm->tilewidth - cam->x,
+		.y = DEBUG_CELL_Y * tm->tileheight - cam->y,
+		.w = tm->tilewidth,
+		.h = tm->tileheight,
+	};
+	SDL_SetRenderDrawColor(r, 0xff, 0xff, 0xff, 0xff);
+	SDL_RenderDrawRect(r, &debug_rect);
+
+	// The outlines of the solid rectangles in view. Drawing them never loads
+	// a region of a streamed map, so only those which are loaded show.
+	SDL_FRect rects[DEBUG_RECTS];
+	int n = resident_rects(tm, cam->x, cam->y, cam->winwidth, cam->winheight, rects, DEBUG_RECTS);
+	SDL_SetRenderDrawColor(r, 0xff, 0x40, 0x40, 0xff);
+	for (int i = 0; i < SDL_min(n, DEBUG_RECTS); i++) {
+		SDL_Rect outline = {
+			.x = rects[i].x - cam->x,
+			.y = rects[i].y - cam->y,
+			.w = rects[i].w,
+			.h = rects[i].h,
+		};
+		SDL_RenderDrawRect(r, &outline);
 	}
 }
 
@@ -214,15 +2717,238 @@ void tilemap_handle_event(struct tilemap* tm, const SDL_Event* event) {
 	// for some quick debugging.
 	if (event->type == SDL_KEYDOWN) {
 		switch (event->key.keysym.sym) {
-		case SDLK_KP_PLUS:
-			tm->tilewidth++;
-			tm->tileheight++;
+		case SDLK_b:
+			tm->batching = !tm->batching;
+			if (tm->chunks != NULL) {
+				chunkcache_invalidate(tm->chunks, tm->tilewidth, tm->tileheight);
+			}
+			break;
+		case SDLK_c:
+			if (tm->chunks == NULL) {
+				tilemap_enable_chunk_cache(tm, CHUNK_CACHE_BUDGET);
+			} else {
+				tilemap_disable_chunk_cache(tm);
+			}
 			break;
-		case SDLK_KP_MINUS:
-			tm->tilewidth--;
-			tm->tileheight--;
+		case SDLK_s:
+			if (tm->scroll_background == NULL) {
+				tilemap_enable_scroll_reuse(tm);
+			} else {
+				tilemap_disable_scroll_reuse(tm);
+			}
 			break;
 		}
+	} else if (event->type == SDL_RENDER_TARGETS_RESET || event->type == SDL_RENDER_DEVICE_RESET) {
+		// The contents of render targets are lost, so rebake every chunk.
+		if (tm->chunks != NULL) {
+			chunkcache_invalidate(tm->chunks, tm->tilewidth, tm->tileheight);
+		}
+		if (tm->scroll_background != NULL) {
+			scrollview_invalidate(tm->scroll_background);
+			scrollview_invalidate(tm->scroll_foreground);
+		}
+		if (tm->overview != NULL) {
+			chunkcache_invalidate(tm->overview, OVERVIEW_TILE_PIXELS, OVERVIEW_TILE_PIXELS);
+		}
+		parallax_invalidate(tm->parallax);
+	}
+}
+
+void tilemap_reset_stats(struct tilemap* tm) {
+	tm->stats.draw_calls = 0;
+	tm->stats.tiles = 0;
+	tm->stats.skipped = 0;
+	tm->stats.mip_level = 0;
+	tm->stats.overview = false;
+}
+
+void tilemap_enable_chunk_cache(struct tilemap* tm, size_t budget) {
+	tilemap_disable_chunk_cache(tm);
+	tm->chunks = chunkcache_create(tm->plan.len, tm->map->width, tm->map->height, CHUNK_TILES, budget);
+	chunkcache_invalidate(tm->chunks, tm->tilewidth, tm->tileheight);
+}
+
+void tilemap_disable_chunk_cache(struct tilemap* tm) {
+	if (tm->chunks != NULL) {
+		chunkcache_free(tm->chunks);
+		tm->chunks = NULL;
+	}
+}
+
+tmx_layer* tilemap_find_layer(const struct tilemap* tm, const char* name) {
+	if (tm->collision_layer != NULL && strcmp(tm->collision_layer->name, name) == 0) {
+		return tm->collision_layer;
+	}
+
+	for (int i = 0; i < tm->plan.len; i++) {
+		const struct plan_layer* pl = &tm->plan.layers[i];
+		if (pl->content == PLAN_TILES && strcmp(pl->layer->name, name) == 0) {
+			return (tmx_layer*)pl->layer;
+		}
+	}
+	return NULL;
+}
+
+bool tilemap_set_tile(struct tilemap* tm, tmx_layer* layer, int x, int y, uint32_t gid) {
+	if (layer == NULL || layer->type != L_LAYER) {
+		return false;
+	}
+	if (x < 0 || x >= (int)tm->map->width || y < 0 || y >= (int)tm->map->height) {
+		return false;
+	}
+	if (tile_render_index(gid) >= tm->render_table_len) {
+		debug_print("Cannot set tile (%d, %d) of '%s' to invalid gid %u\n", x, y, layer->name, gid & TMX_FLIP_BITS_REMOVAL);
+		return false;
+	}
+
+	if (tm->stream != NULL) {
+		// Evicting the region would lose the edit, so it stays.
+		ensure_resident(tm, x, y)->edited = true;
+	}
+
+	size_t idx = (size_t)y * tm->map->width + x;
+	uint32_t old = layer_gid(tm, layer, x, y);
+	if (old == gid) {
+		return true;
+	}
+
+	// The grid goes first. The layer only fails to take a tile which is not
+	// empty, and its block in the grid then stays, so undoing never fails.
+	if (layer == tm->collision_layer &&
+		!collisiongrid_set(tm->collision, x, y, (gid & TMX_FLIP_BITS_REMOVAL) != 0, tileshapes_partial(tm->shapes, gid))) {
+		return false;
+	}
+	if (tm->map->infinite) {
+		if (!tilestore_set(layer->user_data.pointer, x, y, gid)) {
+			if (layer == tm->collision_layer) {
+				collisiongrid_set(tm->collision, x, y, (old & TMX_FLIP_BITS_REMOVAL) != 0, tileshapes_partial(tm->shapes, old));
+			}
+			return false;
+		}
+	} else {
+		layer->content.gids[idx] = gid;
+	}
+
+	// What is derived from a single layer is updated right away, since that
+	// is cheap.
+	if (layer == tm->collision_layer) {
+		collisionmesh_dirty(tm->collision_mesh, x, y, x, y);
+		if (tm->distance != NULL) {
+			distancefield_mark(tm->distance, x, y);
+		}
+	}
+	for (int i = 0; i < tm->plan.len; i++) {
+		struct plan_layer* pl = &tm->plan.layers[i];
+		if (pl->layer != layer) {
+			continue;
+		}
+		if (pl->sparse != NULL) {
+			sparselayer_set(pl->sparse, x, y, gid);
+		}
+		pl->transform = SDL_max(pl->transform, gid_transform(gid));
+		if (tm->anims != NULL) {
+			struct anim_tile* t = animtable_find(tm->anims, old);
+			if (t != NULL) {
+				animtable_remove_cell(t, i, idx);
+			}
+			t = animtable_find(tm->anims, gid);
+			if (t != NULL) {
+				animtable_add_cell(t, i, idx);
+			}
+		}
+		if (tm->chunks != NULL) {
+			int n = tm->chunks->chunk_tiles;
+			chunkcache_dirty(tm->chunks, i, x / n, y / n);
+		}
+		if (tm->overview != NULL) {
+			int n = tm->overview->chunk_tiles;
+			chunkcache_dirty(tm->overview, i < tm->plan.foreground ? 0 : 1, x / n, y / n);
+		}
+	}
+
+	// What depends on other layers as well is updated before the next
+	// frame, once per edited cell, however often it was edited.
+	mark_edited(tm, x, y);
+	return true;
+}
+
+void tilemap_apply_edits(struct tilemap* tm) {
+	distance_field(tm);
+	if (tm->edited == NULL || tm->edited->len == 0) {
+		return;
+	}
+
+	for (uint32_t s = 0; s < tm->edited->capacity; s++) {
+		const struct coordmap_slot* slot = &tm->edited->slots[s];
+		uint32_t* rows = slot->value;
+		if (rows == NULL) {
+			continue;
+		}
+		for (int j = 0; j < EDIT_BLOCK; j++) {
+			for (uint32_t bits = rows[j]; bits != 0; bits &= bits - 1) {
+				int x = slot->x * EDIT_BLOCK + __builtin_ctz(bits);
+				int y = slot->y * EDIT_BLOCK + j;
+				size_t idx = (size_t)y * tm->map->width + x;
+				update_occlusion(tm, idx);
+				update_scroll_views(tm, idx);
+			}
+		}
+		free(rows);
+	}
+	coordmap_clear(tm->edited);
+}
+
+bool tilemap_animate(struct tilemap* tm, uint32_t ticks) {
+	if (tm->anims == NULL || !animtable_advance(tm->anims, ticks)) {
+		return false;
+	}
+
+	bool visible = false;
+	for (int i = 0; i < tm->anims->len; i++) {
+		const struct anim_tile* t = &tm->anims->tiles[i];
+		if (!t->changed) {
+			continue;
+		}
+
+		// Point the gid to the current frame, in every orientation.
+		uint32_t frame = t->frames[t->current];
+		for (uint32_t orientation = 0; orientation < 8; orientation++) {
+			struct tile_render* tr = &tm->render_table[(t->gid << 3) | orientation];
+			*tr = tm->render_frames[(frame << 3) | orientation];
+			tr->animated = true;
+			for (int level = 1; tm->mipmap != NULL && level <= tm->mipmap->levels; level++) {
+				update_mip_entry(tm, level, (t->gid << 3) | orientation);
+			}
+		}
+
+		if (tm->anim_pending_len + t->cells_len > tm->anim_pending_capacity) {
+			tm->anim_pending_capacity = 2 * tm->anim_pending_capacity + t->cells_len;
+			tm->anim_pending = realloc(tm->anim_pending, tm->anim_pending_capacity * sizeof(struct anim_cell));
+		}
+		memcpy(&tm->anim_pending[tm->anim_pending_len], t->cells, t->cells_len * sizeof(struct anim_cell));
+		tm->anim_pending_len += t->cells_len;
+
+		visible = visible || t->cells_len > 0;
+	}
+	return visible;
+}
+
+uint32_t tilemap_animation_deadline(const struct tilemap* tm) {
+	return tm->anims != NULL ? tm->anims->deadline : UINT32_MAX;
+}
+
+void tilemap_enable_scroll_reuse(struct tilemap* tm) {
+	tilemap_disable_scroll_reuse(tm);
+	tm->scroll_background = scrollview_create();
+	tm->scroll_foreground = scrollview_create();
+}
+
+void tilemap_disable_scroll_reuse(struct tilemap* tm) {
+	if (tm->scroll_background != NULL) {
+		scrollview_free(tm->scroll_background);
+		scrollview_free(tm->scroll_foreground);
+		tm->scroll_background = NULL;
+		tm->scroll_foreground = NULL;
 	}
 }
 
@@ -230,3 +2956,127 @@ void tilemap_getsize(const struct tilemap* tm, int* w, int* h) {
 	*w = tm->tilewidth  * tm->map->width;
 	*h = tm->tileheight * tm->map->height;
 }
+
+bool tilemap_visible_range(const struct tilemap* tm, const struct camera* cam, struct tilerange* range) {
+	return visible_range_at(tm, cam->x, cam->y, cam->winwidth, cam->winheight, range);
+}
+
+bool tilemap_stream(struct tilemap* tm, const struct camera* cam, float vx, float vy) {
+	struct tilemap_stream* st = tm->stream;
+	if (st == NULL) {
+		return false;
+	}
+
+	bool changed = false;
+	struct region* rg;
+	while ((rg = streamer_poll(st->streamer)) != NULL) {
+		// Regions which were evicted, or read right away, in the meantime
+		// are dropped.
+		struct region_slot* slot = find_region(st, rg->rx, rg->ry);
+		if (slot != NULL && !slot->resident) {
+			insert_region(tm, rg);
+			slot->resident = true;
+			changed = true;
+		}
+		region_free(rg);
+	}
+
+	if (tm->tilewidth <= 0 || tm->tileheight <= 0) {
+		return changed;
+	}
+
+	// The regions around the camera, and around where it is heading. Those
+	// around the camera go first, since they are needed soonest.
+	float ax = cam->x + vx * STREAM_LOOKAHEAD;
+	float ay = cam->y + vy * STREAM_LOOKAHEAD;
+	struct tilerange near;
+	struct tilerange ahead;
+	stream_range(tm, cam, cam->x, cam->y, STREAM_LOAD_MARGIN, &near);
+	stream_range(tm, cam, ax, ay, STREAM_LOAD_MARGIN, &ahead);
+	if (request_regions(tm, &near)) {
+		request_regions(tm, &ahead);
+	}
+
+	stream_range(tm, cam, cam->x, cam->y, STREAM_EVICT_MARGIN, &near);
+	stream_range(tm, cam, ax, ay, STREAM_EVICT_MARGIN, &ahead);
+	for (int i = st->slots_len - 1; i >= 0; i--) {
+		struct region_slot* slot = &st->slots[i];
+		if (slot->edited || in_range(&near, slot->rx, slot->ry) || in_range(&ahead, slot->rx, slot->ry)) {
+			continue;
+		}
+		if (slot->resident) {
+			evict_region(tm, slot->rx, slot->ry);
+		}
+		st->slots[i] = st->slots[--st->slots_len];
+	}
+
+	return changed;
+}
+
+bool tilemap_write_regions(const struct tilemap* tm, const char* path) {
+	if (!tm->map->infinite || tm->stream != NULL) {
+		fprintf(stderr, "Only infinite maps which are loaded at once can be split into regions\n");
+		return false;
+	}
+
+	tmx_layer** layers = NULL;
+	int layers_len = 0;
+	collect_tile_layers(tm->map->ly_head, &layers, &layers_len);
+
+	// Every store has the same chunk size, and there is at least the
+	// collision layer.
+	const struct tilestore* first = layers[0]->user_data.pointer;
+	struct region_index ri = {
+		.chunk_w = first->chunk_w,
+		.chunk_h = first->chunk_h,
+		.region_chunks = REGION_CHUNKS,
+		.origin_x = tm->origin_x,
+		.origin_y = tm->origin_y,
+		.width = tm->map->width,
+		.height = tm->map->height,
+		.layers = malloc(layers_len * sizeof(char*)),
+		.layers_len = layers_len,
+	};
+	for (int i = 0; i < layers_len; i++) {
+		ri.layers[i] = layers[i]->name;
+	}
+
+	int span_x = REGION_CHUNKS * ri.chunk_w;
+	int span_y = REGION_CHUNKS * ri.chunk_h;
+	int regions_w = (ri.width + span_x - 1) / span_x;
+	int regions_h = (ri.height + span_y - 1) / span_y;
+	ri.regions = malloc(regions_w * regions_h * sizeof(struct region_coord));
+
+	// The regions are written in the order the index keeps them in. The
+	// chunks are borrowed from the stores.
+	struct region_chunk* chunks = malloc(layers_len * REGION_CHUNKS * REGION_CHUNKS * sizeof(struct region_chunk));
+	bool ok = true;
+	for (int ry = 0; ok && ry < regions_h; ry++) {
+		for (int rx = 0; ok && rx < regions_w; rx++) {
+			struct region rg = { rx, ry, chunks, 0 };
+			for (int l = 0; l < layers_len; l++) {
+				for (int cy = ry * REGION_CHUNKS; cy < (ry + 1) * REGION_CHUNKS; cy++) {
+					for (int cx = rx * REGION_CHUNKS; cx < (rx + 1) * REGION_CHUNKS; cx++) {
+						const struct tilestore_chunk* c = tilestore_find(layers[l]->user_data.pointer, cx, cy);
+						if (c != NULL) {
+							chunks[rg.len++] = (struct region_chunk){ l, cx, cy, c->chunk->gids };
+						}
+					}
+				}
+			}
+			if (rg.len > 0) {
+				ok = region_write(&rg, path, &ri);
+				ri.regions[ri.regions_len++] = (struct region_coord){ rx, ry };
+			}
+		}
+	}
+
+	ok = ok && region_index_write(&ri, path);
+	debug_print("Split %s into %d regions\n", path, ri.regions_len);
+
+	free(chunks);
+	free(ri.regions);
+	free(ri.layers);
+	free(layers);
+	return ok;
+}
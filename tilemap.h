@@ -1,13 +1,31 @@
 #ifndef TILEMAP_H
 #define TILEMAP_H
 
+#include "alphamap.h"
 #include "camera.h"
+#include "mipmap.h"
 #include "tmx/tmx.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include <SDL.h>
 
+struct anim_cell;
+struct animtable;
+struct atlas;
+struct chunkcache;
+struct coordmap;
+struct parallax;
+struct region_index;
+struct scrollview;
+struct sparselayer;
+struct streamer;
+struct tilebatch;
+struct tilestore;
+struct tileshapes;
+struct distancefield;
+
 /*
  * Contains data for a single tile.
  */
@@ -16,6 +34,198 @@ struct tile {
 	SDL_Rect r; // The tile dimensions.
 };
 
+/*
+ * Where a box moving through the collision layer first touched a solid tile.
+ */
+struct sweep {
+	float t;        // The fraction of the movement made, 1 when nothing was touched.
+	float x;        // The position of the box then. Along the normal, it lies
+	float y;        // exactly against the tile, or a hair off a shaped one.
+	float normal_x; // The side of the tile which was touched, pointing out of
+	float normal_y; // it, or 0 along both axes when nothing was. Only shaped
+	                // tiles have sides which are not along an axis.
+};
+
+/*
+ * A batch of boxes in world units, as a structure of arrays: box i is at
+ * (x[i], y[i]) and w[i] x h[i] large.
+ */
+struct box_batch {
+	const float* x;
+	const float* y;
+	const float* w;
+	const float* h;
+	int len;
+};
+
+/*
+ * What tilemap_collide_batch found for a batch of boxes. Bit i of `mask' is
+ * set when box i collides. The first solid tile it overlaps, going row by row,
+ * is then put in (tile_x[i], tile_y[i]). That is a tile just outside of the
+ * map when the box left it. The tiles may be NULL.
+ */
+struct box_hits {
+	uint32_t* mask; // (len + 31) / 32 words.
+	int* tile_x;
+	int* tile_y;
+};
+
+/*
+ * Where a ray cast through the collision layer hit a solid tile.
+ */
+struct ray_hit {
+	int tile_x;     // The tile which was hit, which is just outside of the
+	int tile_y;     // map when the ray left it.
+	float x;        // The point where the ray entered the tile.
+	float y;
+	float distance; // From the origin of the ray to that point.
+	float normal_x; // The side of the tile which was hit, pointing out of it.
+	float normal_y; // Both are 0 when the ray starts inside the tile.
+};
+
+/*
+ * An inclusive range of tile indexes. Used to limit the amount of tiles to
+ * visit to only those which can be seen through the camera.
+ */
+struct tilerange {
+	int x1, y1; // top-left tile index
+	int x2, y2; // bottom-right tile index
+};
+
+/*
+ * Everything needed to draw a tile, decoded once when the map is loaded. There
+ * is one of these for every gid and every combination of the flip bits.
+ */
+struct tile_render {
+	SDL_Texture* texture;     // The tileset texture, NULL for empty tiles.
+	SDL_Rect src;             // The source rectangle within the texture.
+	double rotate;            // The rotation in degrees, for SDL_RenderCopyEx.
+	SDL_RendererFlip flip;    // The flip, for SDL_RenderCopyEx.
+	unsigned int orientation; // The flip bits as tile_orientation flags.
+	enum alpha_class alpha;   // Whether the tile is empty, opaque or neither.
+	bool animated;            // Whether this entry follows an animation.
+	uint32_t tile;            // The gid whose pixels are drawn, which is the
+	                          // current frame for animated entries.
+};
+
+/*
+ * Returns the index in the render table for the given gid, which may include
+ * the TMX flip bits.
+ */
+static inline uint32_t tile_render_index(uint32_t gid) {
+	return ((gid & TMX_FLIP_BITS_REMOVAL) << 3) | (gid >> 29);
+}
+
+/*
+ * What a layer in the draw plan consists of.
+ */
+enum plan_content {
+	PLAN_TILES, // A tile layer, drawn from its gids.
+	PLAN_IMAGE, // An image layer, drawn as a single texture.
+};
+
+/*
+ * Which of the tile transforms a layer needs, worked out from the flip bits of
+ * its tiles. Every transform has a draw routine of its own, which leaves out
+ * the work the layer does not need.
+ */
+enum plan_transform {
+	TRANSFORM_NONE, // No tile is flipped.
+	TRANSFORM_FLIP, // Tiles are flipped horizontally or vertically only.
+	TRANSFORM_FULL, // Tiles are flipped diagonally, so they are rotated too.
+	TRANSFORM_COUNT,
+};
+
+/*
+ * A layer to draw, with everything needed to draw it resolved when the map is
+ * loaded. Layers in groups are flattened, with the opacity and offsets of the
+ * groups they are in applied to them.
+ */
+struct plan_layer {
+	enum plan_content content;
+	const tmx_layer* layer; // The layer in the TMX map.
+	int index;              // The index of this layer in the draw plan.
+
+	uint8_t opacity; // The opacity, including the opacity of parent groups.
+	int offsetx;     // The x offset in map pixels, including parent groups.
+	int offsety;     // The y offset in map pixels, including parent groups.
+
+	// PLAN_TILES: the gids of the layer. Mostly empty layers also have a
+	// sparse list of their tiles, which is used to draw them instead. The
+	// layers of infinite maps have no gids, but a store of their chunks.
+	const uint32_t* gids;
+	struct sparselayer* sparse;
+	struct tilestore* store;
+
+	// PLAN_TILES: the transforms the tiles of the layer need. Edits and
+	// streamed chunks may add to them, but never take any away.
+	enum plan_transform transform;
+
+	// PLAN_TILES: a bit per cell, set when the cell is completely covered
+	// by an opaque tile in a layer drawn later. NULL if no cell is covered.
+	// The chunks of a store have bits of their own.
+	uint32_t* occluded;
+
+	// PLAN_IMAGE: the image of the layer, and its size in map pixels.
+	struct {
+		SDL_Texture* texture;
+		int w;
+		int h;
+	} image;
+};
+
+/*
+ * The draw plan contains the layers to draw, in the order to draw them in.
+ * Hidden layers, layers without opacity, object groups, parallax layers and the
+ * collision layer are left out.
+ */
+struct drawplan {
+	struct plan_layer* layers; // Background layers, followed by foreground layers.
+	int len;                   // Amount of layers.
+	int foreground;            // Index of the first foreground layer.
+
+	tmx_layer* collision; // The layer named 'Collision'.
+};
+
+/*
+ * Counters of the work done to draw the tilemap, for debugging purposes.
+ * These are accumulated until tilemap_reset_stats is called.
+ */
+struct tilemap_stats {
+	int draw_calls; // Amount of draw calls issued to the renderer.
+	int tiles;      // Amount of tiles drawn.
+	int skipped;    // Amount of empty or completely covered tiles skipped.
+	int mip_level;  // The mip level the tiles were drawn from.
+	bool overview;  // Whether the layers were drawn from overview chunks.
+};
+
+/*
+ * A region of a streamed map which is resident, or being loaded.
+ */
+struct region_slot {
+	int rx;        // The region coordinate (in regions, not chunks or tiles).
+	int ry;
+	bool resident; // False while the loader is still reading it.
+	bool edited;   // Edited regions are never evicted, so edits are not lost.
+};
+
+/*
+ * Streams the regions of an infinite map, which was split into region files
+ * with tilemap_write_regions. Only the regions near the camera are resident.
+ */
+struct tilemap_stream {
+	char* path;
+	struct region_index* index;
+	struct streamer* streamer;
+
+	tmx_layer** layers; // The tile layers, in the order of the index.
+	int layers_len;
+
+	struct region_slot* slots; // The regions which are resident or requested.
+	int slots_len;
+	int slots_capacity;
+};
+
 /*
  * The tilemap.
  */
@@ -23,11 +233,116 @@ struct tilemap {
 	tmx_map* map;
 	tmx_layer* collision_layer;
 
+	// The collision layer, a bit per tile. Edits to the layer are made to
+	// it as well.
+	struct collisiongrid* collision;
+
+	// The collision shapes of the tiles, for slopes and other tiles which
+	// are only partly solid. NULL when every tile is solid all over.
+	struct tileshapes* shapes;
+
+	// The solid tiles of the collision grid merged into rectangles, for
+	// queries which would otherwise visit a lot of tiles. The blocks of it
+	// which changed along with the grid are merged again when needed.
+	struct collisionmesh* collision_mesh;
+
+	// How far every tile of the collision grid is from the nearest solid
+	// tile, updated around the edits when it is next used, or by
+	// tilemap_apply_edits. NULL for infinite maps, and when it could not be
+	// allocated.
+	struct distancefield* distance;
+
+	// Infinite maps may have tiles at negative coordinates. The tiles of the
+	// tilemap start at the top-left chunk, which is at this TMX coordinate
+	// (in tiles). Both are 0 for other maps.
+	int origin_x;
+	int origin_y;
+
+	// The regions of a streamed map, or NULL when it was loaded at once.
+	struct tilemap_stream* stream;
+
+	// The pages the tilesets were packed into, or NULL when they still use
+	// a texture per image.
+	struct atlas* atlas;
+
+	// Which layers to draw, and how.
+	struct drawplan plan;
+
+	// The image layers which scroll at a speed of their own. These are left
+	// out of the draw plan.
+	struct parallax* parallax;
+
+	// The animated tiles, or NULL when there are none. The render table entries
+	// of an animated gid are replaced by those of its current frame, which are
+	// copied from `render_frames': the render table as it was loaded.
+	struct animtable* anims;
+	struct tile_render* render_frames;
+
+	// Cells whose frame changed, which have to be drawn again in caches.
+	struct anim_cell* anim_pending;
+	int anim_pending_len;
+	int anim_pending_capacity;
+
+	// The render table, indexed using tile_render_index. Every gid in the
+	// layers is guaranteed to be within the table.
+	struct tile_render* render_table;
+	uint32_t render_table_len;
+
+	// The mip levels of the tiles, or NULL when there are none, and a render
+	// table per level which points into their pages. Those follow the
+	// animations of the render table. The tiles are drawn from `draw_table':
+	// the render table of the level which fits the size they are drawn at.
+	struct mipmap* mipmap;
+	struct tile_render* mip_tables[MIPMAP_LEVELS];
+	const struct tile_render* draw_table;
+
+	// Baked chunks of the layers. NULL when the chunk cache is disabled.
+	struct chunkcache* chunks;
+
+	// When zoomed out far, the layers behind the player (layer 0) and those
+	// in front of it (layer 1) are drawn from chunks of this cache, which
+	// are baked at a few pixels per tile. NULL until it is needed.
+	struct chunkcache* overview;
+
+	// What was drawn of the background and foreground in the previous frame,
+	// so only the parts which scrolled into view have to be drawn. Both are
+	// NULL when scroll reuse is disabled.
+	struct scrollview* scroll_background;
+	struct scrollview* scroll_foreground;
+	float scroll_tilewidth;  // The tile size the views were drawn with.
+	float scroll_tileheight;
+
+	// Collects tiles to draw a layer in a single draw call per texture. When
+	// batching is disabled, every tile is drawn with its own copy.
+	struct tilebatch* batch;
+	bool batching;
+
+	struct tilemap_stats stats;
+
+	// The cells edited since the edits were applied last, as a bit per cell
+	// in blocks of cells, keyed on the block. NULL until the first edit.
+	struct coordmap* edited;
+
 	float tilewidth;
 	float tileheight;
 };
 
-struct tilemap* tilemap_create(const char* path);
+/*
+ * Loads the map at the given path. When a renderer is given, the tilesets are
+ * packed into an atlas, so tiles of different tilesets share their texture.
+ *
+ * The tile layers of infinite maps are kept in chunks, which only exist where
+ * there are tiles. The size of such a map is the area its chunks span.
+ */
+struct tilemap* tilemap_create(const char* path, SDL_Renderer* r);
+
+/*
+ * Loads an infinite map which was split into regions, without its chunks. The
+ * regions are loaded in the background by tilemap_stream as the camera comes
+ * near them. Collision checks and edits do not have to know about this: a
+ * region they touch which is not in yet is read right away.
+ */
+struct tilemap* tilemap_create_streamed(const char* path, SDL_Renderer* r);
 void tilemap_free(struct tilemap* tm);
 int tilemap_tileat(struct tilemap* tm, int x, int y);
 
@@ -35,9 +350,178 @@ int tilemap_tileat(struct tilemap* tm, int x, int y);
  * Gets the tile data for the tile which is occupied at the given x and y position.
  */
 struct tile tilemap_gettile(struct tilemap* tm, float x, float y);
+
+/*
+ * Whether the box at (x, y) of w x h world units overlaps a solid tile of the
+ * collision layer, or lies (partly) outside of the map. A box which only
+ * touches a tile does not overlap it. Tiles with a collision shape are solid
+ * where their shape is.
+ */
+bool tilemap_collides(struct tilemap* tm, float x, float y, float w, float h);
+
+/*
+ * Tests a whole batch of boxes like tilemap_collides does, which is a lot
+ * cheaper per box than testing them one by one. Tiles with a collision shape
+ * count as solid all over. Returns the amount of boxes which collide.
+ */
+int tilemap_collide_batch(struct tilemap* tm, const struct box_batch* boxes, struct box_hits* hits);
+
+/*
+ * Moves the box at (x, y) of w x h world units by (dx, dy) through the
+ * collision layer, until it touches a solid tile. Only the columns and rows
+ * of tiles the box passes are visited, so a long movement does not tunnel
+ * through thin walls. Tiles the box overlaps at the start are ignored.
+ *
+ * Tiles which are solid all over are stopped at along the columns and rows.
+ * Of the tiles with a collision shape, only those within the area the box
+ * passes are tested against their polygons.
+ *
+ * Returns whether a tile was touched, and fills in the hit either way.
+ */
+bool tilemap_sweep(struct tilemap* tm, float x, float y, float w, float h, float dx, float dy, struct sweep* hit);
+
+/*
+ * Finds the solid rectangles of the collision layer which overlap the box at
+ * (x, y) of w x h world units. At most `max' of them are put in `rects', in
+ * world units, but all of them are counted. Tiles outside of the map are not
+ * found, unlike with tilemap_collides. This and the two below take tiles with a
+ * collision shape for whole ones.
+ */
+int tilemap_solid_rects(struct tilemap* tm, float x, float y, float w, float h, SDL_FRect* rects, int max);
+
+/*
+ * Whether the point (x, y) in world units is inside a solid tile.
+ */
+bool tilemap_point_solid(struct tilemap* tm, float x, float y);
+
+/*
+ * Whether the segment from (x1, y1) to (x2, y2) in world units enters a solid
+ * tile. If so, `t' is set to the fraction of the segment before it.
+ */
+bool tilemap_segment_solid(struct tilemap* tm, float x1, float y1, float x2, float y2, float* t);
+
+/*
+ * Casts a ray from (x, y) in the direction (dx, dy), which does not have to be
+ * of unit length, up to `max_distance' world units far. The tiles are tested
+ * against the collision grid one by one in the order the ray passes them, so
+ * the ray sees what the player collides with, including the shapes of tiles.
+ * Returns whether it hit one.
+ */
+bool tilemap_raycast(struct tilemap* tm, float x, float y, float dx, float dy, float max_distance, struct ray_hit* hit);
+
+/*
+ * Casts `len' rays from (x, y), ray i in the direction (dx[i], dy[i]), such as
+ * for the vision of an enemy or a light. Bit i of `mask' is set when ray i hit
+ * a tile, and hits[i] is filled in then. Returns the amount of hits.
+ */
+int tilemap_raycast_batch(struct tilemap* tm, float x, float y, const float* dx, const float* dy, int len, float max_distance, uint32_t* mask, struct ray_hit* hits);
+
+/*
+ * Returns how far the point (x, y) is from the nearest solid tile at least, in
+ * world units, such as for steering away from walls. A circle that large
+ * around the point is free. The distance is worked out from the distance
+ * field, so it is cheap, but it is never more than the real distance: it may
+ * fall short by a tile or so, most of all towards walls lying diagonally. It is
+ * 0 inside a solid tile, outside of the map, or on an infinite map.
+ */
+float tilemap_clearance(struct tilemap* tm, float x, float y);
+
+/*
+ * Whether (x2, y2) can be seen from (x1, y1), without any solid tile between.
+ */
+bool tilemap_line_of_sight(struct tilemap* tm, float x1, float y1, float x2, float y2);
+
 void tilemap_draw_foreground(struct tilemap* tm, struct camera* cam, SDL_Renderer* r);
 void tilemap_draw_background(struct tilemap* tm, struct camera* cam, SDL_Renderer* r);
+
+/*
+ * Draws what helps debugging the map through the camera, such as the outline
+ * of the highlighted cell and of the solid rectangles.
+ */
+void tilemap_draw_debug(struct tilemap* tm, struct camera* cam, SDL_Renderer* r);
 void tilemap_handle_event(struct tilemap* tm, const SDL_Event* event);
 void tilemap_getsize(const struct tilemap* tm, int* w, int* h);
 
+/*
+ * Converts the camera rectangle to the range of tile indexes which are visible,
+ * including a margin of one tile around it. The range is clamped to the map
+ * bounds. Returns false when no tile of the map is visible at all.
+ */
+bool tilemap_visible_range(const struct tilemap* tm, const struct camera* cam, struct tilerange* range);
+
+/*
+ * Resets the draw statistics. Call this at the start of every frame.
+ */
+void tilemap_reset_stats(struct tilemap* tm);
+
+/*
+ * Enables the chunk cache. Every layer is baked into textures of a fixed
+ * amount of tiles the first time they come into view, and only those textures
+ * are drawn afterwards. The `budget' is the maximum texture memory in bytes the
+ * chunks may use; the least recently used chunks are discarded when baking a
+ * new one would exceed it. Chunks are baked again when the tile size changes.
+ */
+void tilemap_enable_chunk_cache(struct tilemap* tm, size_t budget);
+void tilemap_disable_chunk_cache(struct tilemap* tm);
+
+/*
+ * Finds the tile layer with the given name, including the collision layer.
+ * Returns NULL when there is no such layer.
+ */
+tmx_layer* tilemap_find_layer(const struct tilemap* tm, const char* name);
+
+/*
+ * Sets the tile at (x, y) of a tile layer to the gid, which may include the TMX
+ * flip bits. Chunks of the layer which contain the tile are baked again when
+ * they come into view, and whatever depends on other layers as well is
+ * updated by tilemap_apply_edits. This way the cost of a batch of edits
+ * depends on the amount of edited tiles, not on the size of the map.
+ *
+ * Returns false when the layer, position or gid is invalid.
+ */
+bool tilemap_set_tile(struct tilemap* tm, tmx_layer* layer, int x, int y, uint32_t gid);
+
+/*
+ * Brings everything up to date with the tiles set since the previous call. This
+ * is done when drawing the background, so it only has to be called to get up
+ * to date before that.
+ */
+void tilemap_apply_edits(struct tilemap* tm);
+
+/*
+ * Moves every animated tile to its frame at the given tick (as in
+ * SDL_GetTicks). Returns true when a frame changed of a tile which is used in
+ * the map, so the map looks different.
+ */
+bool tilemap_animate(struct tilemap* tm, uint32_t ticks);
+
+/*
+ * Returns the tick at which the frame of an animated tile changes next, or
+ * UINT32_MAX when nothing is animated.
+ */
+uint32_t tilemap_animation_deadline(const struct tilemap* tm);
+
+/*
+ * Keeps the background and foreground of the previous frame in render targets.
+ * When the camera scrolls, only the tiles which came into view are drawn, and
+ * when it does not move, nothing is drawn. This pays off with the software
+ * renderer, where drawing tiles is expensive.
+ */
+void tilemap_enable_scroll_reuse(struct tilemap* tm);
+void tilemap_disable_scroll_reuse(struct tilemap* tm);
+
+/*
+ * Picks up the regions the loader finished, requests the regions around the
+ * camera and around where its velocity (in pixels per second) takes it, and
+ * evicts the regions far from both. Call this every frame. Returns true when
+ * a region came in, so the map may look different.
+ */
+bool tilemap_stream(struct tilemap* tm, const struct camera* cam, float vx, float vy);
+
+/*
+ * Splits an infinite map which was loaded at once into region files, next to
+ * `path', so it can be loaded with tilemap_create_streamed.
+ */
+bool tilemap_write_regions(const struct tilemap* tm, const char* path);
+
 #endif // TILEMAP_H
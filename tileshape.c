@@ -0,0 +1,497 @@
+#include "tilebatch.h"
+#include "tilemap.h"
+#include "tileshape.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// A shape covering at least this much of a tile covers all of it.
+static const float FULL_AREA = 0.999f;
+
+// How far a box may be inside a polygon, in world units, and still be stopped
+// by it. Rounding leaves a box about that far in after it was stopped.
+static const float SKIN = 0.01f;
+
+// Movement into a polygon smaller than this, in world units, is rounding too.
+static const float CREEP = 0.0001f;
+
+// The points of the polygon which replaces an ellipse.
+#define ELLIPSE_POINTS 8
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+static inline float cross(const struct point* o, const struct point* a, const struct point* b) {
+	return (a->x - o->x) * (b->y - o->y) - (a->y - o->y) * (b->x - o->x);
+}
+
+static int compare_points(const void* a, const void* b) {
+	const struct point* pa = a;
+	const struct point* pb = b;
+	if (pa->x != pb->x) {
+		return pa->x < pb->x ? -1 : 1;
+	}
+	if (pa->y != pb->y) {
+		return pa->y < pb->y ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Puts the convex hull of the points in `hull', which must have room for one
+ * more point than there are. The points are sorted along the way. Returns the
+ * amount of points of the hull.
+ */
+static int convex_hull(struct point* p, int len, struct point* hull) {
+	qsort(p, len, sizeof(struct point), compare_points);
+
+	// The lower half from left to right, then the upper half back.
+	int n = 0;
+	for (int i = 0; i < len; i++) {
+		while (n >= 2 && cross(&hull[n - 2], &hull[n - 1], &p[i]) <= 0) {
+			n--;
+		}
+		hull[n++] = p[i];
+	}
+	int lower = n + 1;
+	for (int i = len - 2; i >= 0; i--) {
+		while (n >= lower && cross(&hull[n - 2], &hull[n - 1], &p[i]) <= 0) {
+			n--;
+		}
+		hull[n++] = p[i];
+	}
+
+	// The last point is the first one again.
+	return SDL_max(n - 1, 0);
+}
+
+static inline float coord(const struct point* p, int axis) {
+	return axis == 0 ? p->x : p->y;
+}
+
+/*
+ * Cuts off the part of the polygon `in' on the wrong side of `bound' along an
+ * axis, which is the side below it when `side' is 1, and above it when it is
+ * -1. The polygon `out' needs room for one more point than `in' has. Returns
+ * the amount of points left.
+ */
+static int clip(const struct point* in, int len, struct point* out, int axis, float bound, float side) {
+	int n = 0;
+	for (int i = 0; i < len; i++) {
+		const struct point* a = &in[i];
+		const struct point* b = &in[(i + 1) % len];
+		float da = side * (coord(a, axis) - bound);
+		float db = side * (coord(b, axis) - bound);
+		if (da >= 0) {
+			out[n++] = *a;
+		}
+		if ((da >= 0) != (db >= 0)) {
+			float f = da / (da - db);
+			out[n++] = (struct point){ a->x + (b->x - a->x) * f, a->y + (b->y - a->y) * f };
+		}
+	}
+	return n;
+}
+
+/*
+ * Drops the points which are (nearly) the same as the one before them, which
+ * would make sides without a direction.
+ */
+static int drop_duplicates(struct point* p, int len) {
+	int n = 0;
+	for (int i = 0; i < len; i++) {
+		const struct point* prev = n > 0 ? &p[n - 1] : &p[len - 1];
+		if (len > 1 && fabsf(p[i].x - prev->x) < 1e-5f && fabsf(p[i].y - prev->y) < 1e-5f) {
+			continue;
+		}
+		p[n++] = p[i];
+	}
+	return n;
+}
+
+static float area(const struct point* p, int len) {
+	float sum = 0.0f;
+	for (int i = 0; i < len; i++) {
+		sum += cross(&(struct point){ 0.0f, 0.0f }, &p[i], &p[(i + 1) % len]);
+	}
+	return fabsf(sum) / 2.0f;
+}
+
+/*
+ * Returns the amount of points a collision object needs, or 0 when it is not
+ * one with an area.
+ */
+static int object_len(const tmx_object* o) {
+	switch (o->obj_type) {
+	case OT_SQUARE:
+		return 4;
+	case OT_ELLIPSE:
+		return ELLIPSE_POINTS;
+	case OT_POLYGON:
+		return o->content.shape->points_len;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Puts the points of a collision object in `p', in tiles of tile_w x tile_h
+ * pixels. Tiled rotates an object clockwise around its position.
+ */
+static void object_points(const tmx_object* o, float tile_w, float tile_h, struct point* p) {
+	int len = object_len(o);
+	for (int i = 0; i < len; i++) {
+		if (o->obj_type == OT_SQUARE) {
+			p[i].x = (i == 1 || i == 2) ? o->width : 0.0f;
+			p[i].y = (i == 2 || i == 3) ? o->height : 0.0f;
+		} else if (o->obj_type == OT_ELLIPSE) {
+			float angle = 2.0f * M_PI * i / ELLIPSE_POINTS;
+			p[i].x = o->width / 2.0f * (1.0f + cosf(angle));
+			p[i].y = o->height / 2.0f * (1.0f + sinf(angle));
+		} else {
+			p[i].x = o->content.shape->points[i][0];
+			p[i].y = o->content.shape->points[i][1];
+		}
+	}
+
+	float c = cosf(o->rotation * M_PI / 180.0f);
+	float s = sinf(o->rotation * M_PI / 180.0f);
+	for (int i = 0; i < len; i++) {
+		float x = p[i].x * c - p[i].y * s + o->x;
+		float y = p[i].x * s + p[i].y * c + o->y;
+		p[i].x = x / tile_w;
+		p[i].y = y / tile_h;
+	}
+}
+
+static void append_polygon(struct tileshapes* ts, int* capacity, const struct tileshape_polygon* p) {
+	if (ts->polygons_len == *capacity) {
+		*capacity = *capacity == 0 ? 64 : *capacity * 2;
+		ts->polygons = realloc(ts->polygons, *capacity * sizeof(struct tileshape_polygon));
+	}
+	ts->polygons[ts->polygons_len++] = *p;
+}
+
+/*
+ * Compiles the collision objects of a tile into convex polygons within the
+ * tile, at the end of the polygons of the table. Returns the amount of them,
+ * or 0 when the tile is solid all over.
+ */
+static int compile_tile(struct tileshapes* ts, int* capacity, const tmx_tile* tile) {
+	float tile_w = tile->image != NULL ? tile->image->width : tile->tileset->tile_width;
+	float tile_h = tile->image != NULL ? tile->image->height : tile->tileset->tile_height;
+
+	int first = ts->polygons_len;
+	for (const tmx_object* o = tile->collision; o != NULL; o = o->next) {
+		int len = object_len(o);
+		if (len == 0) {
+			continue;
+		}
+
+		// The hull and every cut of it may add a point.
+		struct point* p = malloc(len * sizeof(struct point));
+		struct point* a = malloc((len + 5) * sizeof(struct point));
+		struct point* b = malloc((len + 5) * sizeof(struct point));
+		object_points(o, tile_w, tile_h, p);
+		int n = convex_hull(p, len, a);
+		n = clip(a, n, b, 0, 0.0f, 1.0f);
+		n = clip(b, n, a, 0, 1.0f, -1.0f);
+		n = clip(a, n, b, 1, 0.0f, 1.0f);
+		n = clip(b, n, a, 1, 1.0f, -1.0f);
+		n = drop_duplicates(a, n);
+
+		float size = n >= 3 ? area(a, n) : 0.0f;
+		if (size >= FULL_AREA) {
+			free(p);
+			free(a);
+			free(b);
+			ts->polygons_len = first;
+			return 0;
+		}
+
+		if (size > 0.0f) {
+			struct tileshape_polygon poly = { .len = n };
+			if (n > TILESHAPE_POINTS) {
+				// Too many points, so the bounds of them it is.
+				float x1 = 1.0f, y1 = 1.0f, x2 = 0.0f, y2 = 0.0f;
+				for (int i = 0; i < n; i++) {
+					x1 = SDL_min(x1, a[i].x);
+					y1 = SDL_min(y1, a[i].y);
+					x2 = SDL_max(x2, a[i].x);
+					y2 = SDL_max(y2, a[i].y);
+				}
+				a[0] = (struct point){ x1, y1 };
+				a[1] = (struct point){ x2, y1 };
+				a[2] = (struct point){ x2, y2 };
+				a[3] = (struct point){ x1, y2 };
+				poly.len = 4;
+			}
+			for (int i = 0; i < poly.len; i++) {
+				poly.x[i] = a[i].x;
+				poly.y[i] = a[i].y;
+			}
+			append_polygon(ts, capacity, &poly);
+		}
+		free(p);
+		free(a);
+		free(b);
+	}
+	return ts->polygons_len - first;
+}
+
+/*
+ * Flips the points of a polygon like Tiled flips a tile: first along its
+ * diagonal, then horizontally, then vertically.
+ */
+static void orient_polygon(struct tileshape_polygon* p, unsigned int orientation) {
+	for (int i = 0; i < p->len; i++) {
+		float u = p->x[i];
+		float v = p->y[i];
+		if (orientation & TILE_FLIP_DIAGONAL) {
+			float swap = u;
+			u = v;
+			v = swap;
+		}
+		if (orientation & TILE_FLIP_HORIZONTAL) {
+			u = 1.0f - u;
+		}
+		if (orientation & TILE_FLIP_VERTICAL) {
+			v = 1.0f - v;
+		}
+		p->x[i] = u;
+		p->y[i] = v;
+	}
+}
+
+/*
+ * Projects the polygon, which has its points in world units, onto an axis.
+ */
+static inline void project_polygon(const float* px, const float* py, int len, float ax, float ay, float* lo, float* hi) {
+	*lo = INFINITY;
+	*hi = -INFINITY;
+	for (int i = 0; i < len; i++) {
+		float d = px[i] * ax + py[i] * ay;
+		*lo = SDL_min(*lo, d);
+		*hi = SDL_max(*hi, d);
+	}
+}
+
+static inline void project_box(float x, float y, float w, float h, float ax, float ay, float* lo, float* hi) {
+	float d = x * ax + y * ay;
+	*lo = d + SDL_min(w * ax, 0.0f) + SDL_min(h * ay, 0.0f);
+	*hi = d + SDL_max(w * ax, 0.0f) + SDL_max(h * ay, 0.0f);
+}
+
+/*
+ * Puts the points of the polygon in world units in (px, py), and returns the
+ * amount of axes to test: the two of the box, and then the normals of the
+ * sides of the polygon, which are put in (ax, ay).
+ */
+static int separating_axes(const struct tileshape_polygon* p, float tile_x, float tile_y, float tile_w, float tile_h,
+	float* px, float* py, float* ax, float* ay) {
+
+	for (int i = 0; i < p->len; i++) {
+		px[i] = tile_x + p->x[i] * tile_w;
+		py[i] = tile_y + p->y[i] * tile_h;
+	}
+
+	int n = 0;
+	ax[n] = 1.0f;
+	ay[n++] = 0.0f;
+	ax[n] = 0.0f;
+	ay[n++] = 1.0f;
+	for (int i = 0; i < p->len; i++) {
+		int j = (i + 1) % p->len;
+		float ex = px[j] - px[i];
+		float ey = py[j] - py[i];
+		float len = sqrtf(ex * ex + ey * ey);
+		// Sides along the axes of the box are tested already.
+		if (len == 0.0f || ex == 0.0f || ey == 0.0f) {
+			continue;
+		}
+		ax[n] = ey / len;
+		ay[n++] = -ex / len;
+	}
+	return n;
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct tileshapes* tileshapes_create(const tmx_map* map) {
+	struct tileshapes* ts = calloc(1, sizeof(struct tileshapes));
+	ts->len = map->tilecount << 3;
+	ts->shapes = calloc(ts->len, sizeof(struct tileshape));
+
+	int capacity = 0;
+	int partial = 0;
+	for (uint32_t gid = 0; gid < map->tilecount; gid++) {
+		const tmx_tile* tile = map->tiles[gid];
+		if (tile == NULL || tile->collision == NULL) {
+			continue;
+		}
+
+		int first = ts->polygons_len;
+		int len = compile_tile(ts, &capacity, tile);
+		if (len == 0) {
+			continue;
+		}
+
+		// The polygons as they are become those of the unflipped tile,
+		// the flipped ones are added after them.
+		partial++;
+		for (unsigned int orientation = 0; orientation < 8; orientation++) {
+			struct tileshape* s = &ts->shapes[(gid << 3) | orientation];
+			s->partial = true;
+			s->first = orientation == 0 ? first : ts->polygons_len;
+			s->len = len;
+			for (int i = 0; orientation > 0 && i < len; i++) {
+				struct tileshape_polygon p = ts->polygons[first + i];
+				orient_polygon(&p, orientation);
+				append_polygon(ts, &capacity, &p);
+			}
+		}
+	}
+
+	if (partial == 0) {
+		tileshapes_free(ts);
+		return NULL;
+	}
+
+	debug_print("Compiled the collision shapes of %d tiles into %d polygons\n", partial, ts->polygons_len);
+	return ts;
+}
+
+void tileshapes_free(struct tileshapes* ts) {
+	free(ts->shapes);
+	free(ts->polygons);
+	free(ts);
+}
+
+const struct tileshape* tileshapes_find(const struct tileshapes* ts, uint32_t gid) {
+	uint32_t idx = tile_render_index(gid);
+	return idx < ts->len ? &ts->shapes[idx] : NULL;
+}
+
+bool tileshapes_partial(const struct tileshapes* ts, uint32_t gid) {
+	if (ts == NULL) {
+		return false;
+	}
+	const struct tileshape* s = tileshapes_find(ts, gid);
+	return s != NULL && s->partial;
+}
+
+float tileshape_sweep(const struct tileshape_polygon* p, float tile_x, float tile_y, float tile_w, float tile_h,
+	float x, float y, float w, float h, float dx, float dy, float* normal_x, float* normal_y) {
+
+	float px[TILESHAPE_POINTS], py[TILESHAPE_POINTS];
+	float ax[TILESHAPE_POINTS + 2], ay[TILESHAPE_POINTS + 2];
+	int axes = separating_axes(p, tile_x, tile_y, tile_w, tile_h, px, py, ax, ay);
+
+	// The box touches the polygon once it is past it along every axis, and
+	// leaves it again once it is past it along any. Where a corner of the box
+	// meets a corner of the polygon, the axes tie. A side of the polygon then
+	// wins over a side of the box, so a box walks up the foot of a slope
+	// instead of against it.
+	float t_enter = -INFINITY;
+	float t_leave = INFINITY;
+	float enter_x = 0.0f, enter_y = 0.0f;
+	float tie = SKIN / sqrtf(dx * dx + dy * dy);
+	float side_enter = -INFINITY;
+	float side_x = 0.0f, side_y = 0.0f;
+
+	// For a box which starts inside, the way out which is the shortest.
+	float depth = INFINITY;
+	float depth_x = 0.0f, depth_y = 0.0f;
+
+	for (int i = 0; i < axes; i++) {
+		float plo, phi, blo, bhi;
+		project_polygon(px, py, p->len, ax[i], ay[i], &plo, &phi);
+		project_box(x, y, w, h, ax[i], ay[i], &blo, &bhi);
+		float v = dx * ax[i] + dy * ay[i];
+
+		float enter, leave;
+		float side = 0.0f;
+		if (bhi <= plo) {
+			if (v <= 0.0f) {
+				return INFINITY;
+			}
+			enter = (plo - bhi) / v;
+			leave = (phi - blo) / v;
+			side = -1.0f;
+		} else if (blo >= phi) {
+			if (v >= 0.0f) {
+				return INFINITY;
+			}
+			enter = (phi - blo) / v;
+			leave = (plo - bhi) / v;
+			side = 1.0f;
+		} else {
+			if (bhi - plo < depth) {
+				depth = bhi - plo;
+				depth_x = -ax[i];
+				depth_y = -ay[i];
+			}
+			if (phi - blo < depth) {
+				depth = phi - blo;
+				depth_x = ax[i];
+				depth_y = ay[i];
+			}
+			enter = -INFINITY;
+			leave = v > 0.0f ? (phi - blo) / v : (v < 0.0f ? (plo - bhi) / v : INFINITY);
+		}
+
+		if (enter > t_enter) {
+			t_enter = enter;
+			enter_x = side * ax[i];
+			enter_y = side * ay[i];
+		}
+		if (i >= 2 && enter > side_enter) {
+			side_enter = enter;
+			side_x = side * ax[i];
+			side_y = side * ay[i];
+		}
+		t_leave = SDL_min(t_leave, leave);
+	}
+	if (side_enter > -INFINITY && side_enter >= t_enter - tie) {
+		enter_x = side_x;
+		enter_y = side_y;
+	}
+
+	if (t_enter == -INFINITY) {
+		// Already inside, which only stops a box that is barely in and
+		// still moving further in.
+		if (depth < SKIN && dx * depth_x + dy * depth_y < -CREEP) {
+			*normal_x = depth_x;
+			*normal_y = depth_y;
+			return 0.0f;
+		}
+		return INFINITY;
+	}
+	if (t_enter >= t_leave || t_enter > 1.0f) {
+		return INFINITY;
+	}
+	*normal_x = enter_x;
+	*normal_y = enter_y;
+	return t_enter;
+}
+
+bool tileshape_overlaps(const struct tileshape_polygon* p, float tile_x, float tile_y, float tile_w, float tile_h,
+	float x, float y, float w, float h) {
+
+	float px[TILESHAPE_POINTS], py[TILESHAPE_POINTS];
+	float ax[TILESHAPE_POINTS + 2], ay[TILESHAPE_POINTS + 2];
+	int axes = separating_axes(p, tile_x, tile_y, tile_w, tile_h, px, py, ax, ay);
+	for (int i = 0; i < axes; i++) {
+		float plo, phi, blo, bhi;
+		project_polygon(px, py, p->len, ax[i], ay[i], &plo, &phi);
+		project_box(x, y, w, h, ax[i], ay[i], &blo, &bhi);
+		if (bhi <= plo || blo >= phi) {
+			return false;
+		}
+	}
+	return true;
+}
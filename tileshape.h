@@ -0,0 +1,91 @@
+#ifndef TILESHAPE_H
+#define TILESHAPE_H
+
+#include "tmx/tmx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The most points of a polygon. Larger ones are replaced by their bounds.
+#define TILESHAPE_POINTS 12
+
+/*
+ * A convex polygon within a tile. Its points are in tiles: (0, 0) is the
+ * top-left corner of the tile, and (1, 1) its bottom-right one.
+ */
+struct tileshape_polygon {
+	int len;
+	float x[TILESHAPE_POINTS];
+	float y[TILESHAPE_POINTS];
+};
+
+/*
+ * The solid part of a tile: either all of it, or the polygons from `first'
+ * in the polygons of the table.
+ */
+struct tileshape {
+	bool partial;
+	int first;
+	int len;
+};
+
+/*
+ * The collision shapes of the tiles, compiled from the object groups which
+ * Tiled keeps per tile. Rectangles, polygons and ellipses become convex
+ * polygons: a polygon which is not convex is replaced by its convex hull, and
+ * an ellipse by an octagon. Whatever sticks out of the tile is cut off. Tiles
+ * without any of these, or with a shape covering all of the tile, are solid
+ * all over.
+ *
+ * There is a shape for every gid and every combination of the flip bits, so
+ * flipped and rotated slopes need no work when they are tested.
+ */
+struct tileshapes {
+	struct tileshape* shapes; // Indexed like the render table of a tilemap.
+	uint32_t len;
+
+	struct tileshape_polygon* polygons;
+	int polygons_len;
+};
+
+/*
+ * Compiles the shapes of the tiles of the map. Returns NULL when every tile
+ * is solid all over, which needs no table.
+ */
+struct tileshapes* tileshapes_create(const tmx_map* map);
+void tileshapes_free(struct tileshapes* ts);
+
+/*
+ * Returns the shape of a gid, including its flip bits.
+ */
+const struct tileshape* tileshapes_find(const struct tileshapes* ts, uint32_t gid);
+
+/*
+ * Whether the gid, including its flip bits, is only partly solid.
+ */
+bool tileshapes_partial(const struct tileshapes* ts, uint32_t gid);
+
+/*
+ * Sweeps the box at (x, y) of w x h world units, moving (dx, dy), against a
+ * polygon of the tile at (tile_x, tile_y) in world units, which is tile_w x
+ * tile_h large. Returns the fraction of the movement after which the box
+ * touches the polygon, and puts the normal of the side it touches, pointing
+ * out of the polygon, in (normal_x, normal_y). Returns a value above 1 when
+ * the box does not touch it.
+ *
+ * A box which only touches the polygon does not overlap it. A box which
+ * already overlaps it is not stopped, unless it is less than a hair in while
+ * still moving further in. That is where rounding leaves a box after it was
+ * stopped by a slope, so it stays on top of the slope.
+ */
+float tileshape_sweep(const struct tileshape_polygon* p, float tile_x, float tile_y, float tile_w, float tile_h,
+	float x, float y, float w, float h, float dx, float dy, float* normal_x, float* normal_y);
+
+/*
+ * Whether the box at (x, y) of w x h world units overlaps a polygon of the tile
+ * at (tile_x, tile_y) in world units, which is tile_w x tile_h large.
+ */
+bool tileshape_overlaps(const struct tileshape_polygon* p, float tile_x, float tile_y, float tile_w, float tile_h,
+	float x, float y, float w, float h);
+
+#endif // TILESHAPE_H
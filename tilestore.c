@@ -0,0 +1,192 @@
+#include "tilestore.h"
+#include "coordmap.h"
+#include "util.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+//#############################################################################
+// Private functions.
+//#############################################################################
+
+/*
+ * Adds a chunk to the hash table. Returns NULL when it could not be allocated,
+ * and leaves the table as it was.
+ */
+static struct tilestore_chunk* insert(struct tilestore* ts, int cx, int cy, tmx_chunk* chunk) {
+	assert(coordmap_get(ts->chunks, cx, cy) == NULL);
+	struct tilestore_chunk* c = calloc(1, sizeof(struct tilestore_chunk));
+	if (c == NULL || !coordmap_put(ts->chunks, cx, cy, c)) {
+		free(c);
+		return NULL;
+	}
+	c->cx = cx;
+	c->cy = cy;
+	c->chunk = chunk;
+	return c;
+}
+
+/*
+ * Adds an empty chunk to the TMX layer, which frees it with the map.
+ */
+static struct tilestore_chunk* add_layer_chunk(struct tilestore* ts, int cx, int cy) {
+	size_t size = ts->chunk_w * ts->chunk_h * sizeof(int32_t);
+	tmx_chunk* chunk = tmx_alloc_func(NULL, sizeof(tmx_chunk));
+	int32_t* gids = tmx_alloc_func(NULL, size);
+	if (chunk == NULL || gids == NULL) {
+		tmx_free_func(chunk);
+		tmx_free_func(gids);
+		return NULL;
+	}
+
+	memset(gids, 0, size);
+	chunk->x = ts->origin_x + cx * ts->chunk_w;
+	chunk->y = ts->origin_y + cy * ts->chunk_h;
+	chunk->width = ts->chunk_w;
+	chunk->height = ts->chunk_h;
+	chunk->gids = gids;
+
+	struct tilestore_chunk* c = insert(ts, cx, cy, chunk);
+	if (c == NULL) {
+		tmx_free_func(chunk);
+		tmx_free_func(gids);
+		return NULL;
+	}
+	chunk->next = ts->layer->chunk_head;
+	ts->layer->chunk_head = chunk;
+	return c;
+}
+
+/*
+ * Adds an empty chunk which belongs to the store.
+ */
+static struct tilestore_chunk* add_owned_chunk(struct tilestore* ts, int cx, int cy) {
+	int32_t* gids = calloc(ts->chunk_w * ts->chunk_h, sizeof(int32_t));
+	if (gids == NULL) {
+		return NULL;
+	}
+	struct tilestore_chunk* c = tilestore_insert(ts, cx, cy, gids);
+	if (c == NULL) {
+		free(gids);
+	}
+	return c;
+}
+
+static void free_owned(struct tilestore_chunk* c) {
+	free(c->chunk->gids);
+	free(c->chunk);
+}
+
+//#############################################################################
+// Public functions.
+//#############################################################################
+
+struct tilestore* tilestore_create(tmx_layer* layer, int chunk_w, int chunk_h, int origin_x, int origin_y) {
+	struct tilestore* ts = calloc(1, sizeof(struct tilestore));
+	if (ts == NULL) {
+		return NULL;
+	}
+	ts->chunks = coordmap_create();
+	if (ts->chunks == NULL) {
+		free(ts);
+		return NULL;
+	}
+	ts->layer = layer;
+	ts->chunk_w = chunk_w;
+	ts->chunk_h = chunk_h;
+	ts->origin_x = origin_x;
+	ts->origin_y = origin_y;
+
+	for (tmx_chunk* c = layer->chunk_head; c != NULL; c = c->next) {
+		assert((int)c->width == chunk_w && (int)c->height == chunk_h);
+		assert((c->x - origin_x) % chunk_w == 0 && (c->y - origin_y) % chunk_h == 0);
+		if (insert(ts, (c->x - origin_x) / chunk_w, (c->y - origin_y) / chunk_h, c) == NULL) {
+			tilestore_free(ts);
+			return NULL;
+		}
+	}
+
+	return ts;
+}
+
+void tilestore_free(struct tilestore* ts) {
+	for (uint32_t i = 0; i < ts->chunks->capacity; i++) {
+		struct tilestore_chunk* c = ts->chunks->slots[i].value;
+		if (c == NULL) {
+			continue;
+		}
+		if (c->owned) {
+			free_owned(c);
+		}
+		free(c->occluded);
+		free(c);
+	}
+	coordmap_free(ts->chunks);
+	free(ts);
+}
+
+struct tilestore_chunk* tilestore_find(const struct tilestore* ts, int cx, int cy) {
+	return coordmap_get(ts->chunks, cx, cy);
+}
+
+struct tilestore_chunk* tilestore_insert(struct tilestore* ts, int cx, int cy, int32_t* gids) {
+	tmx_chunk* chunk = calloc(1, sizeof(tmx_chunk));
+	if (chunk == NULL) {
+		return NULL;
+	}
+	chunk->x = ts->origin_x + cx * ts->chunk_w;
+	chunk->y = ts->origin_y + cy * ts->chunk_h;
+	chunk->width = ts->chunk_w;
+	chunk->height = ts->chunk_h;
+	chunk->gids = gids;
+
+	struct tilestore_chunk* c = insert(ts, cx, cy, chunk);
+	if (c == NULL) {
+		free(chunk);
+		return NULL;
+	}
+	c->owned = true;
+	return c;
+}
+
+void tilestore_remove(struct tilestore* ts, int cx, int cy) {
+	struct tilestore_chunk* c = tilestore_find(ts, cx, cy);
+	if (c == NULL) {
+		return;
+	}
+	assert(c->owned);
+	coordmap_remove(ts->chunks, cx, cy);
+	free_owned(c);
+	free(c->occluded);
+	free(c);
+}
+
+uint32_t tilestore_get(const struct tilestore* ts, int x, int y) {
+	const struct tilestore_chunk* c = tilestore_find(ts, x / ts->chunk_w, y / ts->chunk_h);
+	if (c == NULL) {
+		return 0;
+	}
+	return c->chunk->gids[(y % ts->chunk_h) * ts->chunk_w + (x % ts->chunk_w)];
+}
+
+bool tilestore_set(struct tilestore* ts, int x, int y, uint32_t gid) {
+	int cx = x / ts->chunk_w;
+	int cy = y / ts->chunk_h;
+
+	struct tilestore_chunk* c = tilestore_find(ts, cx, cy);
+	if (c == NULL) {
+		if (gid == 0) {
+			return true;
+		}
+
+		c = ts->streamed ? add_owned_chunk(ts, cx, cy) : add_layer_chunk(ts, cx, cy);
+		if (c == NULL) {
+			debug_print("Unable to allocate a chunk for (%d, %d)\n", x, y);
+			return false;
+		}
+	}
+
+	c->chunk->gids[(y % ts->chunk_h) * ts->chunk_w + (x % ts->chunk_w)] = gid;
+	return true;
+}
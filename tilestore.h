@@ -0,0 +1,84 @@
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include "tmx/tmx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct coordmap;
+
+/*
+ * A chunk of a tile store: the TMX chunk holding its tiles, and a bit per cell
+ * which is set when the tile there is covered by layers drawn after it.
+ */
+struct tilestore_chunk {
+	int cx;              // The chunk x coordinate (in chunks, not tiles).
+	int cy;              // The chunk y coordinate (in chunks, not tiles).
+	tmx_chunk* chunk;
+	uint32_t* occluded;  // NULL when no cell is covered.
+	bool owned;          // Whether the chunk belongs to the store.
+};
+
+/*
+ * A tile store holds the tiles of a layer of an infinite map. Such a layer is
+ * made of chunks, of which only the ones with tiles exist, so an empty region
+ * costs no memory at all. The chunks are found through a hash table on their
+ * chunk coordinates, and stay where they are until they are removed.
+ *
+ * Coordinates are relative to the top-left of the map, which is `origin' in
+ * TMX coordinates, so they are never negative. The chunks of the TMX layer
+ * belong to the layer. The store can also hold chunks of its own, which come
+ * and go while the map is streamed from region files.
+ */
+struct tilestore {
+	tmx_layer* layer;
+	int chunk_w;  // The width of every chunk, in tiles.
+	int chunk_h;  // The height of every chunk, in tiles.
+	int origin_x; // The TMX tile coordinate of tile (0, 0).
+	int origin_y;
+	bool streamed; // New chunks belong to the store, not to the TMX layer.
+
+	struct coordmap* chunks; // The tilestore_chunk of every chunk.
+};
+
+/*
+ * Creates a store for the chunks of the layer. Every chunk must be chunk_w x
+ * chunk_h tiles, at a multiple of that size from the origin. Returns NULL when
+ * the store could not be allocated.
+ */
+struct tilestore* tilestore_create(tmx_layer* layer, int chunk_w, int chunk_h, int origin_x, int origin_y);
+void tilestore_free(struct tilestore* ts);
+
+/*
+ * Finds the chunk at chunk coordinate (cx, cy), or NULL when it has no tiles.
+ */
+struct tilestore_chunk* tilestore_find(const struct tilestore* ts, int cx, int cy);
+
+/*
+ * Adds chunk (cx, cy), which must not exist yet. The store takes over the
+ * gids, which must have been allocated with malloc. Returns NULL when the
+ * chunk could not be allocated, and the gids are left to the caller then.
+ */
+struct tilestore_chunk* tilestore_insert(struct tilestore* ts, int cx, int cy, int32_t* gids);
+
+/*
+ * Removes chunk (cx, cy), which must have been added by the store itself.
+ * Nothing happens when it does not exist.
+ */
+void tilestore_remove(struct tilestore* ts, int cx, int cy);
+
+/*
+ * Returns the gid of the tile at (x, y), including the TMX flip bits. Tiles
+ * outside of every chunk are empty.
+ */
+uint32_t tilestore_get(const struct tilestore* ts, int x, int y);
+
+/*
+ * Sets the gid of the tile at (x, y). A chunk is added to the layer (or to the
+ * store, when it is streamed) when the cell was not in one yet, unless the tile
+ * is empty. Returns false when the chunk could not be allocated.
+ */
+bool tilestore_set(struct tilestore* ts, int x, int y, uint32_t gid);
+
+#endif // TILESTORE_H
@@ -15,6 +15,7 @@ void* (*tmx_alloc_func) (void *address, size_t len) = NULL;
 void  (*tmx_free_func ) (void *address) = NULL;
 void* (*tmx_img_load_func) (const char *p) = NULL;
 void  (*tmx_img_free_func) (void *address) = NULL;
+int tmx_skip_chunks = 0;
 
 /*
 	Public functions
@@ -42,6 +42,10 @@ TMXEXPORT extern void  (*tmx_free_func ) (void *address);             /* free */
 TMXEXPORT extern void* (*tmx_img_load_func) (const char *path);
 TMXEXPORT extern void  (*tmx_img_free_func) (void *address);
 
+/* when set, the chunks of infinite maps are not loaded, for programs which
+   load them from elsewhere as they are needed */
+TMXEXPORT extern int tmx_skip_chunks;
+
 /*
 	Data Structures
 */
@@ -69,6 +73,7 @@ typedef struct _tmx_text tmx_text;
 typedef struct _tmx_obj tmx_object;
 typedef struct _tmx_objgr tmx_object_group;
 typedef struct _tmx_templ tmx_template;
+typedef struct _tmx_chunk tmx_chunk;
 typedef struct _tmx_layer tmx_layer;
 typedef struct _tmx_map tmx_map;
 typedef void tmx_properties; /* hashtable, use function tmx_get_property(...) */
@@ -203,6 +208,13 @@ struct _tmx_templ { /* <template> */
 	tmx_object *object; /* never null */
 };
 
+struct _tmx_chunk { /* <chunk> (in layers of infinite maps) */
+	int x, y; /* in tiles, may be negative */
+	unsigned int width, height;
+	int32_t *gids;
+	tmx_chunk *next;
+};
+
 struct _tmx_layer { /* <layer> or <imagelayer> or <objectgroup> */
 	char *name;
 	double opacity;
@@ -216,6 +228,7 @@ struct _tmx_layer { /* <layer> or <imagelayer> or <objectgroup> */
 		tmx_image *image;
 		tmx_layer *group_head;
 	} content;
+	tmx_chunk *chunk_head; /* tile layers of infinite maps, content.gids is NULL; empty chunks are left out */
 
 	tmx_user_data user_data;
 	tmx_properties *properties;
@@ -224,6 +237,7 @@ struct _tmx_layer { /* <layer> or <imagelayer> or <objectgroup> */
 
 struct _tmx_map { /* <map> (Head of the data structure) */
 	enum tmx_map_orient orient;
+	int infinite; /* 0 == false, the tile layers are stored in chunks */
 
 	unsigned int width, height;
 	unsigned int tile_width, tile_height;
@@ -67,6 +67,10 @@ tmx_object_group* alloc_objgr(void) {
 	return (tmx_object_group*)node_alloc(sizeof(tmx_object_group));
 }
 
+tmx_chunk* alloc_chunk(void) {
+	return (tmx_chunk*)node_alloc(sizeof(tmx_chunk));
+}
+
 tmx_layer* alloc_layer(void) {
 	tmx_layer *res = (tmx_layer*)node_alloc(sizeof(tmx_layer));
 	if (res) {
@@ -180,12 +184,23 @@ void free_image(tmx_image *i) {
 	}
 }
 
+void free_chunks(tmx_chunk *c) {
+	tmx_chunk *next;
+	while (c) {
+		next = c->next;
+		tmx_free_func(c->gids);
+		tmx_free_func(c);
+		c = next;
+	}
+}
+
 void free_layers(tmx_layer *l) {
 	if (l) {
 		free_layers(l->next);
 		tmx_free_func(l->name);
 		if (l->type == L_LAYER) {
 			tmx_free_func(l->content.gids);
+			free_chunks(l->chunk_head);
 		}
 		else if (l->type == L_OBJGR) {
 			free_objgr(l->content.objgr);
@@ -249,6 +249,10 @@ int data_decode(const char *source, enum enccmp_t type, size_t gids_count, int32
 	else if (type==B64) {
 		*gids = (int32_t*)b64_decode(source, &b64_len);
 		if (!(*gids)) return 0;
+		if (b64_len < gids_count * sizeof(int32_t)) {
+			tmx_err(E_BDATA, "layer data is too short: %u bytes for %u tiles", b64_len, (unsigned int)gids_count);
+			return 0;
+		}
 	}
 
 	return 1;
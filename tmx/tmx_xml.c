@@ -373,49 +373,149 @@ static int parse_object(xmlTextReaderPtr reader, tmx_object *obj, int is_on_map,
 	return 1;
 }
 
-static int parse_data(xmlTextReaderPtr reader, int32_t **gidsadr, size_t gidscount) {
-	char *value, *inner_xml;
+/* reads the encoding and compression of a 'data' element */
+static int parse_data_encoding(xmlTextReaderPtr reader, enum enccmp_t *type) {
+	char *value, *compression;
 
 	if (!(value = (char*)xmlTextReaderGetAttribute(reader, (xmlChar*)"encoding"))) { /* encoding */
 		tmx_err(E_MISSEL, "xml parser: missing 'encoding' attribute in the 'data' element");
 		return 0;
 	}
 
-	if (!(inner_xml = (char*)xmlTextReaderReadInnerXml(reader))) {
-		tmx_err(E_XDATA, "xml parser: missing content in the 'data' element");
-		tmx_free_func(value);
-		return 0;
-	}
-
 	if (!strcmp(value, "base64")) {
-		tmx_free_func(value);
-		value = (char*)xmlTextReaderGetAttribute(reader, (xmlChar*)"compression"); /* compression */
+		compression = (char*)xmlTextReaderGetAttribute(reader, (xmlChar*)"compression"); /* compression */
 
-		if (value && strcmp(value, "zlib") && strcmp(value, "gzip")) {
-			tmx_err(E_ENCCMP, "xml parser: unsupported data compression: '%s'", value); /* unsupported compression */
+		if (compression && strcmp(compression, "zlib") && strcmp(compression, "gzip")) {
+			tmx_err(E_ENCCMP, "xml parser: unsupported data compression: '%s'", compression); /* unsupported compression */
+			tmx_free_func(compression);
 			goto cleanup;
 		}
-		if (!data_decode(str_trim(inner_xml), value ? B64Z : B64, gidscount, gidsadr)) goto cleanup;
+		*type = compression ? B64Z : B64;
+		tmx_free_func(compression);
 
 	} else if (!strcmp(value, "xml")) {
 		tmx_err(E_ENCCMP, "xml parser: unimplemented data encoding: XML");
 		goto cleanup;
 	} else if (!strcmp(value, "csv")) {
-		if (!data_decode(str_trim(inner_xml), CSV, gidscount, gidsadr)) goto cleanup;
+		*type = CSV;
 	} else {
 		tmx_err(E_ENCCMP, "xml parser: unknown data encoding: %s", value);
 		goto cleanup;
 	}
 	tmx_free_func(value);
-	tmx_free_func(inner_xml);
 	return 1;
 
 cleanup:
 	tmx_free_func(value);
-	tmx_free_func(inner_xml);
 	return 0;
 }
 
+static int parse_data(xmlTextReaderPtr reader, int32_t **gidsadr, size_t gidscount) {
+	enum enccmp_t type;
+	char *inner_xml;
+
+	if (!parse_data_encoding(reader, &type)) return 0;
+
+	if (!(inner_xml = (char*)xmlTextReaderReadInnerXml(reader))) {
+		tmx_err(E_XDATA, "xml parser: missing content in the 'data' element");
+		return 0;
+	}
+
+	if (!data_decode(str_trim(inner_xml), type, gidscount, gidsadr)) {
+		tmx_free_func(inner_xml);
+		return 0;
+	}
+	tmx_free_func(inner_xml);
+	return 1;
+}
+
+/* reads a required integer attribute of a 'chunk' element */
+static int parse_chunk_attribute(xmlTextReaderPtr reader, const char *name, int *res) {
+	char *value;
+	if (!(value = (char*)xmlTextReaderGetAttribute(reader, (xmlChar*)name))) {
+		tmx_err(E_MISSEL, "xml parser: missing '%s' attribute in the 'chunk' element", name);
+		return 0;
+	}
+	*res = atoi(value);
+	tmx_free_func(value);
+	return 1;
+}
+
+/* parses the 'chunk' elements in the 'data' element of an infinite map,
+   chunks without any tile are left out */
+static int parse_chunks(xmlTextReaderPtr reader, tmx_chunk **chunk_headadr) {
+	enum enccmp_t type;
+	tmx_chunk *res;
+	int32_t *gids;
+	char *inner_xml;
+	int curr_depth, x, y, width, height;
+	size_t i, count;
+
+	curr_depth = xmlTextReaderDepth(reader);
+
+	if (!parse_data_encoding(reader, &type)) return 0;
+
+	if (xmlTextReaderIsEmptyElement(reader)) {
+		return 1;
+	}
+
+	do {
+		if (xmlTextReaderRead(reader) != 1) return 0; /* error_handler has been called */
+
+		if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+			continue;
+		}
+		if (strcmp((char*)xmlTextReaderConstName(reader), "chunk")) {
+			/* Unknow element, skip its tree */
+			if (xmlTextReaderNext(reader) != 1) return 0;
+			continue;
+		}
+
+		if (!parse_chunk_attribute(reader, "x", &x) || !parse_chunk_attribute(reader, "y", &y) ||
+		    !parse_chunk_attribute(reader, "width", &width) || !parse_chunk_attribute(reader, "height", &height)) {
+			return 0;
+		}
+		if (width <= 0 || height <= 0) {
+			tmx_err(E_XDATA, "xml parser: invalid chunk size %dx%d", width, height);
+			return 0;
+		}
+
+		if (!(inner_xml = (char*)xmlTextReaderReadInnerXml(reader))) {
+			tmx_err(E_XDATA, "xml parser: missing content in the 'chunk' element");
+			return 0;
+		}
+		count = (size_t)width * height;
+		gids = NULL;
+		if (!data_decode(str_trim(inner_xml), type, count, &gids)) {
+			tmx_free_func(inner_xml);
+			tmx_free_func(gids);
+			return 0;
+		}
+		tmx_free_func(inner_xml);
+
+		for (i=0; i<count && gids[i] == 0; i++);
+		if (i == count) {
+			tmx_free_func(gids);
+			continue;
+		}
+
+		if (!(res = alloc_chunk())) {
+			tmx_free_func(gids);
+			return 0;
+		}
+		res->x = x;
+		res->y = y;
+		res->width = width;
+		res->height = height;
+		res->gids = gids;
+		res->next = *chunk_headadr;
+		*chunk_headadr = res;
+	} while (xmlTextReaderNodeType(reader) != XML_READER_TYPE_END_ELEMENT ||
+	         xmlTextReaderDepth(reader) != curr_depth);
+
+	return 1;
+}
+
 static int parse_image(xmlTextReaderPtr reader, tmx_image **img_adr, short strict, const char *filename) {
 	tmx_image *res;
 	char *value;
@@ -460,7 +560,7 @@ static int parse_image(xmlTextReaderPtr reader, tmx_image **img_adr, short stric
 }
 
 /* parse layers and objectgroups */
-static int parse_layer(xmlTextReaderPtr reader, tmx_layer **layer_headadr, int map_h, int map_w, enum tmx_layer_type type, tmx_resource_manager *rc_mgr, const char *filename) {
+static int parse_layer(xmlTextReaderPtr reader, tmx_layer **layer_headadr, int map_h, int map_w, int infinite, enum tmx_layer_type type, tmx_resource_manager *rc_mgr, const char *filename) {
 	tmx_layer *res;
 	tmx_object *obj;
 	int curr_depth;
@@ -531,6 +631,10 @@ static int parse_layer(xmlTextReaderPtr reader, tmx_layer **layer_headadr, int m
 			name = (char*)xmlTextReaderConstName(reader);
 			if (!strcmp(name, "properties")) {
 				if (!parse_properties(reader, &(res->properties))) return 0;
+			} else if (!strcmp(name, "data") && infinite && tmx_skip_chunks) {
+				if (xmlTextReaderNext(reader) != 1) return 0;
+			} else if (!strcmp(name, "data") && infinite) {
+				if (!parse_chunks(reader, &(res->chunk_head))) return 0;
 			} else if (!strcmp(name, "data")) {
 				if (!parse_data(reader, &(res->content.gids), map_h * map_w)) return 0;
 			} else if (!strcmp(name, "image")) {
@@ -543,7 +647,7 @@ static int parse_layer(xmlTextReaderPtr reader, tmx_layer **layer_headadr, int m
 
 				if (!parse_object(reader, obj, 1, rc_mgr, filename)) return 0;
 			} else if (type == L_GROUP && (child_type = parse_layer_type(name)) != L_NONE) {
-				if (!parse_layer(reader, &(res->content.group_head), map_h, map_w, child_type, rc_mgr, filename)) return 0;
+				if (!parse_layer(reader, &(res->content.group_head), map_h, map_w, infinite, child_type, rc_mgr, filename)) return 0;
 			} else {
 				/* Unknow element, skip its tree */
 				if (xmlTextReaderNext(reader) != 1) return 0;
@@ -913,21 +1017,17 @@ static int parse_template(xmlTextReaderPtr reader, tmx_template *template, tmx_r
 }
 
 static int parse_map(xmlTextReaderPtr reader, tmx_map *map, tmx_resource_manager *rc_mgr, const char *filename) {
-	int curr_depth, flag;
+	int curr_depth;
 	const char *name;
 	char *value;
 	enum tmx_layer_type type;
 
 	curr_depth = xmlTextReaderDepth(reader);
 
-	/* infinite maps not supported */
+	/* infinite maps store their layers in chunks */
 	if ((value = (char*)xmlTextReaderGetAttribute(reader, (xmlChar*)"infinite"))) {
-		flag = atoi(value);
+		map->infinite = atoi(value) == 1;
 		tmx_free_func(value);
-		if (flag == 1) {
-			tmx_err(E_XDATA, "xml parser: chunked layer data is not supported, edit this map to remove the infinite flag");
-			return 0;
-		}
 	}
 
 	/* parses each attribute */
@@ -1016,7 +1116,7 @@ static int parse_map(xmlTextReaderPtr reader, tmx_map *map, tmx_resource_manager
 			} else if (!strcmp(name, "properties")) {
 				if (!parse_properties(reader, &(map->properties))) return 0;
 			} else if ((type = parse_layer_type(name)) != L_NONE) {
-				if (!parse_layer(reader, &(map->ly_head), map->height, map->width, type, rc_mgr, filename)) return 0;
+				if (!parse_layer(reader, &(map->ly_head), map->height, map->width, map->infinite, type, rc_mgr, filename)) return 0;
 			} else {
 				/* Unknow element, skip its tree */
 				if (xmlTextReaderNext(reader) != 1) return 0;